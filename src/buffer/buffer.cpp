@@ -20,6 +20,10 @@ const char* Buffer::Peek() const {
 void Buffer::Retrieve(size_t len) {
     assert(len <= ReadableBytes());
     readPos_ += len;
+    if(readPos_ == writePos_) { // 读空时复位读写位置，不清零内存，后续写入无需挪动数据
+        readPos_ = 0;
+        writePos_ = 0;
+    }
 }
 
 void Buffer::RetrieveUntil(const char* end) {
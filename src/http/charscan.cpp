@@ -0,0 +1,91 @@
+#include "charscan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define CHAR_SCAN_X86 1
+#endif
+
+namespace {
+
+template<bool COLON>
+inline bool IsDelim(char ch) {
+    return ch == '\r' || ch == '\n' || (COLON && ch == ':');
+}
+
+template<bool COLON>
+const char* ScanScalar(const char* p, const char* end) {
+    while(p < end && !IsDelim<COLON>(*p)) { p++; }
+    return p;
+}
+
+#ifdef CHAR_SCAN_X86
+/* SSE4.2：PCMPESTRI 的 EQUAL_ANY 模式一条指令在 16 字节中查找字符集合 */
+template<bool COLON>
+__attribute__((target("sse4.2")))
+const char* ScanSse42(const char* p, const char* end) {
+    const __m128i set = _mm_setr_epi8('\r', '\n', ':', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    const int setLen = COLON ? 3 : 2;
+    while(end - p >= 16) {
+        __m128i data = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        int idx = _mm_cmpestri(set, setLen, data, 16,
+                               _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if(idx < 16) {
+            return p + idx;
+        }
+        p += 16;
+    }
+    return ScanScalar<COLON>(p, end);
+}
+
+/* AVX2：每次比较 32 字节，比较结果压成位掩码后取最低位 */
+template<bool COLON>
+__attribute__((target("avx2")))
+const char* ScanAvx2(const char* p, const char* end) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    const __m256i colon = _mm256_set1_epi8(':');
+    while(end - p >= 32) {
+        __m256i data = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(data, cr), _mm256_cmpeq_epi8(data, lf));
+        if(COLON) {
+            hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(data, colon));
+        }
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(hit));
+        if(mask) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return ScanScalar<COLON>(p, end);
+}
+#endif
+
+} // namespace
+
+const CharScan::Impl& CharScan::Impl_() {
+    static const Impl impl = [] {
+#ifdef CHAR_SCAN_X86
+        __builtin_cpu_init();
+        if(__builtin_cpu_supports("avx2")) {
+            return Impl{ &ScanAvx2<false>, &ScanAvx2<true>, "avx2" };
+        }
+        if(__builtin_cpu_supports("sse4.2")) {
+            return Impl{ &ScanSse42<false>, &ScanSse42<true>, "sse4.2" };
+        }
+#endif
+        return Impl{ &ScanScalar<false>, &ScanScalar<true>, "scalar" };
+    }();
+    return impl;
+}
+
+const char* CharScan::FindEol(const char* p, const char* end) {
+    return Impl_().eol(p, end);
+}
+
+const char* CharScan::FindColonOrEol(const char* p, const char* end) {
+    return Impl_().colonOrEol(p, end);
+}
+
+const char* CharScan::Isa() {
+    return Impl_().name;
+}
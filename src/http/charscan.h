@@ -0,0 +1,28 @@
+#ifndef CHAR_SCAN_H
+#define CHAR_SCAN_H
+
+#include <stddef.h>
+
+/* 请求头解析用的字符查找，运行时按 CPU 选择 AVX2 / SSE4.2 / 标量实现
+   只读 [p, end) 范围内的内存，找不到时返回 end */
+class CharScan {
+public:
+    static const char* FindEol(const char* p, const char* end); // 第一个 '\r' 或 '\n'
+
+    static const char* FindColonOrEol(const char* p, const char* end); // 第一个 ':'、'\r' 或 '\n'
+
+    static const char* Isa(); // 当前使用的实现，用于日志
+
+private:
+    typedef const char* (*ScanFunc)(const char*, const char*);
+
+    struct Impl {
+        ScanFunc eol;
+        ScanFunc colonOrEol;
+        const char* name;
+    };
+
+    static const Impl& Impl_();
+};
+
+#endif //CHAR_SCAN_H
@@ -0,0 +1,325 @@
+#include "filecache.h"
+
+using namespace std;
+
+FileCache::FileCache(): maxBytes_(0), shardBytes_(0), mapLimit_(SIZE_MAX), enabled_(false), inotifyFd_(-1), stopFd_(-1) {}
+
+FileCache::~FileCache() {
+    Close();
+}
+
+FileCache* FileCache::Instance() {
+    static FileCache cache;
+    return &cache;
+}
+
+void FileCache::Init(const string& root, size_t maxBytes, size_t mapLimit) {
+    assert(!root.empty() && root.back() == '/');
+    Close();
+    root_ = root;
+    maxBytes_ = maxBytes;
+    shardBytes_ = maxBytes / SHARDS;
+    mapLimit_ = mapLimit;
+    if(maxBytes_ == 0) { return; }
+    /* 没有 inotify 就无法得知文件变化，不缓存 */
+    inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    stopFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if(inotifyFd_ < 0 || stopFd_ < 0) {
+        LOG_WARN("FileCache: inotify unavailable, cache disabled");
+        Close();
+        return;
+    }
+    AddWatch_(root_);
+    enabled_ = true;
+    watcher_ = thread(&FileCache::Watch_, this);
+}
+
+void FileCache::Close() {
+    if(watcher_.joinable()) {
+        uint64_t one = 1;
+        ssize_t n = write(stopFd_, &one, sizeof(one));
+        (void)n;
+        watcher_.join();
+    }
+    if(inotifyFd_ >= 0) { close(inotifyFd_); }
+    if(stopFd_ >= 0) { close(stopFd_); }
+    inotifyFd_ = stopFd_ = -1;
+    watchDirs_.clear();
+    enabled_ = false;
+    for(Shard& shard: shards_) {
+        lock_guard<mutex> locker(shard.mtx);
+        for(auto it = shard.entries.begin(); it != shard.entries.end(); ) {
+            Erase_(shard, it++);
+        }
+    }
+}
+
+FileRef FileCache::Load_(const string& path, bool compress) const {
+    shared_ptr<CachedFile> file = make_shared<CachedFile>();
+    if(stat(path.c_str(), &file->st) < 0) {
+        file->err = errno;
+        return file;
+    }
+    Validators_(*file);
+    if(!S_ISREG(file->st.st_mode) || !(file->st.st_mode & S_IROTH)) {
+        return file; // 目录、无读权限：只需要 stat 结果
+    }
+    if(file->st.st_size == 0 || static_cast<size_t>(file->st.st_size) >= mapLimit_) {
+        Headers_(path, *file); // 空文件或大文件不映射
+        return file;
+    }
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        file->err = errno;
+        return file;
+    }
+    /* 只读私有映射；映射建立后即可关闭文件描述符 */
+    void* addr = mmap(nullptr, file->st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(addr == MAP_FAILED) {
+        file->err = errno;
+        return file;
+    }
+    file->data = static_cast<char*>(addr);
+    /* 只压缩文本类资源；超出单文件缓存上限的不会入缓存，也不压缩 */
+    if(compress && file->Size() <= shardBytes_ / 4 && MimeType::Lookup(path).compressible) {
+        Gzip_(*file);
+    }
+    Headers_(path, *file);
+    return file;
+}
+
+FileRef FileCache::FromMemory(const string& path, string content, uint64_t version) const {
+    shared_ptr<CachedFile> file = make_shared<CachedFile>();
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+    file->st.st_mode = S_IFREG | 0644;
+    file->st.st_ino = version;
+    file->st.st_size = content.size();
+    file->st.st_mtim = now;
+    file->owned = std::move(content);
+    if(!file->owned.empty()) {
+        file->data = &file->owned[0];
+    }
+    Validators_(*file);
+    if(file->Size() > 0 && MimeType::Lookup(path).compressible) {
+        Gzip_(*file);
+    }
+    Headers_(path, *file);
+    return file;
+}
+
+void FileCache::Headers_(const string& path, CachedFile& file) {
+    const string_view type = MimeType::Lookup(path).type;
+    const string& cacheControl = MimeType::CacheControl(type);
+    for(int gzip = 0; gzip < (file.gzip.empty() ? 1 : 2); gzip++) {
+        string& text = file.header[gzip].text;
+        if(!file.gzip.empty()) {
+            text += "Vary: Accept-Encoding\r\n"; // 同一 URL 有两种编码，缓存需按 Accept-Encoding 区分
+        }
+        /* gzip 版本与原文件内容不同，需要不同的强校验值 */
+        text += "ETag: \"" + file.etag + (gzip ? "-gz" : "") + "\"\r\n";
+        text += "Last-Modified: " + file.lastModified + "\r\n";
+        if(!cacheControl.empty()) {
+            text += "Cache-Control: " + cacheControl + "\r\n";
+        }
+        file.header[gzip].entity = text.size();
+        text += "Accept-Ranges: bytes\r\nContent-type: ";
+        text += type;
+        text += "\r\n";
+        if(gzip) {
+            text += "Content-Encoding: gzip\r\n";
+        }
+    }
+}
+
+/* 校验值随文件版本一起缓存，响应时不必再格式化 */
+void FileCache::Validators_(CachedFile& file) {
+    char buf[64];
+    int n = snprintf(buf, sizeof(buf), "%lx-%lx-%lx", static_cast<unsigned long>(file.st.st_ino),
+                     static_cast<unsigned long>(file.st.st_size),
+                     static_cast<unsigned long>(file.st.st_mtim.tv_sec * 1000000000L + file.st.st_mtim.tv_nsec));
+    file.etag.assign(buf, n);
+    struct tm tm;
+    gmtime_r(&file.st.st_mtime, &tm);
+    file.lastModified.assign(buf, strftime(buf, sizeof(buf), "%a, %d %b %Y %H:%M:%S GMT", &tm));
+}
+
+void FileCache::Gzip_(CachedFile& file) {
+    const size_t size = file.Size();
+    z_stream zs = {};
+    /* windowBits 加 16 输出 gzip 格式；压缩在首次请求的线程中同步进行，用默认级别（6）：
+       最高级别耗时明显更长，文本资源的压缩率只高约 1%，不值得让首个请求等待 */
+    if(deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+        return;
+    }
+    file.gzip.resize(deflateBound(&zs, size));
+    zs.next_in = reinterpret_cast<Bytef*>(file.data);
+    zs.avail_in = size;
+    zs.next_out = reinterpret_cast<Bytef*>(&file.gzip[0]);
+    zs.avail_out = file.gzip.size();
+    int ret = deflate(&zs, Z_FINISH);
+    size_t len = zs.total_out;
+    deflateEnd(&zs);
+    /* 节省不到 1/10 就不值得让客户端解压 */
+    if(ret != Z_STREAM_END || len > size - size / 10) {
+        string().swap(file.gzip);
+        return;
+    }
+    file.gzip.resize(len);
+    file.gzip.shrink_to_fit();
+}
+
+/* 只缓存根目录下的规范路径：含 "//"、"/." 的路径与 inotify 给出的路径对不上，失效不了 */
+bool FileCache::Cacheable_(const string& path) const {
+    return enabled_ && path.size() > root_.size() && path.compare(0, root_.size(), root_) == 0
+            && path.find("//", root_.size() - 1) == string::npos
+            && path.find("/.", root_.size() - 1) == string::npos;
+}
+
+FileRef FileCache::Get(const string& path) {
+    if(!Cacheable_(path)) {
+        return Load_(path, false); // 不缓存的文件每次都会重新加载，不做压缩
+    }
+    Shard& shard = Shard_(path);
+    unique_lock<mutex> locker(shard.mtx);
+    while(true) {
+        auto it = shard.entries.find(path);
+        if(it == shard.entries.end()) { break; }
+        if(!it->second.loading) {
+            shard.lru.splice(shard.lru.begin(), shard.lru, it->second.lru); // 命中：移到表头
+            return it->second.file;
+        }
+        shard.cond.wait(locker); // 其他线程正在加载同一文件，等待其结果
+    }
+    shard.entries.emplace(path, Entry());
+    locker.unlock();
+
+    FileRef file = Load_(path, true);
+
+    locker.lock();
+    auto it = shard.entries.find(path);
+    assert(it != shard.entries.end() && it->second.loading);
+    size_t bytes = (file->data ? file->Size() : 0) + file->gzip.size() + file->header[0].text.size() +
+                   file->header[1].text.size() + path.size() + sizeof(Entry);
+    if(it->second.stale || file->err || bytes > shardBytes_ / 4) {
+        shard.entries.erase(it); // 加载期间文件已变化、文件不存在（不缓存未命中），或单个文件太大不值得占用缓存
+    } else {
+        Entry& entry = it->second;
+        entry.file = file;
+        entry.bytes = bytes;
+        entry.loading = false;
+        shard.lru.push_front(path);
+        entry.lru = shard.lru.begin();
+        shard.bytes += bytes;
+        Evict_(shard);
+    }
+    shard.cond.notify_all();
+    return file;
+}
+
+void FileCache::Erase_(Shard& shard, unordered_map<string, Entry>::iterator it) {
+    if(it->second.loading) {
+        it->second.stale = true; // 由加载线程负责移除
+        return;
+    }
+    shard.lru.erase(it->second.lru);
+    shard.bytes -= it->second.bytes;
+    shard.entries.erase(it);
+}
+
+void FileCache::Evict_(Shard& shard) {
+    while(shard.bytes > shardBytes_ && !shard.lru.empty()) {
+        Erase_(shard, shard.entries.find(shard.lru.back()));
+    }
+}
+
+void FileCache::Invalidate(const string& relPath) {
+    InvalidatePath_(root_ + relPath);
+}
+
+void FileCache::InvalidatePath_(const string& path) {
+    Shard& shard = Shard_(path);
+    lock_guard<mutex> locker(shard.mtx);
+    auto it = shard.entries.find(path);
+    if(it != shard.entries.end()) {
+        Erase_(shard, it);
+    }
+}
+
+void FileCache::InvalidatePrefix_(const string& prefix) {
+    for(Shard& shard: shards_) {
+        lock_guard<mutex> locker(shard.mtx);
+        for(auto it = shard.entries.begin(); it != shard.entries.end(); ) {
+            auto cur = it++;
+            if(cur->first.compare(0, prefix.size(), prefix) == 0) {
+                Erase_(shard, cur);
+            }
+        }
+    }
+}
+
+/* 递归监听目录及其子目录 */
+void FileCache::AddWatch_(const string& dir) {
+    int wd = inotify_add_watch(inotifyFd_, dir.c_str(), WATCH_MASK | IN_ONLYDIR);
+    if(wd < 0) {
+        LOG_WARN("FileCache: watch %s error: %d", dir.c_str(), errno);
+        return;
+    }
+    watchDirs_[wd] = dir;
+    DIR* pDir = opendir(dir.c_str());
+    if(!pDir) { return; }
+    while(struct dirent* pEnt = readdir(pDir)) {
+        if(pEnt->d_type == DT_DIR && strcmp(".", pEnt->d_name) != 0 && strcmp("..", pEnt->d_name) != 0) {
+            AddWatch_(dir + pEnt->d_name + "/");
+        }
+    }
+    closedir(pDir);
+}
+
+void FileCache::Watch_() {
+    alignas(struct inotify_event) char buf[4096];
+    struct pollfd fds[2] = { { inotifyFd_, POLLIN, 0 }, { stopFd_, POLLIN, 0 } };
+    while(true) {
+        if(poll(fds, 2, -1) < 0) {
+            if(errno == EINTR) { continue; }
+            LOG_ERROR("FileCache: poll error: %d", errno);
+            break;
+        }
+        if(fds[1].revents) { break; }
+        ssize_t len;
+        while((len = read(inotifyFd_, buf, sizeof(buf))) > 0) {
+            for(char* p = buf; p < buf + len; ) {
+                const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(p);
+                HandleEvent_(event);
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+    }
+}
+
+void FileCache::HandleEvent_(const struct inotify_event* event) {
+    if(event->mask & IN_Q_OVERFLOW) {
+        LOG_WARN("FileCache: inotify queue overflow, drop all");
+        InvalidatePrefix_(root_);
+        return;
+    }
+    auto it = watchDirs_.find(event->wd);
+    if(it == watchDirs_.end()) { return; }
+    if(event->mask & IN_IGNORED) { // 目录已删除或移走，内核自动撤销了监听
+        watchDirs_.erase(it);
+        return;
+    }
+    if(event->len == 0) { // 被监听目录自身的事件
+        InvalidatePrefix_(it->second);
+        return;
+    }
+    string path = it->second + event->name;
+    if(event->mask & IN_ISDIR) {
+        if(event->mask & (IN_CREATE | IN_MOVED_TO)) {
+            AddWatch_(path + "/");
+        }
+        InvalidatePrefix_(path + "/");
+    }
+    InvalidatePath_(path);
+}
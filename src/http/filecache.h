@@ -0,0 +1,134 @@
+#ifndef FILE_CACHE_H
+#define FILE_CACHE_H
+
+#include <unordered_map>
+#include <list>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <condition_variable>
+#include <thread>
+#include <fcntl.h>       // open
+#include <unistd.h>      // close
+#include <poll.h>
+#include <dirent.h>
+#include <sys/stat.h>    // stat
+#include <sys/mman.h>    // mmap, munmap
+#include <sys/inotify.h>
+#include <sys/eventfd.h>
+#include <string.h>      // strcmp
+#include <strings.h>     // strcasecmp
+#include <stdio.h>       // snprintf
+#include <assert.h>
+#include <stdint.h>      // SIZE_MAX
+#include <zlib.h>        // deflate
+#include <time.h>        // gmtime_r, strftime
+
+#include "../log/log.h"
+#include "mimetype.h"
+
+/* 缓存的文件：stat 结果与只读映射，加载后不再修改，多个响应可同时引用 */
+struct CachedFile {
+    CachedFile(): err(0), st(), data(nullptr) {}
+    ~CachedFile() {
+        if(data && data != owned.data()) { munmap(data, st.st_size); }
+    }
+    size_t Size() const { return S_ISREG(st.st_mode) ? st.st_size : 0; }
+
+    int err;         // stat/open/mmap 失败时的 errno，0 表示成功
+    struct stat st;
+    char* data;      // 普通且其他用户可读的非空文件、且小于映射阈值才映射，否则为 nullptr（大文件由 sendfile 发送）
+    std::string owned; // 内存中生成的内容（FromMemory），data 指向这里而不是映射
+    std::string gzip; // 可压缩的文本类文件在加载时生成的 gzip 版本，压缩后不够小则为空
+    std::string etag; // 强校验值（不含引号）：inode-大小-修改时间(ns)，文件任何变化都会改变
+    std::string lastModified; // HTTP-date 格式的修改时间
+
+    /* 预先生成的响应头常量部分，[0] 原文件、[1] gzip 版本；每个文件版本生成一次，响应时整块拷贝
+       text 的 [0, entity) 为 Vary/ETag/Last-Modified/Cache-Control（304 只发这部分），其后为 Accept-Ranges/Content-type/Content-Encoding */
+    struct HeaderBlock {
+        std::string text;
+        size_t entity = 0;
+    };
+    HeaderBlock header[2];
+};
+
+typedef std::shared_ptr<const CachedFile> FileRef;
+
+/* 静态文件缓存（单例）
+   以完整路径为键缓存 stat 结果与文件映射，命中时不产生任何文件系统调用；引用计数归零才 munmap，淘汰不影响正在发送的响应。
+   按路径哈希分成 SHARDS 个分片，各自一把锁、一条 LRU，按映射字节数各限容 1/SHARDS；不存在的路径不缓存，扫描不存在的 URL 不会挤掉热点文件。
+   同一文件的并发未命中只加载一次；后台线程用 inotify 监听资源目录，文件变化时使对应缓存失效。
+   html/css/js 等文本文件加载时一并压缩出 gzip 版本，与原文件一同缓存，每个文件版本只压缩一次 */
+class FileCache {
+public:
+    static FileCache* Instance();
+
+    void Init(const std::string& root, size_t maxBytes, size_t mapLimit); // root 以 '/' 结尾；不小于 mapLimit 的文件只缓存 stat 结果
+                                                                          // inotify 不可用时退化为每次直接加载
+
+    FileRef Get(const std::string& path);
+
+    /* 把内存中生成的内容包装成文件（同样带校验值、gzip 版本与预生成的响应头），不进入缓存；version 参与 ETag，每次内容变化应递增 */
+    FileRef FromMemory(const std::string& path, std::string content, uint64_t version) const;
+
+    void Invalidate(const std::string& relPath); // 相对资源根目录的路径；服务器自己写入资源目录后立即调用，不必等 inotify 通知
+
+    void Close();
+
+private:
+    FileCache();
+    ~FileCache();
+
+    struct Entry {
+        Entry(): bytes(0), loading(true), stale(false) {}
+        FileRef file;
+        size_t bytes;
+        bool loading;   // 正在加载，其他线程等待而不是重复加载
+        bool stale;     // 加载期间收到失效通知，加载完不入缓存
+        std::list<std::string>::iterator lru;
+    };
+
+    struct Shard {
+        Shard(): bytes(0) {}
+        std::mutex mtx;
+        std::condition_variable cond;
+        std::unordered_map<std::string, Entry> entries;
+        std::list<std::string> lru; // 表头为最近使用
+        size_t bytes;
+    };
+
+    FileRef Load_(const std::string& path, bool compress) const;
+    static void Gzip_(CachedFile& file);
+    static void Validators_(CachedFile& file);
+    static void Headers_(const std::string& path, CachedFile& file);
+    bool Cacheable_(const std::string& path) const;
+    Shard& Shard_(const std::string& path) { return shards_[std::hash<std::string>()(path) % SHARDS]; }
+    static void Erase_(Shard& shard, std::unordered_map<std::string, Entry>::iterator it);
+    void Evict_(Shard& shard);
+    void InvalidatePath_(const std::string& path);
+    void InvalidatePrefix_(const std::string& prefix);
+
+    void AddWatch_(const std::string& dir);
+    void Watch_();
+    void HandleEvent_(const struct inotify_event* event);
+
+    static const size_t SHARDS = 16;
+    static const uint32_t WATCH_MASK = IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE |
+                                       IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+
+    std::string root_;
+    size_t maxBytes_;
+    size_t shardBytes_; // 每个分片的容量；单个文件超过其 1/4 不缓存
+    size_t mapLimit_;
+    std::atomic<bool> enabled_;
+
+    Shard shards_[SHARDS];
+
+    int inotifyFd_;
+    int stopFd_;   // eventfd：通知监听线程退出
+    std::unordered_map<int, std::string> watchDirs_; // wd -> 目录路径（以 '/' 结尾），只由监听线程访问
+    std::thread watcher_;
+};
+
+#endif //FILE_CACHE_H
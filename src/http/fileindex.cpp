@@ -0,0 +1,135 @@
+#include "fileindex.h"
+
+using namespace std;
+
+FileIndex::FileIndex(): version_(0), inotifyFd_(-1), wd_(-1), dirMtime_{0, 0} {}
+
+FileIndex::~FileIndex() {
+    Close();
+}
+
+FileIndex* FileIndex::Instance() {
+    static FileIndex index;
+    return &index;
+}
+
+void FileIndex::Init(const string& dir) {
+    assert(!dir.empty() && dir.back() == '/');
+    Close();
+    lock_guard<mutex> locker(mtx_);
+    dir_ = dir;
+    /* 只监听上传目录本身；事件不由后台线程处理，而是在请求列表时非阻塞地读出 */
+    inotifyFd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(inotifyFd_ >= 0) {
+        wd_ = inotify_add_watch(inotifyFd_, dir_.c_str(), IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO |
+                                IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR);
+    }
+    if(wd_ < 0) {
+        LOG_WARN("FileIndex: watch %s error: %d, rescan when the directory changes", dir_.c_str(), errno);
+    }
+    Scan_();
+}
+
+void FileIndex::Close() {
+    lock_guard<mutex> locker(mtx_);
+    if(inotifyFd_ >= 0) { close(inotifyFd_); }
+    inotifyFd_ = wd_ = -1;
+    names_.clear();
+    listing_.reset();
+}
+
+/* 以 '.' 开头的隐藏文件不列出：上传中的临时文件、分块上传的内容存储目录 */
+bool FileIndex::Visible_(const string& name) {
+    return !name.empty() && name[0] != '.';
+}
+
+/* 集合内容不变时保留已生成的响应体，定期重新扫描不会重新序列化、压缩 */
+void FileIndex::Scan_() {
+    struct stat st;
+    dirMtime_ = stat(dir_.c_str(), &st) == 0 ? st.st_mtim : timespec{0, 0}; // 先取修改时间：扫描期间的变化留给下一次
+    scanned_ = Clock::now();
+    set<string> names;
+    DIR* pDir = opendir(dir_.c_str());
+    if(pDir) {
+        while(struct dirent* pEnt = readdir(pDir)) {
+            if(Visible_(pEnt->d_name)) {
+                names.insert(pEnt->d_name);
+            }
+        }
+        closedir(pDir);
+    } else {
+        LOG_ERROR("FileIndex: opendir %s error: %d", dir_.c_str(), errno);
+    }
+    if(names != names_) {
+        names_.swap(names);
+        listing_.reset();
+    }
+}
+
+/* 没有 inotify：目录修改时间变化（增删、改名）或距上次扫描超过 RESCAN_S 秒时才重新扫描 */
+void FileIndex::Poll_() {
+    struct stat st;
+    timespec mtime = stat(dir_.c_str(), &st) == 0 ? st.st_mtim : timespec{0, 0};
+    if(mtime.tv_sec != dirMtime_.tv_sec || mtime.tv_nsec != dirMtime_.tv_nsec ||
+       Clock::now() - scanned_ >= chrono::seconds(RESCAN_S)) {
+        Scan_();
+    }
+}
+
+/* 读出积压的 inotify 事件并应用到集合；队列溢出或目录本身变化时重新扫描 */
+void FileIndex::Drain_() {
+    if(wd_ < 0) {
+        Poll_();
+        return;
+    }
+    alignas(struct inotify_event) char buf[4096];
+    ssize_t len;
+    bool rescan = false;
+    while((len = read(inotifyFd_, buf, sizeof(buf))) > 0) {
+        for(char* p = buf; p < buf + len; ) {
+            const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(p);
+            p += sizeof(struct inotify_event) + event->len;
+            if(event->mask & IN_IGNORED) {
+                wd_ = -1; // 目录已删除或移走，监听随之撤销，之后按修改时间重新扫描
+                rescan = true;
+            } else if(event->mask & (IN_Q_OVERFLOW | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                rescan = true;
+            } else if(event->len == 0 || !Visible_(event->name)) {
+                continue;
+            } else if(event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                if(names_.insert(event->name).second) { listing_.reset(); }
+            } else if(event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                if(names_.erase(event->name)) { listing_.reset(); }
+            }
+        }
+    }
+    if(rescan) {
+        Scan_();
+    }
+}
+
+FileRef FileIndex::Listing() {
+    lock_guard<mutex> locker(mtx_);
+    Drain_();
+    if(!listing_) {
+        Json::Value root(Json::arrayValue);
+        Json::Value file;
+        for(const string& name: names_) {
+            file["filename"] = name;
+            root.append(file);
+        }
+        Json::StreamWriterBuilder writerBuilder;
+        listing_ = FileCache::Instance()->FromMemory(PATH, Json::writeString(writerBuilder, root), ++version_);
+    }
+    return listing_;
+}
+
+void FileIndex::Add(const string& name) {
+    lock_guard<mutex> locker(mtx_);
+    if(names_.insert(name).second) { listing_.reset(); }
+}
+
+void FileIndex::Remove(const string& name) {
+    lock_guard<mutex> locker(mtx_);
+    if(names_.erase(name)) { listing_.reset(); }
+}
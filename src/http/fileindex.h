@@ -0,0 +1,61 @@
+#ifndef FILE_INDEX_H
+#define FILE_INDEX_H
+
+#include <set>
+#include <string>
+#include <mutex>
+#include <chrono>
+#include <unistd.h>      // read, close
+#include <dirent.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <string.h>      // strcmp
+#include <assert.h>
+#include <json/json.h>
+
+#include "../log/log.h"
+#include "filecache.h"
+
+/* 上传目录的文件索引（单例），供 /list.json 使用
+   文件名集合常驻内存，由上传处理与 inotify 增量更新；集合变化后第一次请求时才序列化成 json，
+   生成的响应体（含 ETag、gzip 版本）在下次变化前一直复用，读请求不再 readdir，也不再写磁盘 */
+class FileIndex {
+public:
+    static FileIndex* Instance();
+
+    void Init(const std::string& dir); // dir 以 '/' 结尾；inotify 不可用时退化为按目录修改时间（至多 RESCAN_S 秒）重新扫描
+
+    FileRef Listing(); // 当前文件列表，json 格式
+
+    void Add(const std::string& name);
+    void Remove(const std::string& name);
+
+    void Close();
+
+    static constexpr const char* PATH = "/list.json";
+
+private:
+    FileIndex();
+    ~FileIndex();
+
+    static bool Visible_(const std::string& name);
+    void Scan_();
+    void Drain_();
+    void Poll_();
+
+    typedef std::chrono::steady_clock Clock;
+    static const int RESCAN_S = 1; // 没有 inotify 时，目录修改时间未变也至多隔这么久重新扫描（修改时间精度有限）
+
+    std::string dir_;
+    std::set<std::string> names_;
+    FileRef listing_;   // names_ 变化时置空，下次请求时重新生成
+    uint64_t version_;
+
+    int inotifyFd_;
+    int wd_;
+    struct timespec dirMtime_; // 上次扫描前目录的修改时间
+    Clock::time_point scanned_;
+    std::mutex mtx_;
+};
+
+#endif //FILE_INDEX_H
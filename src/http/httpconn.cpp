@@ -9,6 +9,10 @@ HttpConn::HttpConn() {
     fd_ = -1;
     addr_ = { 0 };
     isClose_ = true;
+    toWrite_ = 0;
+    keepAlive_ = readMore_ = paused_ = false;
+    drainOnClose_ = draining_ = false;
+    drained_ = 0;
 };
 
 HttpConn::~HttpConn() { 
@@ -20,15 +24,21 @@ void HttpConn::init(int fd, const sockaddr_in& addr) {
     userCount++;
     addr_ = addr;
     fd_ = fd;
+    ClearPending_();
     writeBuff_.RetrieveAll();
     readBuff_.RetrieveAll();
     isClose_ = false;
+    keepAlive_ = readMore_ = paused_ = false;
+    drainOnClose_ = draining_ = false;
+    drained_ = 0;
     request_.Init(); // 在连接时初始化，而不是请求到来时，避免一次请求分多次发送，状态机状态重置
     LOG_INFO("Client[%d](%s:%d) in, userCount:%d", fd_, GetIP(), GetPort(), (int)userCount);
 }
 
 void HttpConn::Close() {
     response_.UnmapFile();
+    request_.Init(); // 丢弃未完成的上传（删除临时文件）
+    ClearPending_();
     if(isClose_ == false){
         isClose_ = true; 
         userCount--;
@@ -55,82 +65,275 @@ int HttpConn::GetPort() const {
 }
 
 ssize_t HttpConn::read(int* saveErrno) {
+    if(draining_) {
+        return Drain_(saveErrno);
+    }
     // fd_ 分散读入 readBuff_
     ssize_t len = -1;
+    readMore_ = false;
     do {
         len = readBuff_.ReadFd(fd_, saveErrno);
         if (len <= 0) {
             break;
         }
+        if(isET && readBuff_.ReadableBytes() >= MAX_READ_BUFFER) {
+            readMore_ = true; // 未读到 EAGAIN，先交给 process() 消费，由它接着读
+            break;
+        }
     } while (isET);
     return len;
 }
 
+/* ET 模式下读取曾因缓冲区已满提前停止：缓冲区有空间时继续读入，返回是否读到新数据 */
+bool HttpConn::ReadMore_() {
+    if(!readMore_ || readBuff_.ReadableBytes() >= MAX_READ_BUFFER) {
+        return false;
+    }
+    /* ET 模式下 read() 返回的是最后一次读的结果（通常为 EAGAIN），以缓冲区是否增长为准 */
+    size_t before = readBuff_.ReadableBytes();
+    int readErrno = 0;
+    read(&readErrno);
+    return readBuff_.ReadableBytes() > before;
+}
+
+bool HttpConn::Linger() {
+    if(!drainOnClose_ || draining_) {
+        return false;
+    }
+    draining_ = true;
+    shutdown(fd_, SHUT_WR); // 响应之后紧跟 FIN，对端先读到完整的 413
+    readBuff_.RetrieveAll();
+    int readErrno = 0;
+    return Drain_(&readErrno) < 0 && readErrno == EAGAIN; // 对端已关闭则直接关闭
+}
+
+/* 半关闭后读入即丢弃：读到 EOF 返回 0，丢弃超过 MAX_DRAIN 返回 -1 */
+ssize_t HttpConn::Drain_(int* saveErrno) {
+    ssize_t len = -1;
+    do {
+        len = readBuff_.ReadFd(fd_, saveErrno);
+        readBuff_.RetrieveAll();
+        if(len > 0 && (drained_ += len) > MAX_DRAIN) {
+            *saveErrno = EMSGSIZE;
+            return -1;
+        }
+    } while(len > 0 && isET);
+    return len;
+}
+
 ssize_t HttpConn::write(int* saveErrno) {
-    // iov_ 集中写入 fd_
+    // 发送队列中的多个响应（响应头 + 文件片段）集中写入 fd_；大文件片段走 sendfile
     ssize_t len = -1;
     do {
-        len = writev(fd_, iov_, iovCnt_);
-        if(len <= 0) {
-            *saveErrno = errno;
+        if(segments_.empty()) { /* 传输结束 */
+            len = 0;
             break;
         }
-        if(iov_[0].iov_len + iov_[1].iov_len  == 0) { break; } /* 传输结束 */
-        else if(static_cast<size_t>(len) > iov_[0].iov_len) {
-            /* iov_[0] 写完了，iov_[1] 写了一部分 */
-            iov_[1].iov_base = (uint8_t*) iov_[1].iov_base + (len - iov_[0].iov_len);
-            iov_[1].iov_len -= (len - iov_[0].iov_len);
-            if(iov_[0].iov_len) {
-                writeBuff_.RetrieveAll();
-                iov_[0].iov_len = 0;
-            }
+        Segment& front = segments_.front();
+        if(front.offset >= 0 && pending_.front().fd >= 0) {
+            len = SendFile_(front);
+        } else {
+            len = SendBuffered_();
         }
-        else {
-            /* iov_[0] 未写完 */
-            iov_[0].iov_base = (uint8_t*)iov_[0].iov_base + len; 
-            iov_[0].iov_len -= len; 
-            writeBuff_.Retrieve(len);
+        if(len <= 0) {
+            *saveErrno = len == 0 ? EIO : errno; // sendfile 返回 0：文件在发送期间被截短
+            len = -1;
+            break;
         }
-    } while(isET || ToWriteBytes() > 10240);
+        Consume_(len);
+    } while(toWrite_ > 0 && (isET || toWrite_ > 10240));
     return len;
 }
 
-bool HttpConn::process() {
+/* 一次 sendmsg 写出队列前部 writeBuff_ 中的字节与内存中的文件片段，遇到走 sendfile 的片段即止；
+   此时带 MSG_MORE，响应头留在内核中与随后 sendfile 的文件数据合并成满载的报文段 */
+ssize_t HttpConn::SendBuffered_() {
+    struct iovec iov[MAX_IOV];
+    bool beforeFile = false;
+    struct msghdr msg = {};
+    msg.msg_iov = iov;
+    msg.msg_iovlen = Gather(iov, MAX_IOV, &beforeFile);
+    return sendmsg(fd_, &msg, beforeFile ? MSG_MORE : 0);
+}
 
-    if(readBuff_.ReadableBytes() <= 0) {
-        return false;
+/* 从队首起把 writeBuff_ 中的字节与内存中的文件片段依次填入 iov，遇到走 sendfile 的片段即止（beforeFile 置为 true） */
+int HttpConn::Gather(struct iovec* iov, int maxIov, bool* beforeFile) const {
+    int iovCnt = 0;
+    const char* head = writeBuff_.Peek();
+    auto out = pending_.begin();
+    for(auto it = segments_.begin(); it != segments_.end() && iovCnt < maxIov; ++it) {
+        if(it->offset < 0) {
+            iov[iovCnt].iov_base = const_cast<char*>(head);
+            iov[iovCnt++].iov_len = it->len;
+            head += it->len;
+        } else if(out->fd >= 0) {
+            if(beforeFile) { *beforeFile = true; }
+            break;
+        } else {
+            iov[iovCnt].iov_base = const_cast<char*>(out->data) + it->offset;
+            iov[iovCnt++].iov_len = it->len;
+        }
+        if(it->last) { ++out; }
+    }
+    return iovCnt;
+}
+
+ssize_t HttpConn::SendFile(int* saveErrno) {
+    ssize_t len = 0;
+    while(!segments_.empty() && segments_.front().offset >= 0 && pending_.front().fd >= 0) {
+        len = SendFile_(segments_.front());
+        if(len <= 0) {
+            *saveErrno = len == 0 ? EIO : errno; // 返回 0：文件在发送期间被截短
+            return -1;
+        }
+        Consume_(len);
+    }
+    return len;
+}
+
+bool HttpConn::Feed(const char* data, size_t len) {
+    if(draining_) {
+        return (drained_ += len) <= MAX_DRAIN;
     }
-    HTTP_CODE ret = request_.parse(readBuff_); 
-    // 请求不完整，继续读取
-    if (ret == HTTP_CODE::NO_REQUEST) {
-        return false; // 返回false后，会继续监听读(处理逻辑在 webserver.cpp OnProcess_() 中)
+    readBuff_.Append(data, len);
+    return true;
+}
+
+ssize_t HttpConn::SendFile_(Segment& seg) {
+    off_t offset = seg.offset;
+    return sendfile(fd_, pending_.front().fd, &offset, seg.len);
+}
+
+/* 从队首起扣除已写出的字节，响应的最后一个片段发完后释放其文件 */
+void HttpConn::Consume_(size_t len) {
+    assert(len <= toWrite_);
+    toWrite_ -= len;
+    while(len > 0) {
+        assert(!segments_.empty());
+        Segment& seg = segments_.front();
+        size_t n = std::min(len, seg.len);
+        if(seg.offset < 0) {
+            writeBuff_.Retrieve(n);
+        } else {
+            seg.offset += n;
+        }
+        seg.len -= n;
+        len -= n;
+        if(seg.len > 0) {
+            break;
+        }
+        if(seg.last) {
+            if(pending_.front().fd >= 0) { close(pending_.front().fd); }
+            pending_.pop_front(); // 释放文件引用
+        }
+        segments_.pop_front();
     }
-    // 请求完整，开始写
-    else if (ret == HTTP_CODE::GET_REQUEST) {
-        LOG_DEBUG("%s", request_.path().c_str());
-        response_.Init(srcDir, request_.path(), request_.IsKeepAlive(), 200);
+}
 
-        request_.Init(); // 等待下一次请求，需要初始化
-        readBuff_.RetrieveAll(); // 读缓冲区清空
+void HttpConn::ClearPending_() {
+    for(auto& out: pending_) {
+        if(out.fd >= 0) { close(out.fd); }
     }
-    //请求行错误, bad request
-    else if (ret == HTTP_CODE::BAD_REQUEST)
-    {
-        response_.Init(srcDir, request_.path(), false, 400);
+    pending_.clear();
+    segments_.clear();
+    toWrite_ = 0;
+}
+
+/* 生成当前响应，按 response_.Parts() 的顺序把片段追加到发送队列末尾 */
+void HttpConn::QueueResponse_() {
+    response_.MakeResponse(writeBuff_); // 生成响应头（及 multipart 分段头）写入 writeBuff_
+    Pending out = { nullptr, response_.File(), response_.ReleaseBodyFd() };
+    out.file = response_.ReleaseFile();
+    for(const HttpResponse::BodyPart& part: response_.Parts()) {
+        if(part.head) {
+            segments_.push_back({ part.head, -1, false });
+        }
+        if(part.len) {
+            assert(out.file && (out.data || out.fd >= 0));
+            segments_.push_back({ part.len, static_cast<int64_t>(part.offset), false });
+        }
+        toWrite_ += part.head + part.len;
     }
+    assert(!segments_.empty());
+    segments_.back().last = true;
+    pending_.push_back(std::move(out));
+    LOG_DEBUG("response parts:%d, queued:%d to %d", (int)response_.Parts().size(), (int)pending_.size(), toWrite_);
+}
+
+/* Expect: 100-continue：中间响应与普通响应一样按顺序进入发送队列 */
+void HttpConn::QueueContinue_() {
+    static const char CONTINUE[] = "HTTP/1.1 100 Continue\r\n\r\n";
+    writeBuff_.Append(CONTINUE, sizeof(CONTINUE) - 1);
+    segments_.push_back({ sizeof(CONTINUE) - 1, -1, true });
+    pending_.push_back({ nullptr, nullptr, -1 });
+    toWrite_ += sizeof(CONTINUE) - 1;
+    keepAlive_ = true; // 还要继续接收消息体
+}
 
-    response_.MakeResponse(writeBuff_); // 生成响应写入 writeBuff_
-    /* 响应头 */
-    iov_[0].iov_base = const_cast<char*>(writeBuff_.Peek());
-    iov_[0].iov_len = writeBuff_.ReadableBytes();
-    iovCnt_ = 1;
-
-    /* 响应体：文件 */
-    if(response_.File() && response_.FileLen() > 0) {
-        iov_[1].iov_base = response_.File();
-        iov_[1].iov_len = response_.FileLen();
-        iovCnt_ = 2;
+/* 流水线：读缓冲区中已完整到达的请求依次解析，响应按顺序进入发送队列，由 write() 一次 writev 批量发出 */
+bool HttpConn::process() {
+    int queued = 0;
+    paused_ = false;
+    if(draining_) {
+        return false;
     }
-    LOG_DEBUG("response_ filesize:%d, %d  to %d", response_.FileLen() , iovCnt_, ToWriteBytes());
-    return true;
+    while(queued < MAX_PIPELINE) {
+        if(request_.DiskBusy()) {
+            if(request_.WaitDisk()) {
+                paused_ = true; // 等待磁盘任务，完成后由回调恢复
+                break;
+            }
+        }
+        else if(readBuff_.ReadableBytes() == 0 && !ReadMore_()) {
+            break;
+        }
+        HTTP_CODE ret = request_.parse(readBuff_);
+        if(request_.TakeContinue()) {
+            QueueContinue_();
+            queued++;
+        }
+        // 请求不完整：等待磁盘任务的回到循环开头登记等待；上次读取因缓冲区满而中断的（流式上传）接着读，否则等待下一次可读事件
+        if (ret == HTTP_CODE::NO_REQUEST) {
+            if(request_.DiskBusy() || ReadMore_()) {
+                continue;
+            }
+            break;
+        }
+        // 请求完整，生成响应
+        else if (ret == HTTP_CODE::GET_REQUEST) {
+            LOG_DEBUG("%s", request_.path().c_str());
+            response_.Init(srcDir, request_.path(), request_.IsKeepAlive(), 200);
+            response_.SetContent(request_.TakeReply());
+            response_.SetCookie(request_.TakeCookie());
+            if(request_.method() == "GET") {
+                response_.SetRange(request_.GetHeader("Range"), request_.GetHeader("If-Range"));
+                response_.SetAcceptGzip(request_.AcceptsEncoding("gzip"));
+                response_.SetConditional(request_.GetHeader("If-None-Match"), request_.GetHeader("If-Modified-Since"));
+            }
+            request_.Init(); // 等待下一次请求，需要初始化
+        }
+        //请求行错误, bad request
+        else if (ret == HTTP_CODE::BAD_REQUEST)
+        {
+            response_.Init(srcDir, request_.path(), false, 400);
+        }
+        // 请求完整但无法完成（分块上传的会话不存在、未收全、写入出错）
+        else if (ret == HTTP_CODE::NO_RESOURSE || ret == HTTP_CODE::CONFLICT || ret == HTTP_CODE::INTERNAL_ERROR) {
+            int code = ret == HTTP_CODE::NO_RESOURSE ? 404 : (ret == HTTP_CODE::CONFLICT ? 409 : 500);
+            response_.Init(srcDir, request_.path(), request_.IsKeepAlive(), code);
+            request_.Init();
+        }
+        // 消息体超出上限：不再接收，回应后关闭连接
+        else if (ret == HTTP_CODE::PAYLOAD_TOO_LARGE) {
+            response_.Init(srcDir, request_.path(), false, 413);
+            drainOnClose_ = true;
+        }
+        QueueResponse_();
+        queued++;
+        keepAlive_ = response_.IsKeepAlive();
+        if(!keepAlive_) {
+            break; // 响应后关闭连接，之后的请求不再处理
+        }
+    }
+    return queued > 0; // 返回false后，会继续监听读(处理逻辑在 webserver.cpp onProcess_() 中)
 }
@@ -3,9 +3,13 @@
 
 #include <sys/types.h>
 #include <sys/uio.h>     // readv/writev
+#include <sys/socket.h>  // sendmsg
+#include <sys/sendfile.h>
 #include <arpa/inet.h>   // sockaddr_in
 #include <stdlib.h>      // atoi()
 #include <errno.h>      
+#include <deque>
+#include <algorithm>
 
 #include "../log/log.h"
 #include "../pool/sqlconnRAII.h"
@@ -19,6 +23,7 @@ public:
     ~HttpConn();
 
     void init(int sockFd, const sockaddr_in& addr);
+    void SetResume(std::function<void()> resume) { request_.SetResume(std::move(resume)); } // init 后设置，见 IsPaused()
 
     ssize_t read(int* saveErrno);
     ssize_t write(int* saveErrno);
@@ -32,14 +37,29 @@ public:
     
     bool process();
 
-    int ToWriteBytes() { 
-        return iov_[0].iov_len + iov_[1].iov_len; 
+    size_t ToWriteBytes() const { 
+        return toWrite_; 
     }
 
     bool IsKeepAlive() const {
-        return request_.IsKeepAlive();
+        return keepAlive_; // 以发送队列中最后一个响应为准，process() 遇到不保持连接的响应即停止解析
     }
 
+    /* process() 因等待磁盘任务而停止：此时不应监听读，任务完成后 SetResume 设置的回调被调用一次，应在连接所属线程再次 process() */
+    bool IsPaused() const {
+        return paused_;
+    }
+
+    /* 不保持连接的响应发完后调用：413 时半关闭写端，继续读入并丢弃对端仍在发送的消息体，
+       避免带着未读数据 close() 发出 RST 冲掉响应；返回 true 时应继续监听读，read() 读到对端关闭或丢弃过多时返回失败 */
+    bool Linger();
+
+    /* io_uring 完成模式：读写由事件循环提交给内核，HttpConn 只提供要发送的数据并记账 */
+    bool Feed(const char* data, size_t len); // 内核读入的数据追加到读缓冲区（半关闭后丢弃），丢弃过多时返回 false
+    int Gather(struct iovec* iov, int maxIov, bool* beforeFile = nullptr) const; // 队列前部可由 sendmsg 发送的片段，队首走 sendfile 时返回 0
+    void Sent(size_t len) { Consume_(len); }
+    ssize_t SendFile(int* saveErrno); // 发送队首走 sendfile 的片段（io_uring 没有对应的操作），内核缓冲区满时返回 -1、EAGAIN
+
     static bool isET;
     static const char* srcDir;
     static std::atomic<int> userCount;
@@ -49,13 +69,49 @@ private:
     int fd_;
     struct  sockaddr_in addr_;
 
+    /* 发送队列中的一个响应持有的文件：小文件为 FileCache 中映射的引用（writev），大文件为打开的描述符（sendfile），发送完毕后释放 */
+    struct Pending {
+        FileRef file;
+        const char* data; // 内存中的消息体（映射的原文件或其 gzip 版本）
+        int fd;          // >= 0 时文件片段由 sendfile 从该描述符发送
+    };
+
+    /* 发送片段：writeBuff_ 中依次排列的字节（响应头、multipart 分段头），或所属响应文件中的一段 */
+    struct Segment {
+        size_t len;      // 尚未发送的字节数
+        int64_t offset;  // 文件偏移，-1 表示数据在 writeBuff_ 中
+        bool last;       // 所属响应的最后一个片段，发完后释放该响应的文件
+    };
+
+    void QueueResponse_();
+    void QueueContinue_();
+    bool ReadMore_();
+    ssize_t Drain_(int* saveErrno);
+    ssize_t SendBuffered_();
+    ssize_t SendFile_(Segment& seg);
+    void Consume_(size_t len);
+    void ClearPending_();
+
+    static const int MAX_PIPELINE = 16; // 一次 process() 最多排队的响应数，其余请求留在读缓冲区等本批发完
+    static const int MAX_IOV = 64;
+    static const size_t MAX_READ_BUFFER = 256 * 1024; // ET 模式下一次最多读入的量，流式上传时读缓冲区不会随消息体增长
+    static const size_t MAX_DRAIN = 4 * 1024 * 1024; // 回 413 后最多丢弃的字节数，超过即关闭
+
+    bool keepAlive_;
+    bool readMore_;  // 读取因缓冲区已满而提前停止，内核中可能还有数据
+    bool paused_;
+    bool drainOnClose_; // 发送队列中的最后一个响应是 413
+    bool draining_;     // 已半关闭，只读入并丢弃
+    size_t drained_;
+
     bool isClose_;
     
-    int iovCnt_;
-    struct iovec iov_[2]; // iov_[0] = writeBuff_; iov[1] = response_.File();
+    std::deque<Pending> pending_;
+    std::deque<Segment> segments_;
+    size_t toWrite_;
     
     Buffer readBuff_; // 读缓冲区
-    Buffer writeBuff_; // 写缓冲区
+    Buffer writeBuff_; // 写缓冲区：发送队列中所有响应的响应头
 
     HttpRequest request_;
     HttpResponse response_;
@@ -10,125 +10,223 @@ const unordered_set<string> HttpRequest::DEFAULT_HTML{
 const unordered_map<string, int> HttpRequest::DEFAULT_HTML_TAG {
             {"/register.html", 0}, {"/login.html", 1},  };
 
+size_t HttpRequest::maxBodySize = SIZE_MAX;
+string HttpRequest::uploadDir = "./resources/files/";
+
 void HttpRequest::Init() {
-    method_ = path_ = version_ = body_ = "";
+    method_ = version_ = std::string_view();
+    path_ = body_ = "";
+    head_.clear();
     state_ = REQUEST_LINE;
     contentLen = 0;
+    bodyRead_ = 0;
+    isForm_ = expectContinue_ = false;
+    multipart_.Abort(); // 未完成的上传删除临时文件
+    upload_.reset();
+    uploadOffset_ = 0;
+    reply_.reset();
+    complete_ = nullptr;
+    user_.clear();
+    sid_.clear();
+    cookie_.clear();
+    parsed_ = 0;
+    base_ = nullptr;
     header_.clear();
     post_.clear();
 }
 
-bool HttpRequest::IsKeepAlive() const {
-    if(header_.count("Connection") == 1) {
-        return header_.find("Connection")->second == "keep-alive" && version_ == "1.1";
+void HttpRequest::SetResume(function<void()> resume) {
+    resume_ = std::move(resume);
+    disk_.reset(); // 上一个连接遗留的任务继续执行，完成后回调的是旧连接的句柄，已作废
+}
+
+shared_ptr<DiskChannel>& HttpRequest::Disk_() {
+    if(!disk_) {
+        disk_ = make_shared<DiskChannel>(resume_);
     }
-    return false;
+    return disk_;
+}
+
+bool HttpRequest::DiskBusy() const {
+    return state_ == WAIT_DISK || (state_ == BODY && disk_ && disk_->Busy());
+}
+
+bool HttpRequest::WaitDisk() {
+    return disk_ && disk_->Wait(state_ == WAIT_DISK);
+}
+
+// 字段名比较不区分大小写
+static bool EqualsIgnoreCase(string_view a, string_view b) {
+    return a.size() == b.size() && strncasecmp(a.data(), b.data(), a.size()) == 0;
+}
+
+bool HttpRequest::IsKeepAlive() const {
+    // 未读完的消息体还留在连接中，不能再解析后续请求
+    return GetHeader("Connection") == "keep-alive" && version_ == "1.1" && bodyRead_ == contentLen;
+}
+
+bool HttpRequest::TakeContinue() {
+    bool ret = expectContinue_;
+    expectContinue_ = false;
+    return ret;
 }
 
 HTTP_CODE HttpRequest::parse(Buffer& buff) {
-    
     // 外部 process() 函数调用时，确保 buff.ReadableBytes() > 0
-    while(buff.ReadableBytes()) {
+    if(state_ == REQUEST_LINE || state_ == HEADERS) {
+        HTTP_CODE ret = ParseHead_(buff);
+        if(state_ != BODY) {
+            return ret;
+        }
+    }
+    if(state_ == BODY) {
+        if(disk_ && disk_->Busy()) {
+            return NO_REQUEST; // 交给磁盘的数据积压过多，暂停读取，降下来后由 resume_ 恢复
+        }
+        // 消息体只取 Content-Length 指定的长度，之后的数据属于流水线中的下一个请求
+        size_t len = std::min(contentLen - bodyRead_, buff.ReadableBytes());
+        bool last = bodyRead_ + len == contentLen;
+        size_t used = len;
+        if(multipart_.Active()) {
+            // 可能是分隔符前缀的尾部留在缓冲区，与下次读入的数据一起解析
+            used = multipart_.Feed(buff.Peek(), len, last);
+            if(multipart_.Failed()) {
+                state_ = FINISH;
+                return BAD_REQUEST;
+            }
+        } else if(upload_ && len > 0) {
+            Disk_()->Submit([session = upload_, offset = uploadOffset_ + bodyRead_, data = string(buff.Peek(), len)] {
+                UploadStore::Status status = UploadStore::Write(*session, offset, data.data(), data.size());
+                return status == UploadStore::OK ? 0 : (status == UploadStore::NOT_FOUND ? ENOENT : EIO);
+            }, len);
+        } else if(isForm_) {
+            body_.append(buff.Peek(), len);
+        } // 其他类型的消息体不处理，读出后丢弃
+        buff.Retrieve(used);
+        bodyRead_ += used;
+        LOG_DEBUG("body read: %d Byte, contentLen: %d Byte.", bodyRead_, contentLen);
+        if(bodyRead_ < contentLen) {
+            return NO_REQUEST;
+        }
+        state_ = WAIT_DISK;
+    }
+    if(state_ == WAIT_DISK) {
+        return Complete_();
+    }
+    return NO_REQUEST;
+}
+
+/* 消息体交给磁盘的任务全部完成后才处理请求：上传的文件此时已落盘改名，出错返回 500（分块上传的会话已结束返回 404）；
+   处理请求时又提交了任务的（分块上传的建立、完成、放弃），等这些任务完成后由 complete_ 给出结果 */
+HTTP_CODE HttpRequest::Complete_() {
+    if(disk_ && !disk_->Idle()) {
+        return NO_REQUEST;
+    }
+    int err = disk_ ? disk_->TakeError() : 0;
+    if(err) {
+        state_ = FINISH;
+        complete_ = nullptr;
+        return err == ENOENT && upload_ ? NO_RESOURSE : INTERNAL_ERROR;
+    }
+    if(complete_) {
+        state_ = FINISH;
+        function<HTTP_CODE()> complete = std::move(complete_);
+        complete_ = nullptr;
+        return complete();
+    }
+    HTTP_CODE ret = ParseBody_();
+    if(complete_) {
+        return NO_REQUEST;
+    }
+    state_ = FINISH;
+    return ret;
+}
+
+/* 在读缓冲区内原地解析请求行和请求头：逐行查找 CR/LF/冒号，字段只记录视图不拷贝
+   请求头不完整时已解析的行保留，下次从 parsed_ 处继续，不重复扫描；请求头完整后才从缓冲区取出 */
+HTTP_CODE HttpRequest::ParseHead_(Buffer& buff) {
+    const char* begin = buff.Peek();
+    const char* end = buff.BeginWriteConst();
+    Rebase_(begin);
+    const char* lineStart = begin + parsed_;
+    while(lineStart < end) {
+        const char* colon = nullptr;
         const char* lineEnd;
-        std::string line;
-
-        // 除了消息体外，逐行解析
-        if (state_ != BODY) {
-            // 从buffer中读指针开始到写指针结束（前闭后开），并去除"\r\n"，返回有效数据的行末指针，search 函数在没找到子序列的时候会直接返回末尾的地址
-            lineEnd = search(buff.Peek(), buff.BeginWriteConst(), CRLF, CRLF + 2); // 查找 [first1, last1) 范围内第一个 [first2, last2) 子序列
-            //如果没找到CRLF，也不是BODY，那么一定不完整
-            if (lineEnd == buff.BeginWrite() && state_ == HEADERS) return NO_REQUEST;
-            line = std::string(buff.Peek(), lineEnd); 
-            buff.RetrieveUntil(lineEnd + 2); // 除消息体外，都有回车换行符
+        if(state_ == HEADERS) {
+            lineEnd = CharScan::FindColonOrEol(lineStart, end);
+            if(lineEnd < end && *lineEnd == ':') {
+                colon = lineEnd;
+                lineEnd = CharScan::FindEol(colon + 1, end);
+            }
         } else {
-            // 消息体读取全部内容，同时清空缓存
-            body_ += buff.RetrieveAllToStr();
-            LOG_DEBUG("body_.size(): %d Byte, contentLen: %d Byte.", body_.size(), contentLen);
-            if (body_.size() < contentLen) {
-                return NO_REQUEST;
+            lineEnd = CharScan::FindEol(lineStart, end);
+        }
+        //没找到行尾，请求头一定不完整
+        if(lineEnd == end || (*lineEnd == '\r' && lineEnd + 1 == end)) {
+            return NO_REQUEST;
+        }
+        const char* next = lineEnd + 1;
+        if(*lineEnd == '\r') {
+            if(*next != '\n') {
+                LOG_ERROR("Header line Error");
+                return BAD_REQUEST;
             }
+            next++;
         }
+        parsed_ = next - begin;
 
-        switch(state_) {
-            case REQUEST_LINE: {
-                HTTP_CODE ret = ParseRequestLine_(line);
-                if (ret == BAD_REQUEST) {
-                    return BAD_REQUEST;
-                }
-                ParsePath_(); // 解析 path_ 变量，主要作用是将 path_ 转换为 xxx.html
-                break; // 跳出 switch
+        if(state_ == REQUEST_LINE) {
+            if(ParseRequestLine_(lineStart, lineEnd) == BAD_REQUEST) {
+                return BAD_REQUEST;
             }
-            case HEADERS: {
-                HTTP_CODE ret = ParseHeader_(line);
-                //内部根据content-length字段判断请求完整，提前结束
-                if (ret == GET_REQUEST) {
-                    return GET_REQUEST;
-                }
-                break;
-            }
-            case BODY: {
-                HTTP_CODE ret = ParseBody_();
-                if (ret == GET_REQUEST) {
-                    return GET_REQUEST;
+            ParsePath_(); // 解析 path_ 变量，主要作用是将 path_ 转换为 xxx.html
+        }
+        else if(lineEnd == lineStart) {
+            // 空行，请求头结束；读消息体时读缓冲区可能被挪动或覆盖，先把请求头拷贝一份
+            ParseSession_();
+            if(contentLen) {
+                HTTP_CODE ret = BeginBody_();
+                if(ret != NO_REQUEST) {
+                    buff.RetrieveUntil(next);
+                    state_ = FINISH;
+                    return ret;
                 }
-                break;
+                head_.assign(begin, next);
+                Rebase_(head_.data());
+                buff.RetrieveUntil(next);
+                state_ = BODY;
+                return NO_REQUEST;
             }
-            default:
-                break;
+            buff.RetrieveUntil(next);
+            state_ = IsChunked_() ? WAIT_DISK : FINISH;
+            return IsChunked_() ? Complete_() : GET_REQUEST;
+        }
+        else if(!colon || ParseHeader_(lineStart, colon, lineEnd) == BAD_REQUEST) {
+            LOG_ERROR("Header line Error");
+            return BAD_REQUEST;
         }
+        lineStart = next;
     }
-    //缓存读空了，但请求还不完整，继续读
     return NO_REQUEST;
 }
 
-// 解析路径
-const static std::regex regex_filesPath(".files.+");
-
-vector<string> HttpRequest::getDownloadFiles(string dir) {
-    vector<string> files;
-    DIR *pDir = NULL;
-	struct dirent * pEnt = NULL;
-
-	pDir = opendir(dir.c_str());
-	if (NULL == pDir)
-	{
-		perror("opendir");
-		return files;
-	}	
-    
-	while (1)
-	{
-		pEnt = readdir(pDir);
-		if(pEnt != NULL)
-		{
-            if(strcmp(".",pEnt->d_name)==0 || strcmp("..",pEnt->d_name)==0)
-            {
-                continue;
+/* 读缓冲区扩容或挪动后，数据相对 Peek() 的位置不变，把已有视图平移到新地址 */
+void HttpRequest::Rebase_(const char* base) {
+    if(base_ && base_ != base) {
+        auto shift = [this, base](string_view& view) {
+            if(!view.empty()) {
+                uintptr_t offset = reinterpret_cast<uintptr_t>(view.data()) - reinterpret_cast<uintptr_t>(base_);
+                view = string_view(base + offset, view.size());
             }
-			files.push_back(pEnt->d_name);
-		}
-		else
-		{
-			break;
-		}
-	};
-	return files;
-}
-
-void HttpRequest::writeJson(string file, Json::Value root) {
-    std::ostringstream os;
-    Json::StreamWriterBuilder writerBuilder;
-    std::unique_ptr<Json::StreamWriter> jsonWriter(writerBuilder.newStreamWriter());
-
-    jsonWriter->write(root, &os);
-
-    ofstream ofs;
-    ofs.open(file);
-    assert(ofs.is_open());
-    ofs << os.str();
-    ofs.close();
-
-    return;
+        };
+        shift(method_);
+        shift(version_);
+        for(auto& field: header_) {
+            shift(field.first);
+            shift(field.second);
+        }
+    }
+    base_ = base;
 }
 
 char FromHex(char x) {
@@ -163,17 +261,9 @@ void HttpRequest::ParsePath_() {
         path_ = "/index.html"; 
     } else if (DEFAULT_HTML.count(path_)) {
         path_ += ".html";
-    } else if (path_ == "/list.json") {
-        auto files = getDownloadFiles("./resources/files");
-        Json::Value root;
-        Json::Value file;
-        for (int i = 0; i < (int)files.size(); i ++)
-        {
-            file["filename"] = files[i];
-            root.append(file);
-        }
-        writeJson("./resources/list.json", root);
-    } else if (regex_match(path_, regex_filesPath)) {
+    } else if (path_ == FileIndex::PATH) {
+        // 文件列表由 FileIndex 在内存中维护，响应时直接取用，不再扫描目录、改写 list.json
+    } else if (path_.size() > 7 && path_.compare(1, 5, "files") == 0) { // /files/xxx
         string newpath = "/files/";
         string tobedecode = path_.substr(7);
         newpath += UrlDecode(tobedecode);
@@ -181,72 +271,192 @@ void HttpRequest::ParsePath_() {
     }
 }
 
-HTTP_CODE HttpRequest::ParseRequestLine_(const string& line) {
-    // 匹配正则表达式，以括号（）划分组别，一共三组分别匹配：请求方法（GET、POST）; URL 资源路径; 协议版本
-    // ^ 符号表示匹配字符串的开头, $ 符号表示匹配字符串的结尾
-    // [^ ]* 表示匹配零个或多个非空格字符, ^字符在此处表示取反的意思
-    regex patten("^([^ ]*) ([^ ]*) HTTP/([^ ]*)$"); 
-    smatch subMatch;
-    if(regex_match(line, subMatch, patten)) {   
-        method_ = subMatch[1];
-        path_ = subMatch[2];
-        version_ = subMatch[3];
-        state_ = HEADERS; // 解析请求行完毕，状态置为解析请求头 HEADERS
-        return NO_REQUEST; //request isn't completed
-    }
-    LOG_ERROR("RequestLine Error");
-    return BAD_REQUEST;
-}
-
-HTTP_CODE HttpRequest::ParseHeader_(const string& line) {
-    // 从起始位置（^表示匹配字符串的开头）到结束位置（$表示匹配字符串的结尾）进行匹配
-    // ([^:]*表示匹配零个或多个非冒号（:）字符，用于捕获键（key）部分的文本
-    // ?表示前面的空格是可选的，用于匹配可能存在或不存在的空格
-    // .*表示匹配零个或多个任意字符，这个捕获组用于捕获冒号后面的值（value）部分的文本
-    regex patten("^([^:]*): ?(.*)$");
-    smatch subMatch;
-    if(regex_match(line, subMatch, patten)) {
-        header_[subMatch[1]] = subMatch[2];
-        if (subMatch[1] == "Content-Length") {
-            contentLen = stoi(subMatch[2]);
+HTTP_CODE HttpRequest::ParseRequestLine_(const char* begin, const char* end) {
+    // 请求行以空格划分为三部分：请求方法（GET、POST）; URL 资源路径; 协议版本 HTTP/x.x，各部分内不含空格
+    const char* sp1 = static_cast<const char*>(memchr(begin, ' ', end - begin));
+    const char* sp2 = sp1 ? static_cast<const char*>(memchr(sp1 + 1, ' ', end - sp1 - 1)) : nullptr;
+    if(!sp1 || !sp2 || sp1 == begin || sp2 == sp1 + 1 || end - sp2 - 1 < 5
+            || memcmp(sp2 + 1, "HTTP/", 5) != 0 || memchr(sp2 + 6, ' ', end - sp2 - 6)) {
+        LOG_ERROR("RequestLine Error");
+        return BAD_REQUEST;
+    }
+    method_ = string_view(begin, sp1 - begin);
+    path_.assign(sp1 + 1, sp2);
+    version_ = string_view(sp2 + 6, end - sp2 - 6);
+    state_ = HEADERS; // 解析请求行完毕，状态置为解析请求头 HEADERS
+    return NO_REQUEST; //request isn't completed
+}
+
+HTTP_CODE HttpRequest::ParseHeader_(const char* begin, const char* colon, const char* end) {
+    // 冒号前为字段名，冒号后去掉首尾空白为字段值
+    string_view key(begin, colon - begin);
+    const char* value = colon + 1;
+    while(value < end && (*value == ' ' || *value == '\t')) { value++; }
+    while(end > value && (end[-1] == ' ' || end[-1] == '\t')) { end--; }
+    if(key.empty()) {
+        return BAD_REQUEST;
+    }
+    header_.emplace_back(key, string_view(value, end - value));
+    if(EqualsIgnoreCase(key, "Content-Length")) {
+        size_t len = 0;
+        if(value == end) { return BAD_REQUEST; }
+        for(const char* p = value; p < end; p++) {
+            if(*p < '0' || *p > '9' || len > (SIZE_MAX - 9) / 10) {
+                return BAD_REQUEST;
+            }
+            len = len * 10 + (*p - '0');
+        }
+        contentLen = len;
+    }
+    return NO_REQUEST;
+}
+
+/* 请求头完整、消息体到达之前：检查长度上限，确定消息体的处理方式 */
+HTTP_CODE HttpRequest::BeginBody_() {
+    string_view type = GetHeader("Content-Type");
+    bool multipart = method_ == "POST" && type.find("multipart/form-data") != string_view::npos;
+    isForm_ = method_ == "POST" && type == "application/x-www-form-urlencoded";
+    if(contentLen > (isForm_ ? min(MAX_FORM_BODY, maxBodySize) : maxBodySize)) {
+        LOG_WARN("body too large: %d Byte", contentLen);
+        return PAYLOAD_TOO_LARGE;
+    }
+    if(multipart && !multipart_.Init(type, uploadDir, Disk_())) {
+        LOG_ERROR("multipart boundary error");
+        return BAD_REQUEST;
+    }
+    if(method_ == "PUT" && IsChunked_()) {
+        if(path_.size() == strlen(UploadStore::PREFIX)) {
+            return BAD_REQUEST; // PUT 须指明会话 id
         }
+        upload_ = UploadStore::Instance()->Find(path_.substr(strlen(UploadStore::PREFIX) + 1));
+        if(!upload_) {
+            return NO_RESOURSE;
+        }
+        /* Content-Range: bytes 起点-终点/总长，区间长度须与消息体一致 */
+        string range(GetHeader("Content-Range"));
+        unsigned long long start, end, total;
+        int n = 0;
+        if(sscanf(range.c_str(), "bytes %llu-%llu/%llu%n", &start, &end, &total, &n) != 3 || n != (int)range.size() ||
+                start > end || end - start + 1 != contentLen || total != upload_->size || end >= total) {
+            LOG_WARN("chunked upload: bad Content-Range %s", range.c_str());
+            return BAD_REQUEST;
+        }
+        uploadOffset_ = start;
+    }
+    expectContinue_ = EqualsIgnoreCase(GetHeader("Expect"), "100-continue");
+    return NO_REQUEST;
+}
+
+bool HttpRequest::IsChunked_() const {
+    const size_t len = strlen(UploadStore::PREFIX);
+    return path_.compare(0, len, UploadStore::PREFIX) == 0 && (path_.size() == len || path_[len] == '/');
+}
+
+/* 分块上传：POST /upload/chunked 建立会话（表单字段 name、size）；对 /upload/chunked/<id>，
+   PUT 写入 Content-Range 指定的区间，GET 查询已收到的区间，POST 完成（可带表单字段 sha256 校验），DELETE 放弃。
+   涉及文件操作的步骤提交给磁盘 I/O 线程，完成后由 complete_ 生成响应 */
+HTTP_CODE HttpRequest::ParseChunked_() {
+    UploadStore* store = UploadStore::Instance();
+    if(isForm_) {
+        ParseFromUrlencoded_();
+    }
+    if(path_.size() == strlen(UploadStore::PREFIX)) {
+        string size = GetPost("size");
+        char* end = nullptr;
+        unsigned long long n = strtoull(size.c_str(), &end, 10);
+        if(method_ != "POST" || size.empty() || !isdigit(size[0]) || *end != '\0') {
+            return BAD_REQUEST;
+        }
+        if(n > maxBodySize) {
+            return PAYLOAD_TOO_LARGE;
+        }
+        shared_ptr<string> id = make_shared<string>();
+        Disk_()->Submit([store, id, name = GetPost("name"), n] {
+            *id = store->Create(name, n);
+            return 0;
+        });
+        complete_ = [this, store, id] {
+            UploadStore::SessionRef session = store->Find(*id);
+            return session ? Reply_(UploadStore::Describe(*session)) : BAD_REQUEST;
+        };
+        return NO_REQUEST;
+    }
+    const string id = path_.substr(strlen(UploadStore::PREFIX) + 1);
+    if(method_ == "POST") {
+        shared_ptr<pair<UploadStore::Status, Json::Value>> done = make_shared<pair<UploadStore::Status, Json::Value>>();
+        Disk_()->Submit([store, done, id, sha256 = GetPost("sha256")] {
+            done->first = store->Finalize(id, sha256, done->second); // 需要补算摘要时读回整个文件
+            return 0;
+        });
+        complete_ = [this, done] {
+            const Json::Value& result = done->second;
+            switch(done->first) {
+            case UploadStore::OK:
+                FileCache::Instance()->Invalidate("files/" + result["name"].asString());
+                FileIndex::Instance()->Add(result["name"].asString());
+                return Reply_(result);
+            case UploadStore::NOT_FOUND:
+                return NO_RESOURSE;
+            case UploadStore::INCOMPLETE:
+            case UploadStore::MISMATCH:
+                return CONFLICT;
+            default:
+                return INTERNAL_ERROR;
+            }
+        };
         return NO_REQUEST;
-    } else if (contentLen) {
-        state_ = BODY;
+    }
+    UploadStore::SessionRef session = upload_ ? upload_ : store->Find(id);
+    if(!session || (method_ != "GET" && method_ != "PUT" && method_ != "DELETE")) {
+        return session ? BAD_REQUEST : NO_RESOURSE;
+    }
+    Json::Value status = UploadStore::Describe(*session);
+    if(method_ == "DELETE") {
+        Disk_()->Submit([store, id] {
+            store->Remove(id);
+            return 0;
+        });
+        complete_ = [this, status] { return Reply_(status); };
         return NO_REQUEST;
-    } else {
-        return GET_REQUEST;
     }
+    return Reply_(status);
+}
+
+HTTP_CODE HttpRequest::Reply_(const Json::Value& value) {
+    Json::StreamWriterBuilder writerBuilder;
+    return Reply_("reply.json", Json::writeString(writerBuilder, value));
+}
+
+/* 程序生成的响应体只在内存中，不写入资源目录；name 决定 Content-type */
+HTTP_CODE HttpRequest::Reply_(const char* name, string content) {
+    static atomic<uint64_t> version(0);
+    reply_ = FileCache::Instance()->FromMemory(name, std::move(content), ++version);
+    return GET_REQUEST;
 }
 
 /* 解析请求消息体，根据消息类型解析内容 */
 HTTP_CODE HttpRequest::ParseBody_()
 {
+    if(IsChunked_()) {
+        return ParseChunked_();
+    }
     //key-value
-    if (method_ == "POST" && header_["Content-Type"] == "application/x-www-form-urlencoded")
+    if (method_ == "POST" && GetHeader("Content-Type") == "application/x-www-form-urlencoded")
     {
         ParseFromUrlencoded_();
         if(DEFAULT_HTML_TAG.count(path_)) {
             int tag = DEFAULT_HTML_TAG.find(path_)->second;
             if(tag == 0 || tag == 1) {
                 bool isLogin = (tag == 1); // 登录或注册
-                if(UserVerify(post_["username"], post_["password"], isLogin)) {
-                    path_ = "/welcome.html";
-                } 
-                else {
-                    path_ = "/error.html";
-                }
+                UserVerify_(post_["username"], post_["password"], isLogin);
             }
         }
     }
-    else if (method_ == "POST" && header_["Content-Type"].find("multipart/form-data") != string::npos)
+    else if (multipart_.Done())
     {
         ParseMultipartFormData_();
         LOG_INFO("upload file!");
-        ofstream ofs;
-        ofs.open("./resources/response.txt", ios::ate);
-        ofs << "./resources/files/" << fileInfo["filename"];
-        ofs.close();
+        Reply_("response.txt", uploadDir + fileInfo["filename"]); // 上传结果直接从内存返回，不再改写 resources/response.txt
         path_ = "/response.txt";
     }
     LOG_DEBUG("Body:%s len:%d", body_.c_str(), body_.size());
@@ -258,31 +468,17 @@ HTTP_CODE HttpRequest::ParseBody_()
 int HttpRequest::ConverHex(char ch) {
     if(ch >= 'A' && ch <= 'F') return ch -'A' + 10;
     if(ch >= 'a' && ch <= 'f') return ch -'a' + 10;
-    return ch;
+    return ch - '0';
 }
 
+/* 文件内容已由 multipart_ 交给磁盘 I/O 线程写入上传目录并改名到位，这里只登记结果 */
 void HttpRequest::ParseMultipartFormData_() {
-    if (body_.size() == 0) return;
-
-    size_t st = 0, ed = 0;
-    ed = body_.find(CRLF);
-    string boundary = body_.substr(0, ed);
-
-    // 解析文件信息
-    st = body_.find("filename=\"", ed) + strlen("filename=\"");
-    ed = body_.find("\"", st);
-    fileInfo["filename"] = body_.substr(st, ed - st);
-    
-    // 解析文件内容，文件内容以\r\n\r\n开始
-    st = body_.find("\r\n\r\n", ed) + strlen("\r\n\r\n");
-    ed = body_.find(boundary, st) - 2; // 文件结尾也有\r\n
-    string content = body_.substr(st, ed - st);
-
-    ofstream ofs;
-    // 如果文件分多次发送，应该采用app，同时为避免重复上传，应该用md5做校验
-    ofs.open("./resources/files/" + fileInfo["filename"], ios::ate);
-    ofs << content;
-    ofs.close();
+    fileInfo["filename"] = "";
+    for(const string& name: multipart_.Files()) {
+        fileInfo["filename"] = name;
+        FileCache::Instance()->Invalidate("files/" + name);
+        FileIndex::Instance()->Add(name); // 不等 inotify 通知，上传后立即出现在列表中
+    }
 }
 
 void HttpRequest::ParseFromUrlencoded_() {
@@ -303,11 +499,12 @@ void HttpRequest::ParseFromUrlencoded_() {
         case '+':
             body_[i] = ' '; // + 替换为空格
             break;
-        case '%': // % 后面两位十六进制数替换为十进制数
-            num = ConverHex(body_[i + 1]) * 16 + ConverHex(body_[i + 2]);
-            body_[i + 2] = num % 10 + '0';
-            body_[i + 1] = num / 10 + '0';
-            i += 2;
+        case '%': // % 后面两位十六进制数解码为一个字节（中文文件名等）
+            if(i + 2 < n && isxdigit(body_[i + 1]) && isxdigit(body_[i + 2])) {
+                num = ConverHex(body_[i + 1]) * 16 + ConverHex(body_[i + 2]);
+                body_.replace(i, 3, 1, static_cast<char>(num));
+                n -= 2;
+            }
             break;
         case '&': // & 前为 value
             value = body_.substr(j, i - j);
@@ -326,65 +523,49 @@ void HttpRequest::ParseFromUrlencoded_() {
     }
 }
 
-bool HttpRequest::UserVerify(const string &name, const string &pwd, bool isLogin) {
-    if(name == "" || pwd == "") { return false; }
-    LOG_INFO("Verify name:%s pwd:%s", name.c_str(), pwd.c_str());
-    MYSQL* sql;
-    SqlConnRAII(&sql,  SqlConnPool::Instance());
-    assert(sql);
-    
-    bool flag = false;
-    unsigned int j = 0;
-    char order[256] = { 0 };
-    MYSQL_FIELD *fields = nullptr;
-    MYSQL_RES *res = nullptr;
-    
-    if(!isLogin) { flag = true; }
-    /* 查询用户及密码 */
-    snprintf(order, 256, "SELECT username, passwd FROM user WHERE username='%s' LIMIT 1", name.c_str());
-    LOG_DEBUG("query order: %s", order);
-
-    if(mysql_query(sql, order)) { // 执行查询出现错误（函数返回非0值）
-        mysql_free_result(res); // 遵循释放资源的规范操作
-        return false; 
-    }
-    res = mysql_store_result(sql); // 获取查询结果集并存储到 res 指针指向的内存中
-    j = mysql_num_fields(res); // 获取结果集中字段的数量
-    fields = mysql_fetch_fields(res); // 获取结果集的字段信息
-
-    while(MYSQL_ROW row = mysql_fetch_row(res)) { // 遍历查询结果集中的每一行数据（实际按逻辑应该只有一行，因为前面 LIMIT 1 限制了）
-        LOG_DEBUG("MYSQL ROW: %s %s", row[0], row[1]);
-        string password(row[1]);
-        /* 登录行为 */
-        if(isLogin) {
-            if(pwd == password) { flag = true; }
-            else {
-                flag = false;
-                LOG_DEBUG("password error!");
+/* 校验交给用户存储（MySQL 时由数据库线程查询），等待结果期间不占用工作线程；结果到达后由 complete_ 决定跳转的页面 */
+void HttpRequest::UserVerify_(const string &name, const string &pwd, bool isLogin) {
+    shared_ptr<atomic<bool>> verified = make_shared<atomic<bool>>(false);
+    if(name != "" && pwd != "") {
+        shared_ptr<DiskChannel>& disk = Disk_();
+        disk->Begin();
+        UserStore::Instance()->Verify(name, pwd, isLogin, [disk, verified](bool ok) {
+            *verified = ok;
+            disk->End();
+        });
+    }
+    complete_ = [this, verified, name] {
+        path_ = *verified ? "/welcome.html" : "/error.html";
+        if(*verified) {
+            string token = SessionTable::Instance()->Create(name, sid_); // 替换请求原带的会话，反复登录不会累积会话
+            if(!token.empty()) {
+                user_ = name;
+                cookie_ = string(SessionTable::COOKIE) + "=" + token + "; Path=/; HttpOnly; SameSite=Lax";
             }
-        } 
-        else { 
-            flag = false; 
-            LOG_DEBUG("user used!");
         }
-    }
-    mysql_free_result(res); // 遵循释放资源的规范操作
-
-    /* 注册行为 且 用户名未被使用*/
-    if(!isLogin && flag == true) {
-        LOG_DEBUG("regirster!");
-        bzero(order, 256);
-        snprintf(order, 256,"INSERT INTO user(username, passwd) VALUES('%s','%s')", name.c_str(), pwd.c_str());
-        LOG_DEBUG( "query order: %s", order);
-        if(mysql_query(sql, order)) { 
-            LOG_DEBUG( "MYSQL (user, passwd) insert error!");
-            flag = false; 
+        return GET_REQUEST;
+    };
+}
+
+/* 从 Cookie 中取出会话令牌，查会话表得到用户；已登录的用户再打开登录、注册页面时直接进入欢迎页 */
+void HttpRequest::ParseSession_() {
+    string_view cookie = GetHeader("Cookie");
+    size_t nameLen = strlen(SessionTable::COOKIE);
+    while(!cookie.empty()) {
+        size_t end = cookie.find(';');
+        string_view item = cookie.substr(0, end);
+        cookie = end == string_view::npos ? string_view() : cookie.substr(end + 1);
+        while(!item.empty() && item.front() == ' ') { item.remove_prefix(1); }
+        if(item.size() > nameLen && item.compare(0, nameLen, SessionTable::COOKIE) == 0 && item[nameLen] == '=') {
+            sid_ = string(item.substr(nameLen + 1));
+            user_ = SessionTable::Instance()->Find(sid_);
+            break;
         }
-        flag = true;
     }
-    SqlConnPool::Instance()->FreeConn(sql); // 释放 sql connection 返回 sqlconnpool
-    LOG_DEBUG( "UserVerify complete !!");
-    return flag;
+    if(!user_.empty() && method_ == "GET" && (path_ == "/login.html" || path_ == "/register.html")) {
+        LOG_DEBUG("session of %s, skip %s", user_.c_str(), path_.c_str());
+        path_ = "/welcome.html";
+    }
 }
 
 std::string HttpRequest::path() const{
@@ -395,14 +576,55 @@ std::string& HttpRequest::path(){
     return path_;
 }
 
-std::string HttpRequest::method() const {
+std::string_view HttpRequest::method() const {
     return method_;
 }
 
-std::string HttpRequest::version() const {
+std::string_view HttpRequest::version() const {
     return version_;
 }
 
+std::string_view HttpRequest::GetHeader(std::string_view key) const {
+    for(auto& field: header_) {
+        if(EqualsIgnoreCase(field.first, key)) {
+            return field.second;
+        }
+    }
+    return std::string_view();
+}
+
+bool HttpRequest::AcceptsEncoding(std::string_view coding) const {
+    std::string_view list = GetHeader("Accept-Encoding");
+    int wildcard = -1; // "*" 的结果，编码未单独列出时使用
+    while(!list.empty()) {
+        size_t comma = list.find(',');
+        std::string_view item = list.substr(0, comma);
+        list = comma == std::string_view::npos ? std::string_view() : list.substr(comma + 1);
+        size_t semi = item.find(';');
+        std::string_view name = item.substr(0, semi);
+        while(!name.empty() && name.front() == ' ') { name.remove_prefix(1); }
+        while(!name.empty() && name.back() == ' ') { name.remove_suffix(1); }
+        /* q 值全为 0（"q=0"、"q=0.000"）表示不接受 */
+        bool accepted = true;
+        if(semi != std::string_view::npos) {
+            std::string_view params = item.substr(semi + 1);
+            size_t q = params.find("q=");
+            if(q != std::string_view::npos) {
+                std::string_view value = params.substr(q + 2);
+                value = value.substr(0, value.find_first_not_of("0123456789."));
+                accepted = value.find_first_of("123456789") != std::string_view::npos;
+            }
+        }
+        if(EqualsIgnoreCase(name, coding)) {
+            return accepted;
+        }
+        if(name == "*") {
+            wildcard = accepted;
+        }
+    }
+    return wildcard == 1;
+}
+
 std::string HttpRequest::GetPost(const std::string& key) const {
     assert(key != "");
     if(post_.count(key) == 1) {
@@ -4,25 +4,36 @@
 #include <unordered_map>
 #include <unordered_set>
 #include <string>
-#include <regex>
-#include <errno.h>   
-#include <mysql/mysql.h>  //mysql
+#include <string_view>
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <ctype.h>     // isdigit, isxdigit
+#include <errno.h>
+#include <strings.h>   // strncasecmp
+#include <stdint.h>    // SIZE_MAX
 
-#include <fstream>
 #include <stdio.h>
 #include <sys/types.h>
 #include <dirent.h>
-#include <json/json.h>
 
 #include "../buffer/buffer.h"
+#include "charscan.h"
+#include "filecache.h"
+#include "fileindex.h"
+#include "multipart.h"
+#include "uploadstore.h"
+#include "session.h"
 #include "../log/log.h"
-#include "../pool/sqlconnpool.h"
-#include "../pool/sqlconnRAII.h"
+#include "../pool/diskio.h"
+#include "../pool/userstore.h"
 
 enum PARSE_STATE {
     REQUEST_LINE,
     HEADERS,
     BODY,
+    WAIT_DISK,     // 消息体已读完，等待磁盘任务完成后再处理请求
     FINISH,        
 };
 
@@ -35,6 +46,8 @@ enum HTTP_CODE {
     FILE_REQUEST,
     INTERNAL_ERROR,
     CLOSED_CONNECTION,
+    PAYLOAD_TOO_LARGE, // 请求头完整时即可判断，不读消息体直接返回 413
+    CONFLICT,          // 与资源当前状态冲突（分块上传未收全、摘要不符），409
 };
 
 class HttpRequest {
@@ -43,16 +56,32 @@ public:
     ~HttpRequest() = default;
 
     void Init();
+    void SetResume(std::function<void()> resume); // 新连接：磁盘任务完成、可以继续处理时调用 resume（在磁盘 I/O 线程中）
     HTTP_CODE parse(Buffer& buff);
 
+    /* 请求在等待磁盘任务（写入积压或结果未出），此时不应再读 socket；
+       WaitDisk() 登记等待，返回 false 表示已经可以继续，应立即再次 parse() */
+    bool DiskBusy() const;
+    bool WaitDisk();
+
+    /* method/version/header 为指向读缓冲区的视图，只在本次请求处理期间（下一次读入或 Init() 之前）有效 */
     std::string path() const;
     std::string& path();
-    std::string method() const;
-    std::string version() const;
+    std::string_view method() const;
+    std::string_view version() const;
+    std::string_view GetHeader(std::string_view key) const; // 字段名不区分大小写，不存在返回空
+    bool AcceptsEncoding(std::string_view coding) const;    // Accept-Encoding 是否接受该编码（含 "*"，q=0 表示拒绝）
     std::string GetPost(const std::string& key) const;
     std::string GetPost(const char* key) const;
 
     bool IsKeepAlive() const;
+    bool TakeContinue(); // 请求带 Expect: 100-continue 且可以接收消息体时返回 true（只返回一次），应先回复 100 Continue
+    FileRef TakeReply() { return std::move(reply_); } // 程序生成的响应体（分块上传的 json），没有则为空
+    std::string TakeCookie() { return std::move(cookie_); } // 登录成功时需要设置的 Set-Cookie 值，没有则为空
+    const std::string& user() const { return user_; }        // 请求所带会话对应的用户，未登录为空
+
+    static size_t maxBodySize; // 消息体上限（字节），超过时返回 413
+    static std::string uploadDir; // 上传目录，以 '/' 结尾
 
     /* 
     todo 
@@ -61,28 +90,55 @@ public:
     */
 
 private:
-    HTTP_CODE ParseRequestLine_(const std::string& line);
-    HTTP_CODE ParseHeader_(const std::string& line);
+    HTTP_CODE ParseHead_(Buffer& buff);
+    HTTP_CODE ParseRequestLine_(const char* begin, const char* end);
+    HTTP_CODE ParseHeader_(const char* begin, const char* colon, const char* end);
+    HTTP_CODE BeginBody_();
+    HTTP_CODE Complete_();
+    std::shared_ptr<DiskChannel>& Disk_();
+    bool IsChunked_() const;
+    HTTP_CODE ParseChunked_();
+    HTTP_CODE Reply_(const Json::Value& value);
+    HTTP_CODE Reply_(const char* name, std::string content);
     HTTP_CODE ParseBody_();
+    void Rebase_(const char* base);
 
     void ParsePath_();
     void ParseFromUrlencoded_();
     void ParseMultipartFormData_();
 
-    static bool UserVerify(const std::string& name, const std::string& pwd, bool isLogin);
+    void UserVerify_(const std::string& name, const std::string& pwd, bool isLogin);
+    void ParseSession_();
     static int ConverHex(char ch);
 
-    std::vector<std::string> getDownloadFiles(std::string dir);
-    void writeJson(std::string file, Json::Value root);
     std::string UrlDecode(const std::string& str);
 
     size_t contentLen;
+    size_t bodyRead_;    // 已消费的消息体字节数
+    bool isForm_;        // application/x-www-form-urlencoded：消息体保存在 body_ 中，其他类型不保存
+    bool expectContinue_;
+    MultipartParser multipart_; // multipart/form-data：边读边写入上传目录
+    UploadStore::SessionRef upload_; // 分块上传的 PUT：消息体按 uploadOffset_ 起的偏移写入该会话
+    uint64_t uploadOffset_;
+    FileRef reply_;
+    std::shared_ptr<DiskChannel> disk_; // 本连接的异步任务（磁盘写入、数据库查询），首次需要时创建
+    std::function<void()> resume_;
+    std::function<HTTP_CODE()> complete_; // 处理请求时提交了异步任务：任务完成后由它给出结果
+    std::string user_;   // Cookie 中的会话令牌对应的用户
+    std::string sid_;    // Cookie 中的会话令牌
+    std::string cookie_; // 新建的会话
     PARSE_STATE state_;
-    std::string method_, path_, version_, body_;
-    std::unordered_map<std::string, std::string> header_;
+    size_t parsed_;      // 请求头已解析到的位置（相对 Peek() 的偏移），请求头完整前不从缓冲区取出
+    const char* base_;   // 上次解析时的 Peek()，缓冲区扩容或挪动后据此平移各视图
+    std::string head_;   // 有消息体时请求头的副本：读消息体会清空读缓冲区
+    std::string_view method_, version_;
+    std::string path_, body_;
+    std::vector<std::pair<std::string_view, std::string_view>> header_;
     std::unordered_map<std::string, std::string> post_;
     std::unordered_map<std::string, std::string> fileInfo;
 
+    static constexpr size_t MAX_FORM_BODY = 64 * 1024; // 表单消息体整体保存在内存中，单独限制
+
     static const std::unordered_set<std::string> DEFAULT_HTML;
     static const std::unordered_map<std::string, int> DEFAULT_HTML_TAG;
 
@@ -2,34 +2,20 @@
 
 using namespace std;
 
-const unordered_map<string, string> HttpResponse::SUFFIX_TYPE = {
-    { ".html",  "text/html" },
-    { ".xml",   "text/xml" },
-    { ".xhtml", "application/xhtml+xml" },
-    { ".txt",   "text/plain" },
-    { ".rtf",   "application/rtf" },
-    { ".pdf",   "application/pdf" },
-    { ".word",  "application/nsword" },
-    { ".png",   "image/png" },
-    { ".gif",   "image/gif" },
-    { ".jpg",   "image/jpeg" },
-    { ".jpeg",  "image/jpeg" },
-    { ".au",    "audio/basic" },
-    { ".mpeg",  "video/mpeg" },
-    { ".mpg",   "video/mpeg" },
-    { ".avi",   "video/x-msvideo" },
-    { ".gz",    "application/x-gzip" },
-    { ".tar",   "application/x-tar" },
-    { ".css",   "text/css "},
-    { ".js",    "text/javascript "},
+const HttpResponse::Status HttpResponse::STATUS[] = {
+    { 200, "OK",                    "HTTP/1.1 200 OK\r\n" },
+    { 206, "Partial Content",       "HTTP/1.1 206 Partial Content\r\n" },
+    { 304, "Not Modified",          "HTTP/1.1 304 Not Modified\r\n" },
+    { 400, "Bad Request",           "HTTP/1.1 400 Bad Request\r\n" },
+    { 403, "Forbidden",             "HTTP/1.1 403 Forbidden\r\n" },
+    { 404, "Not Found",             "HTTP/1.1 404 Not Found\r\n" },
+    { 409, "Conflict",              "HTTP/1.1 409 Conflict\r\n" },
+    { 413, "Payload Too Large",     "HTTP/1.1 413 Payload Too Large\r\n" },
+    { 416, "Range Not Satisfiable", "HTTP/1.1 416 Range Not Satisfiable\r\n" },
+    { 500, "Internal Server Error", "HTTP/1.1 500 Internal Server Error\r\n" },
 };
 
-const unordered_map<int, string> HttpResponse::CODE_STATUS = {
-    { 200, "OK" },
-    { 400, "Bad Request" },
-    { 403, "Forbidden" },
-    { 404, "Not Found" },
-};
+atomic<unsigned> HttpResponse::boundarySeq_(0);
 
 const unordered_map<int, string> HttpResponse::CODE_PATH = {
     { 400, "/400.html" },
@@ -41,123 +27,373 @@ HttpResponse::HttpResponse() {
     code_ = -1;
     path_ = srcDir_ = "";
     isKeepAlive_ = false;
-    mmFile_ = nullptr; 
-    mmFileStat_ = { 0 };
+    bodyFd_ = -1;
+    headStart_ = 0;
+    acceptGzip_ = gzip_ = false;
 };
 
 HttpResponse::~HttpResponse() {
     UnmapFile();
 }
 
-void HttpResponse::Init(const string& srcDir, string& path, bool isKeepAlive, int code){
-    assert(srcDir != "");
-    if(mmFile_) { UnmapFile(); }
+void HttpResponse::Init(string_view srcDir, string& path, bool isKeepAlive, int code){
+    assert(!srcDir.empty());
+    UnmapFile();
     code_ = code;
     isKeepAlive_ = isKeepAlive;
     path_ = path;
     srcDir_ = srcDir;
-    mmFile_ = nullptr; 
-    mmFileStat_ = { 0 };
+    acceptGzip_ = gzip_ = false;
+    cookie_.clear();
+    range_.clear();
+    ifRange_.clear();
+    ifNoneMatch_.clear();
+    ifModifiedSince_.clear();
+    ranges_.clear();
+    parts_.clear();
 }
 
-void HttpResponse::MakeResponse(Buffer& buff) {
-    /* 判断请求的资源文件 */
-    if(stat((srcDir_ + path_).data(), &mmFileStat_) < 0 || S_ISDIR(mmFileStat_.st_mode)) { // 请求资源不存在
-        // stat函数尝试获取(srcDir_ + path_).data()所表示的文件（或目录）的相关状态信息
-        // 并将结果存储到mmFileStat_结构体变量中。如果stat函数调用返回值小于0，意味着获取文件状态失败
-        code_ = 404;
+void HttpResponse::SetRange(string_view range, string_view ifRange) {
+    range_ = range;
+    ifRange_ = ifRange;
+}
+
+void HttpResponse::SetConditional(string_view ifNoneMatch, string_view ifModifiedSince) {
+    ifNoneMatch_ = ifNoneMatch;
+    ifModifiedSince_ = ifModifiedSince;
+}
+
+void HttpResponse::SetCacheControl(const string& mimePrefix, const string& value) {
+    MimeType::SetCacheControl(mimePrefix, value);
+}
+
+/* 资源完整路径，作为 FileCache 的键：srcDir_ 以 '/' 结尾，path_ 以 '/' 开头，去掉重复的 '/' */
+const string& HttpResponse::FilePath_() {
+    filePath_.assign(srcDir_);
+    if(!path_.empty() && path_[0] == '/') {
+        filePath_.append(path_, 1, string::npos);
+    } else {
+        filePath_.append(path_);
     }
-    else if(!(mmFileStat_.st_mode & S_IROTH)) { // 资源文件的权限设置中没有其他用户的读权限
-    // S_IROTH：S_I是stat结构（用于存储文件的各种状态信息，包括权限信息）相关权限位的系列宏的前缀，ROTH代表 “Read by Others”（其他用户可读）
-        code_ = 403;
+    return filePath_;
+}
+
+void HttpResponse::MakeResponse(Buffer& buff) {
+    headStart_ = buff.ReadableBytes();
+    parts_.clear();
+    /* 判断请求的资源文件：经 FileCache 查询，命中时不再 stat/open/mmap；文件列表取自内存中的 FileIndex */
+    if(code_ >= 400) {
+        file_.reset(); // 已确定为错误：不查找请求的资源，有错误页面的由 ErrorHtml_() 加载，没有的只回错误说明
     }
-    else if(code_ == -1) { 
-        code_ = 200; 
+    else {
+        if(!file_) { // SetContent() 未指定时按路径查找
+            file_ = path_ == FileIndex::PATH ? FileIndex::Instance()->Listing() : FileCache::Instance()->Get(FilePath_());
+        }
+        if(file_->err == ENOENT || file_->err == ENOTDIR || S_ISDIR(file_->st.st_mode)) { // 请求资源不存在
+            code_ = 404;
+        }
+        else if(!(file_->st.st_mode & S_IROTH)) { // 资源文件的权限设置中没有其他用户的读权限
+        // S_IROTH：S_I是stat结构（用于存储文件的各种状态信息，包括权限信息）相关权限位的系列宏的前缀，ROTH代表 “Read by Others”（其他用户可读）
+            code_ = 403;
+        }
+        else if(code_ == -1) { 
+            code_ = 200; 
+        }
     }
     ErrorHtml_();
+    /* 按 Accept-Encoding 选择预压缩版本，校验值随所选版本不同 */
+    const bool gzip = code_ == 200 && acceptGzip_ && !file_->gzip.empty();
+    gzip_ = gzip;
+    if(code_ == 200 && NotModified_()) {
+        code_ = 304; // 只发响应头，不打开、不发送文件
+    }
+    else if(code_ == 200 && !range_.empty() && file_->Size() > 0) {
+        /* Range 总是针对原文件，If-Range 也按原文件的校验值比较（gzip 版本的 "-gz" 校验值不匹配）；
+           与文件当前版本不符，或 Range 语法无效、区间过多时忽略 Range，整体返回 200，此时仍可发送 gzip 版本 */
+        gzip_ = false;
+        bool current = ifRange_.empty() || ifRange_ == file_->lastModified ||
+                       (ifRange_.front() == '"' && MatchETag_(ifRange_, false));
+        if(current && ParseRange_()) {
+            code_ = ranges_.empty() ? 416 : 206;
+        } else {
+            ranges_.clear();
+            gzip_ = gzip;
+        }
+    }
     AddStateLine_(buff);
     AddHeader_(buff);
     AddContent_(buff);
 }
 
-char* HttpResponse::File() {
-    return mmFile_;
+const char* HttpResponse::File() {
+    if(!file_) { return nullptr; }
+    return gzip_ ? file_->gzip.data() : file_->data;
+}
+
+FileRef HttpResponse::ReleaseFile() {
+    return std::move(file_);
+}
+
+int HttpResponse::ReleaseBodyFd() {
+    int fd = bodyFd_;
+    bodyFd_ = -1;
+    return fd;
 }
 
 size_t HttpResponse::FileLen() const {
-    return mmFileStat_.st_size;
+    return file_ ? file_->Size() : 0;
 }
 
 void HttpResponse::ErrorHtml_() {
     if(CODE_PATH.count(code_) == 1) {
         path_ = CODE_PATH.find(code_)->second;
-        stat((srcDir_ + path_).data(), &mmFileStat_);
+        file_ = FileCache::Instance()->Get(FilePath_());
     }
 }
 
-void HttpResponse::AddStateLine_(Buffer& buff) {
-    string status;
-    if(CODE_STATUS.count(code_) == 1) {
-        status = CODE_STATUS.find(code_)->second;
+string_view HttpResponse::Reason_(int code) {
+    for(const Status& status: STATUS) {
+        if(status.code == code) { return status.reason; }
     }
-    else {
-        code_ = 400;
-        status = CODE_STATUS.find(400)->second;
+    return string_view();
+}
+
+/* "Date: ...\r\n"，每个线程每秒格式化一次 */
+string_view HttpResponse::DateHeader_() {
+    thread_local time_t last = -1;
+    thread_local char buf[48];
+    thread_local size_t len = 0;
+    time_t now = time(nullptr);
+    if(now != last) {
+        struct tm tm;
+        gmtime_r(&now, &tm);
+        len = strftime(buf, sizeof(buf), "Date: %a, %d %b %Y %H:%M:%S GMT\r\n", &tm);
+        last = now;
+    }
+    return string_view(buf, len);
+}
+
+void HttpResponse::Append_(Buffer& buff, string_view str) {
+    buff.Append(str.data(), str.size()); // 不经过临时 std::string
+}
+
+void HttpResponse::AppendNumber_(Buffer& buff, size_t value) {
+    char buf[24];
+    char* p = buf + sizeof(buf);
+    do {
+        *--p = '0' + value % 10;
+        value /= 10;
+    } while(value);
+    buff.Append(p, buf + sizeof(buf) - p);
+}
+
+void HttpResponse::AddStateLine_(Buffer& buff) {
+    for(const Status& status: STATUS) {
+        if(status.code == code_) {
+            Append_(buff, status.line);
+            return;
+        }
     }
-    buff.Append("HTTP/1.1 " + to_string(code_) + " " + status + "\r\n");
+    code_ = 400;
+    AddStateLine_(buff);
 }
 
+/* 静态文件的常量部分整块取自 FileCache 预先生成的响应头，这里只补 Connection、Date 与登录时的 Set-Cookie */
 void HttpResponse::AddHeader_(Buffer& buff) {
-    buff.Append("Connection: ");
-    if(isKeepAlive_) {
-        buff.Append("keep-alive\r\n");
-        buff.Append("keep-alive: max=6, timeout=120\r\n");
-    } else{
-        buff.Append("close\r\n");
+    static constexpr string_view KEEP_ALIVE = "Connection: keep-alive\r\nkeep-alive: max=6, timeout=120\r\n";
+    static constexpr string_view CLOSE = "Connection: close\r\n";
+    Append_(buff, isKeepAlive_ ? KEEP_ALIVE : CLOSE);
+    Append_(buff, DateHeader_());
+    if(!cookie_.empty()) {
+        buff.Append("Set-Cookie: " + cookie_ + "\r\n");
+    }
+    if((code_ != 200 && code_ != 206 && code_ != 304) || file_->err != 0) {
+        Append_(buff, "Content-type: text/html\r\n"); // 错误页面或 ErrorContent 生成的页面
+        return;
+    }
+    const CachedFile::HeaderBlock& block = file_->header[gzip_ ? 1 : 0];
+    if(code_ == 304) {
+        buff.Append(block.text.data(), block.entity); // 304 没有消息体，只发校验与缓存相关的头
+        return;
+    }
+    if(ranges_.size() > 1) {
+        buff.Append(block.text.data(), block.entity);
+        boundary_ = "NanoWebServer" + to_string(boundarySeq_.fetch_add(1, memory_order_relaxed));
+        buff.Append("Accept-Ranges: bytes\r\nContent-type: multipart/byteranges; boundary=" + boundary_ + "\r\n");
+        return;
     }
-    buff.Append("Content-type: " + GetFileType_() + "\r\n");
+    buff.Append(block.text.data(), block.text.size());
+}
+
+/* 解析 "bytes=a-b, c-, -n"，区间按文件大小截断，不可满足的区间丢弃；语法错误或区间过多返回 false */
+bool HttpResponse::ParseRange_() {
+    ranges_.clear();
+    const size_t size = file_->Size();
+    string_view spec(range_);
+    if(spec.compare(0, 6, "bytes=") != 0) { return false; }
+    spec.remove_prefix(6);
+    size_t count = 0;
+    while(true) {
+        size_t comma = spec.find(',');
+        string_view item = spec.substr(0, comma);
+        while(!item.empty() && (item.front() == ' ' || item.front() == '\t')) { item.remove_prefix(1); }
+        while(!item.empty() && (item.back() == ' ' || item.back() == '\t')) { item.remove_suffix(1); }
+        size_t dash = item.find('-');
+        if(dash == string_view::npos || ++count > MAX_RANGES) { return false; }
+        /* 十进制非负整数，空串记为 SIZE_MAX；超过 size_t 的值按 SIZE_MAX 处理，效果与超出文件末尾相同 */
+        auto number = [](string_view digits, size_t& value) {
+            value = SIZE_MAX;
+            if(digits.empty()) { return true; }
+            value = 0;
+            for(char ch: digits) {
+                if(ch < '0' || ch > '9') { return false; }
+                if(value > (SIZE_MAX - 9) / 10) { value = SIZE_MAX; continue; }
+                value = value * 10 + (ch - '0');
+            }
+            return true;
+        };
+        size_t first, last;
+        if(!number(item.substr(0, dash), first) || !number(item.substr(dash + 1), last)) { return false; }
+        if(dash == 0) {
+            /* 后缀区间：最后 last 个字节 */
+            if(last == SIZE_MAX && item.size() == 1) { return false; }
+            if(last > 0) {
+                size_t len = min(last, size);
+                ranges_.emplace_back(size - len, len);
+            }
+        } else {
+            if(first == SIZE_MAX || (last != SIZE_MAX && last < first)) { return false; }
+            if(first < size) {
+                ranges_.emplace_back(first, min(last, size - 1) - first + 1);
+            }
+        }
+        if(comma == string_view::npos) { break; }
+        spec.remove_prefix(comma + 1);
+    }
+    return true;
+}
+
+/* tag 为带引号的校验值，与发送版本的 ETag 比较；弱比较忽略 "W/" 前缀，强比较（If-Range）不接受弱校验值 */
+bool HttpResponse::MatchETag_(string_view tag, bool weak) const {
+    if(tag.compare(0, 2, "W/") == 0) {
+        if(!weak) { return false; }
+        tag.remove_prefix(2);
+    }
+    string_view suffix = gzip_ ? "-gz\"" : "\"";
+    return tag.size() == file_->etag.size() + suffix.size() + 1 && tag.front() == '"' &&
+           tag.compare(1, file_->etag.size(), file_->etag) == 0 &&
+           tag.substr(1 + file_->etag.size()) == suffix;
+}
+
+/* If-None-Match 优先；没有时才看 If-Modified-Since */
+bool HttpResponse::NotModified_() const {
+    if(!ifNoneMatch_.empty()) {
+        string_view list(ifNoneMatch_);
+        while(!list.empty()) {
+            size_t comma = list.find(',');
+            string_view tag = list.substr(0, comma);
+            list = comma == string_view::npos ? string_view() : list.substr(comma + 1);
+            while(!tag.empty() && tag.front() == ' ') { tag.remove_prefix(1); }
+            while(!tag.empty() && tag.back() == ' ') { tag.remove_suffix(1); }
+            if(tag == "*" || MatchETag_(tag, true)) { return true; }
+        }
+        return false;
+    }
+    if(!ifModifiedSince_.empty()) {
+        if(ifModifiedSince_ == file_->lastModified) { return true; }
+        struct tm tm = {};
+        const char* end = strptime(ifModifiedSince_.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &tm);
+        return end && *end == '\0' && file_->st.st_mtime <= timegm(&tm);
+    }
+    return false;
 }
 
 void HttpResponse::AddContent_(Buffer& buff) {
-    int srcFd = open((srcDir_ + path_).data(), O_RDONLY);
-    if(srcFd < 0) { 
-        ErrorContent(buff, "File NotFound!");
+    if(code_ == 304) {
+        Append_(buff, "\r\n");
+        parts_.push_back({ buff.ReadableBytes() - headStart_, 0, 0 });
+        return;
+    }
+    /* 小文件已由 FileCache 映射到内存（只读私有映射）；大文件未映射，打开描述符留给 sendfile */
+    if(code_ != 416 && file_ && file_->err == 0 && !file_->data && file_->Size() > 0) {
+        bodyFd_ = open(FilePath_().data(), O_RDONLY | O_CLOEXEC);
+    }
+    if(code_ == 416) {
+        Append_(buff, "Content-Range: bytes */");
+        AppendNumber_(buff, file_->Size());
+        Append_(buff, "\r\n");
+    }
+    if(code_ == 416 || !file_ || file_->err != 0 || (!file_->data && file_->Size() > 0 && bodyFd_ < 0)) { 
+        file_.reset();
+        if(code_ >= 400 && CODE_PATH.count(code_) == 0) {
+            ErrorContent(buff, string(Reason_(code_)));
+        } else {
+            ErrorContent(buff, "File NotFound!");
+        }
+        parts_.push_back({ buff.ReadableBytes() - headStart_, 0, 0 });
         return; 
     }
+    LOG_DEBUG("AddContent_ file path: %s", FilePath_().data());
+    if(ranges_.size() > 1) {
+        AddMultipart_(buff);
+        return;
+    }
+    size_t offset = 0, len = gzip_ ? file_->gzip.size() : file_->Size();
+    if(ranges_.size() == 1) {
+        offset = ranges_[0].first;
+        len = ranges_[0].second;
+        Append_(buff, "Content-Range: bytes ");
+        AppendNumber_(buff, offset);
+        Append_(buff, "-");
+        AppendNumber_(buff, offset + len - 1);
+        Append_(buff, "/");
+        AppendNumber_(buff, file_->Size());
+        Append_(buff, "\r\n");
+    }
+    Append_(buff, "Content-length: ");
+    AppendNumber_(buff, len);
+    Append_(buff, "\r\n\r\n");
+    parts_.push_back({ buff.ReadableBytes() - headStart_, offset, len });
+}
 
-    /* 将文件映射到内存提高文件的访问速度 
-        PROT_READ 映射区域的保护属性为只读
-        MAP_PRIVATE 建立一个写入时拷贝的私有映射,即如果进程对映射区域进行写操作（虽然这里按逻辑不应进行写操作，因为设置了只读保护），
-        系统会为该进程单独创建一份要修改的数据副本，而不会影响到磁盘上的原文件以及其他进程对该文件的映射情况。*/
-    LOG_DEBUG("AddContent_ opened file path: %s", (srcDir_ + path_).data());
-    int* mmRet = (int*)mmap(0, mmFileStat_.st_size, PROT_READ, MAP_PRIVATE, srcFd, 0);
-    if(*mmRet == -1) {
-        ErrorContent(buff, "File NotFound!");
-        return; 
+/* multipart/byteranges：各分段头依次写入 buff，文件片段仍由映射或 sendfile 发送，不复制文件内容 */
+void HttpResponse::AddMultipart_(Buffer& buff) {
+    const string type(GetFileType_());
+    const string total = to_string(file_->Size());
+    string heads;
+    vector<size_t> headLens;
+    size_t length = 0;
+    for(const auto& range: ranges_) {
+        size_t before = heads.size();
+        heads += "\r\n--" + boundary_ + "\r\nContent-type: " + type + "\r\nContent-Range: bytes " +
+                 to_string(range.first) + "-" + to_string(range.first + range.second - 1) + "/" + total + "\r\n\r\n";
+        headLens.push_back(heads.size() - before);
+        length += range.second;
+    }
+    const string closing = "\r\n--" + boundary_ + "--\r\n";
+    length += heads.size() + closing.size();
+    buff.Append("Content-length: " + to_string(length) + "\r\n\r\n");
+    size_t head = buff.ReadableBytes() - headStart_;
+    buff.Append(heads);
+    buff.Append(closing);
+    for(size_t i = 0; i < ranges_.size(); i++) {
+        parts_.push_back({ head + headLens[i], ranges_[i].first, ranges_[i].second });
+        head = 0;
     }
-    mmFile_ = (char*)mmRet;
-    close(srcFd); // 后续通过内存映射的方式访问文件内容，已经不需要这个文件描述符了，及时关闭可以释放相关系统资源
-    buff.Append("Content-length: " + to_string(mmFileStat_.st_size) + "\r\n\r\n");
+    parts_.push_back({ closing.size(), 0, 0 });
 }
 
 void HttpResponse::UnmapFile() {
-    if(mmFile_) {
-        munmap(mmFile_, mmFileStat_.st_size);
-        mmFile_ = nullptr;
+    file_.reset(); // 只释放引用，映射由 FileCache 管理
+    if(bodyFd_ >= 0) {
+        close(bodyFd_);
+        bodyFd_ = -1;
     }
 }
 
-string HttpResponse::GetFileType_() {
+string_view HttpResponse::GetFileType_() const {
     /* 判断文件类型 */
-    string::size_type idx = path_.find_last_of('.');
-    if(idx == string::npos) {
-        return "text/plain";
-    }
-    string suffix = path_.substr(idx);
-    if(SUFFIX_TYPE.count(suffix) == 1) {
-        return SUFFIX_TYPE.find(suffix)->second;
-    }
-    return "text/plain";
+    return MimeType::Lookup(path_).type;
 }
 
 void HttpResponse::ErrorContent(Buffer& buff, string message) 
@@ -166,9 +402,8 @@ void HttpResponse::ErrorContent(Buffer& buff, string message)
     string status;
     body += "<html><title>Error</title>";
     body += "<body bgcolor=\"ffffff\">";
-    if(CODE_STATUS.count(code_) == 1) {
-        status = CODE_STATUS.find(code_)->second;
-    } else {
+    status = Reason_(code_);
+    if(status.empty()) {
         status = "Bad Request";
     }
     body += to_string(code_) + " : " + status  + "\n";
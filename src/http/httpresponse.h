@@ -7,43 +7,103 @@
 #include <sys/stat.h>    // stat
 #include <sys/mman.h>    // mmap, munmap
 #include <string>
+#include <string_view>
+#include <vector>
+#include <atomic>
+#include <time.h>        // strptime, timegm, gmtime_r
 
 
 #include "../buffer/buffer.h"
 #include "../log/log.h"
+#include "filecache.h"
+#include "mimetype.h"
+#include "fileindex.h"
 
 class HttpResponse {
 public:
+    /* 响应的发送顺序：先发 writeBuff_ 中 head 个字节（响应头或 multipart 分段头），再发文件的 [offset, offset + len) */
+    struct BodyPart {
+        size_t head;
+        size_t offset;
+        size_t len;
+    };
+
     HttpResponse();
     ~HttpResponse();
 
-    void Init(const std::string& srcDir, std::string& path, bool isKeepAlive = false, int code = -1);
+    void Init(std::string_view srcDir, std::string& path, bool isKeepAlive = false, int code = -1); // srcDir 为视图：HttpConn 传入 const char*，不构造临时 string
+    void SetRange(std::string_view range, std::string_view ifRange); // GET 请求的 Range / If-Range 头，Init 之后调用
+    void SetAcceptGzip(bool accept) { acceptGzip_ = accept; }       // 客户端接受 gzip 时发送预压缩版本
+    void SetConditional(std::string_view ifNoneMatch, std::string_view ifModifiedSince); // 文件未变化时返回 304
+    void SetContent(FileRef content) { file_ = std::move(content); } // 程序生成的消息体（FileCache::FromMemory），代替按路径查找的文件
+    void SetCookie(std::string cookie) { cookie_ = std::move(cookie); } // 非空时发送 Set-Cookie
     void MakeResponse(Buffer& buff);
+    const std::vector<BodyPart>& Parts() const { return parts_; }
     void UnmapFile();
-    char* File();
+    const char* File(); // 本次发送的消息体：映射的原文件或其 gzip 版本
+    FileRef ReleaseFile(); // 文件引用交给发送队列，响应发完后释放
+    int ReleaseBodyFd();   // 大文件的描述符交给发送队列（sendfile），无则返回 -1
     size_t FileLen() const;
     void ErrorContent(Buffer& buff, std::string message);
     int Code() const { return code_; }
+    bool IsKeepAlive() const { return isKeepAlive_; }
+
+    /* 按 MIME 类型前缀（如 "text/html"、"image/"）配置 Cache-Control，最长前缀优先，空值表示不发送；须在服务器启动前调用 */
+    static void SetCacheControl(const std::string& mimePrefix, const std::string& value);
 
 private:
     void AddStateLine_(Buffer &buff);
     void AddHeader_(Buffer &buff);
     void AddContent_(Buffer &buff);
+    void AddMultipart_(Buffer &buff);
+
+    bool ParseRange_();
+    bool NotModified_() const;
+    bool MatchETag_(std::string_view tag, bool weak) const;
 
     void ErrorHtml_();
-    std::string GetFileType_();
+    std::string_view GetFileType_() const;
+    const std::string& FilePath_();
+
+    static std::string_view Reason_(int code);
+    static std::string_view DateHeader_();
+    static void Append_(Buffer& buff, std::string_view str);
+    static void AppendNumber_(Buffer& buff, size_t value);
 
     int code_;
     bool isKeepAlive_;
 
     std::string path_;
     std::string srcDir_;
+    std::string filePath_; // FilePath_() 的结果，复用容量，避免每个响应分配
     
-    char* mmFile_; 
-    struct stat mmFileStat_;
+    FileRef file_; // 来自 FileCache 的文件（stat 结果 + 映射），不再逐请求 open/mmap/munmap
+    int bodyFd_;   // 未映射的大文件：打开的描述符，由 sendfile 发送
+
+    bool acceptGzip_;
+    bool gzip_;   // 本次响应发送 gzip 版本
+    std::string cookie_;
+
+    std::string range_;
+    std::string ifRange_;
+    std::string ifNoneMatch_;
+    std::string ifModifiedSince_;
+    std::vector<std::pair<size_t, size_t>> ranges_; // 可满足的区间（起点, 长度），多于一个时以 multipart/byteranges 发送
+    std::string boundary_;
+    std::vector<BodyPart> parts_;
+    size_t headStart_; // 本响应在 writeBuff_ 中的起始位置
+
+    static const size_t MAX_RANGES = 16; // 区间过多时忽略 Range，整体返回，避免被用来放大请求
+    static std::atomic<unsigned> boundarySeq_;
+
+    /* 状态码 -> 原因短语与完整状态行，编译期常量 */
+    struct Status {
+        int code;
+        std::string_view reason;
+        std::string_view line;
+    };
+    static const Status STATUS[];
 
-    static const std::unordered_map<std::string, std::string> SUFFIX_TYPE;
-    static const std::unordered_map<int, std::string> CODE_STATUS;
     static const std::unordered_map<int, std::string> CODE_PATH;
 };
 
@@ -0,0 +1,143 @@
+#include "mimetype.h"
+
+using namespace std;
+
+namespace {
+
+typedef MimeType::Info Info;
+
+constexpr Info TYPES[] = {
+    { ".html",  "text/html",                 true },
+    { ".htm",   "text/html",                 true },
+    { ".xml",   "text/xml",                  true },
+    { ".xhtml", "application/xhtml+xml",     true },
+    { ".txt",   "text/plain",                true },
+    { ".rtf",   "application/rtf",           true },
+    { ".pdf",   "application/pdf",           false },
+    { ".word",  "application/nsword",        false },
+    { ".png",   "image/png",                 false },
+    { ".gif",   "image/gif",                 false },
+    { ".jpg",   "image/jpeg",                false },
+    { ".jpeg",  "image/jpeg",                false },
+    { ".au",    "audio/basic",               false },
+    { ".mpeg",  "video/mpeg",                false },
+    { ".mpg",   "video/mpeg",                false },
+    { ".avi",   "video/x-msvideo",           false },
+    { ".gz",    "application/x-gzip",        false },
+    { ".tar",   "application/x-tar",         false },
+    { ".css",   "text/css",                  true },
+    { ".js",    "text/javascript",           true },
+    { ".json",  "application/json",          true },
+    { ".svg",   "image/svg+xml",             true },
+    { ".ico",   "image/x-icon",              true },
+    { ".woff",  "font/woff",                 false },
+    { ".woff2", "font/woff2",                false },
+    { ".ttf",   "font/ttf",                  true },
+    { ".otf",   "font/otf",                  true },
+    { ".eot",   "application/vnd.ms-fontobject", true },
+    { ".mp4",   "video/mp4",                 false },
+    { ".webp",  "image/webp",                false },
+    { ".zip",   "application/zip",           false },
+    { ".wasm",  "application/wasm",          true },
+};
+constexpr Info DEFAULT = { "", "text/plain", false }; // 后缀未知时不确定是否为文本，不压缩
+
+constexpr int COUNT = sizeof(TYPES) / sizeof(TYPES[0]);
+constexpr int SLOTS = 64; // 2 的幂，不小于 COUNT
+constexpr size_t MAX_SUFFIX = 8;
+static_assert(COUNT <= SLOTS, "MimeType: too many types for the table");
+
+constexpr char Lower(char ch) {
+    return ch >= 'A' && ch <= 'Z' ? ch - 'A' + 'a' : ch;
+}
+
+/* FNV-1a，种子参与初值；取中间位作为槽号 */
+constexpr uint32_t Hash(string_view s, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for(char ch: s) {
+        h ^= static_cast<unsigned char>(Lower(ch));
+        h *= 16777619u;
+    }
+    return (h >> 8) & (SLOTS - 1);
+}
+
+constexpr bool Perfect(uint32_t seed) {
+    bool used[SLOTS] = {};
+    for(const Info& info: TYPES) {
+        uint32_t slot = Hash(info.suffix, seed);
+        if(used[slot]) { return false; }
+        used[slot] = true;
+    }
+    return true;
+}
+
+/* 编译期搜索使所有后缀互不冲突的种子，增删类型后自动重新计算 */
+constexpr uint32_t FindSeed() {
+    uint32_t seed = 0;
+    while(!Perfect(seed)) { seed++; }
+    return seed;
+}
+
+struct Table {
+    int8_t slot[SLOTS]; // 槽 -> TYPES 下标，-1 为空
+};
+
+constexpr Table Build(uint32_t seed) {
+    Table table = {};
+    for(int i = 0; i < SLOTS; i++) { table.slot[i] = -1; }
+    for(int i = 0; i < COUNT; i++) {
+        table.slot[Hash(TYPES[i].suffix, seed)] = static_cast<int8_t>(i);
+    }
+    return table;
+}
+
+constexpr uint32_t SEED = FindSeed();
+constexpr Table TABLE = Build(SEED);
+
+} // namespace
+
+/* 未带版本号的资源 URL 不变，缓存时间不宜过长；html 每次都用 ETag 协商（命中时只回 304） */
+unordered_map<string, string> MimeType::CACHE_CONTROL = {
+    { "",           "no-cache" },
+    { "text/css",   "public, max-age=3600" },
+    { "text/javascript", "public, max-age=3600" },
+    { "image/",     "public, max-age=86400" },
+    { "audio/",     "public, max-age=86400" },
+    { "video/",     "public, max-age=86400" },
+    { "font/",      "public, max-age=86400" },
+};
+
+const MimeType::Info& MimeType::Lookup(string_view path) {
+    size_t idx = path.find_last_of("./");
+    if(idx == string_view::npos || path[idx] != '.') {
+        return DEFAULT;
+    }
+    string_view suffix = path.substr(idx);
+    if(suffix.size() > MAX_SUFFIX) {
+        return DEFAULT;
+    }
+    int i = TABLE.slot[Hash(suffix, SEED)];
+    if(i < 0 || TYPES[i].suffix.size() != suffix.size()) {
+        return DEFAULT;
+    }
+    for(size_t j = 0; j < suffix.size(); j++) {
+        if(Lower(suffix[j]) != TYPES[i].suffix[j]) { return DEFAULT; }
+    }
+    return TYPES[i];
+}
+
+void MimeType::SetCacheControl(const string& mimePrefix, const string& value) {
+    CACHE_CONTROL[mimePrefix] = value;
+}
+
+const string& MimeType::CacheControl(string_view type) {
+    auto best = CACHE_CONTROL.end();
+    for(auto it = CACHE_CONTROL.begin(); it != CACHE_CONTROL.end(); ++it) {
+        if(type.compare(0, it->first.size(), it->first) == 0 &&
+                (best == CACHE_CONTROL.end() || it->first.size() > best->first.size())) {
+            best = it;
+        }
+    }
+    static const string none;
+    return best == CACHE_CONTROL.end() ? none : best->second;
+}
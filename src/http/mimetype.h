@@ -0,0 +1,29 @@
+#ifndef MIME_TYPE_H
+#define MIME_TYPE_H
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <stdint.h>
+
+/* 按文件后缀查 MIME 类型：编译期生成的完美哈希表，一次哈希、一次比较，不分配内存
+   同时记录该类型是否值得压缩，以及按类型前缀配置的 Cache-Control */
+class MimeType {
+public:
+    struct Info {
+        std::string_view suffix;
+        std::string_view type;
+        bool compressible;   // 文本类格式；jpg/png/gz/woff2 等本身已压缩
+    };
+
+    static const Info& Lookup(std::string_view path); // 不区分大小写，未知后缀按 text/plain
+
+    /* 最长前缀优先，空值表示不发送；须在服务器启动前设置，已缓存文件的响应头不会随之更新 */
+    static void SetCacheControl(const std::string& mimePrefix, const std::string& value);
+    static const std::string& CacheControl(std::string_view type);
+
+private:
+    static std::unordered_map<std::string, std::string> CACHE_CONTROL;
+};
+
+#endif //MIME_TYPE_H
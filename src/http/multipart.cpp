@@ -0,0 +1,263 @@
+#include "multipart.h"
+
+using namespace std;
+
+MultipartParser::MultipartParser(): state_(IDLE), isFile_(false) {}
+
+bool MultipartParser::Init(string_view contentType, const string& dir, shared_ptr<DiskChannel> disk) {
+    Abort();
+    string_view boundary = Param_(contentType, "boundary");
+    if(boundary.empty() || boundary.size() > 70) { // RFC 2046：1~70 个字符
+        return false;
+    }
+    assert(disk);
+    dir_ = dir;
+    disk_ = std::move(disk);
+    delim_ = "\r\n--";
+    delim_.append(boundary);
+    state_ = PREAMBLE;
+    return true;
+}
+
+void MultipartParser::Abort() {
+    Discard_();
+    disk_.reset();
+    state_ = IDLE;
+    isFile_ = false;
+    name_.clear();
+    filename_.clear();
+    field_.clear();
+    files_.clear();
+    fields_.clear();
+}
+
+/* 丢弃未完成的文件部分：排在它已提交的写入之后关闭并删除临时文件 */
+void MultipartParser::Discard_() {
+    if(!file_) { return; }
+    shared_ptr<TempFile> file = std::move(file_);
+    disk_->Submit([file] {
+        if(file->fd >= 0) {
+            close(file->fd);
+            unlink(file->path.c_str());
+            file->fd = -1;
+        }
+        return 0;
+    });
+}
+
+size_t MultipartParser::Fail_(const char* reason) {
+    LOG_WARN("multipart: %s", reason);
+    Discard_();
+    state_ = FAILED;
+    return 0;
+}
+
+size_t MultipartParser::Feed(const char* data, size_t len, bool last) {
+    size_t pos = 0;
+    while(true) {
+        switch(state_) {
+        case PREAMBLE: {
+            /* 第一个分隔符前没有 CRLF */
+            const char* hit = static_cast<const char*>(memmem(data + pos, len - pos, delim_.data() + 2, delim_.size() - 2));
+            if(!hit) {
+                if(last) { return Fail_("missing boundary"); }
+                size_t keep = min(len - pos, delim_.size() - 3);
+                return len - keep;
+            }
+            pos = hit - data + delim_.size() - 2;
+            state_ = AFTER_DELIM;
+            break;
+        }
+        case AFTER_DELIM:
+            if(len - pos < 2) {
+                if(last) { return Fail_("truncated boundary"); }
+                return pos;
+            }
+            if(data[pos] == '-' && data[pos + 1] == '-') {
+                state_ = EPILOGUE;
+            } else if(data[pos] == '\r' && data[pos + 1] == '\n') {
+                state_ = PART_HEAD;
+            } else {
+                return Fail_("bad boundary");
+            }
+            pos += 2;
+            break;
+        case PART_HEAD: {
+            /* 部分头以空行结束；没有头时直接是空行 */
+            string_view rest(data + pos, len - pos);
+            size_t end = rest.compare(0, 2, "\r\n") == 0 ? 0 : rest.find("\r\n\r\n");
+            if(end == string_view::npos) {
+                if(last || rest.size() > MAX_PART_HEAD) { return Fail_("bad part header"); }
+                return pos;
+            }
+            if(end > MAX_PART_HEAD || !BeginPart_(rest.substr(0, end))) { return Fail_("bad part header"); }
+            pos += end == 0 ? 2 : end + 4;
+            state_ = PART_DATA;
+            break;
+        }
+        case PART_DATA: {
+            const char* hit = static_cast<const char*>(memmem(data + pos, len - pos, delim_.data(), delim_.size()));
+            if(hit) {
+                if(!Data_(data + pos, hit - data - pos) || !EndPart_()) { return 0; }
+                pos = hit - data + delim_.size();
+                state_ = AFTER_DELIM;
+                break;
+            }
+            if(last) { return Fail_("missing closing boundary"); }
+            /* 末尾可能是下一次才完整的分隔符：从第一个能作为分隔符前缀的 '\r' 起保留，其余写出 */
+            size_t keep = 0;
+            for(size_t i = len - min(len - pos, delim_.size() - 1); i < len; i++) {
+                if(data[i] == '\r' && memcmp(data + i, delim_.data(), len - i) == 0) {
+                    keep = len - i;
+                    break;
+                }
+            }
+            if(!Data_(data + pos, len - keep - pos)) { return 0; }
+            return len - keep;
+        }
+        case EPILOGUE:
+            return len;
+        default:
+            return pos;
+        }
+    }
+}
+
+/* 解析部分头中的 Content-Disposition，文件部分打开临时文件 */
+bool MultipartParser::BeginPart_(string_view head) {
+    name_.clear();
+    filename_.clear();
+    field_.clear();
+    isFile_ = false;
+    while(!head.empty()) {
+        size_t eol = head.find("\r\n");
+        string_view line = head.substr(0, eol);
+        head = eol == string_view::npos ? string_view() : head.substr(eol + 2);
+        static const string_view KEY = "Content-Disposition:";
+        if(line.size() < KEY.size() || strncasecmp(line.data(), KEY.data(), KEY.size()) != 0) {
+            continue;
+        }
+        line.remove_prefix(KEY.size());
+        name_ = Param_(line, "name");
+        size_t idx = line.find("filename=");
+        if(idx != string_view::npos && (idx == 0 || line[idx - 1] == ' ' || line[idx - 1] == ';')) {
+            isFile_ = true;
+            filename_ = Param_(line, "filename");
+        }
+    }
+    if(!isFile_) {
+        return true;
+    }
+    /* 只取文件名部分（部分浏览器会带上客户端路径），不允许借文件名跳出上传目录或覆盖临时文件 */
+    size_t slash = filename_.find_last_of("/\\");
+    if(slash != string::npos) {
+        filename_.erase(0, slash + 1);
+    }
+    if(filename_.empty()) {
+        return true; // 未选择文件，丢弃内容
+    }
+    if(!UploadStore::ValidName(filename_)) {
+        LOG_WARN("multipart: rejected filename %s", filename_.c_str());
+        return false;
+    }
+    shared_ptr<TempFile> file = make_shared<TempFile>();
+    file->path = dir_ + TEMP_PREFIX + "XXXXXX";
+    file_ = file;
+    disk_->Submit([file] {
+        file->fd = mkstemp(&file->path[0]);
+        if(file->fd < 0) {
+            int err = errno;
+            LOG_ERROR("multipart: mkstemp %s error: %d", file->path.c_str(), err);
+            file->failed = true;
+            return err;
+        }
+        fchmod(file->fd, 0644); // mkstemp 创建的文件只有属主可读，上传的文件需要能被下载
+        return 0;
+    });
+    return true;
+}
+
+/* 文件数据拷贝一份交给磁盘任务：读缓冲区随即被复用，写入在 I/O 线程中完成 */
+bool MultipartParser::Data_(const char* data, size_t len) {
+    if(isFile_) {
+        if(file_ && len > 0) {
+            disk_->Submit([file = file_, data = string(data, len)] {
+                for(size_t written = 0; !file->failed && written < data.size(); ) {
+                    ssize_t n = write(file->fd, data.data() + written, data.size() - written);
+                    if(n < 0) {
+                        if(errno == EINTR) { continue; }
+                        int err = errno;
+                        LOG_ERROR("multipart: write %s error: %d", file->path.c_str(), err);
+                        file->failed = true;
+                        return err;
+                    }
+                    written += n;
+                }
+                return 0;
+            }, len);
+        }
+        return true;
+    }
+    if(field_.size() + len > MAX_FIELD) {
+        Fail_("field too large");
+        return false;
+    }
+    field_.append(data, len);
+    return true;
+}
+
+/* 部分结束：临时文件落盘后改名为正式文件（同一目录内 rename 是原子的，已存在的同名文件被替换） */
+bool MultipartParser::EndPart_() {
+    if(!isFile_) {
+        fields_[name_] = std::move(field_);
+        field_.clear();
+        return true;
+    }
+    if(!file_) {
+        return true;
+    }
+    disk_->Submit([file = std::move(file_), path = dir_ + filename_] {
+        if(file->fd < 0) {
+            return 0; // 创建失败，已记录错误
+        }
+        int err = 0;
+        if(file->failed || fsync(file->fd) < 0 || rename(file->path.c_str(), path.c_str()) < 0) {
+            err = file->failed ? 0 : errno;
+            if(err) { LOG_ERROR("multipart: save %s error: %d", path.c_str(), err); }
+            unlink(file->path.c_str());
+        }
+        close(file->fd);
+        file->fd = -1;
+        return err;
+    });
+    files_.push_back(filename_);
+    return true;
+}
+
+/* 取 "; key=value" 形式的参数，值可带引号；找不到返回空 */
+string_view MultipartParser::Param_(string_view header, string_view name) {
+    size_t pos = 0;
+    while(pos < header.size()) {
+        /* 逐个参数扫描，引号内的 ';' 不作为分隔 */
+        size_t begin = pos;
+        bool quoted = false;
+        while(pos < header.size() && (quoted || header[pos] != ';')) {
+            if(header[pos] == '"') { quoted = !quoted; }
+            pos++;
+        }
+        string_view item = header.substr(begin, pos - begin);
+        pos++;
+        while(!item.empty() && (item.front() == ' ' || item.front() == '\t')) { item.remove_prefix(1); }
+        size_t eq = item.find('=');
+        if(eq == string_view::npos || eq != name.size() || strncasecmp(item.data(), name.data(), eq) != 0) {
+            continue;
+        }
+        string_view value = item.substr(eq + 1);
+        while(!value.empty() && (value.back() == ' ' || value.back() == '\t')) { value.remove_suffix(1); }
+        if(value.size() >= 2 && value.front() == '"' && value.back() == '"') {
+            value = value.substr(1, value.size() - 2);
+        }
+        return value;
+    }
+    return string_view();
+}
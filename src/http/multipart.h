@@ -0,0 +1,92 @@
+#ifndef MULTIPART_H
+#define MULTIPART_H
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <unordered_map>
+#include <fcntl.h>       // open
+#include <sys/stat.h>    // fchmod
+#include <unistd.h>      // write, close, unlink
+#include <stdlib.h>      // mkstemp
+#include <stdio.h>       // rename
+#include <string.h>      // memmem
+#include <strings.h>     // strncasecmp
+#include <errno.h>
+#include <assert.h>
+
+#include "../log/log.h"
+#include "../pool/diskio.h"
+#include "uploadstore.h"
+
+/* multipart/form-data 流式解析
+   消息体分多次到达，每次把读缓冲区中的数据交给 Feed()，跨读取的分隔符由调用方保留的尾部数据拼接识别；
+   文件部分边到达边写入上传目录下的临时文件，该部分结束后改名为正式文件名，普通字段保存在内存中（有长度上限）。
+   文件的创建、写入、fsync、改名都作为任务交给 DiskChannel，由磁盘 I/O 线程按顺序执行；
+   内存占用只与读缓冲区大小及 DiskChannel 的积压上限有关，与上传文件大小无关 */
+class MultipartParser {
+public:
+    MultipartParser();
+    ~MultipartParser() { Abort(); }
+
+    /* dir 以 '/' 结尾；Content-Type 中没有 boundary 时返回 false。文件操作提交到 disk，出错记录在 disk 上 */
+    bool Init(std::string_view contentType, const std::string& dir, std::shared_ptr<DiskChannel> disk);
+
+    /* 处理 [data, data + len)，返回消费的字节数；未消费的尾部可能是分隔符的前缀，调用方须保留并在下次与新数据一起传入。
+       last 表示消息体到此为止，此时必须全部消费，否则视为出错 */
+    size_t Feed(const char* data, size_t len, bool last);
+
+    void Abort(); // 删除未完成的临时文件（同样作为磁盘任务，排在已提交的写入之后）并复位
+
+    bool Active() const { return state_ != IDLE; }
+    bool Done() const { return state_ == EPILOGUE; }
+    bool Failed() const { return state_ == FAILED; }
+
+    const std::vector<std::string>& Files() const { return files_; } // 已提交保存的文件名（相对上传目录），DiskChannel 空闲后才全部落盘
+    const std::unordered_map<std::string, std::string>& Fields() const { return fields_; }
+
+    static const size_t MAX_PART_HEAD = 8 * 1024;
+    static const size_t MAX_FIELD = 64 * 1024;
+    static constexpr const char* TEMP_PREFIX = ".upload-"; // 上传中的临时文件，隐藏文件不出现在文件列表中
+
+private:
+    enum STATE {
+        IDLE,
+        PREAMBLE,     // 查找第一个分隔符
+        AFTER_DELIM,  // 分隔符之后：CRLF 开始新的部分，"--" 表示结束
+        PART_HEAD,
+        PART_DATA,
+        EPILOGUE,     // 结束分隔符之后，忽略
+        FAILED,
+    };
+
+    bool BeginPart_(std::string_view head);
+    bool Data_(const char* data, size_t len);
+    bool EndPart_();
+    size_t Fail_(const char* reason);
+    void Discard_();
+
+    /* 当前文件部分的临时文件，由磁盘任务共享；前面的任务出错后，后续任务不再操作 */
+    struct TempFile {
+        std::string path;
+        int fd = -1;
+        bool failed = false;
+    };
+
+    static std::string_view Param_(std::string_view header, std::string_view name);
+
+    STATE state_;
+    std::string dir_;
+    std::string delim_;    // "\r\n--" + boundary
+    std::string name_;     // 当前部分的字段名
+    std::string filename_; // 当前文件部分的文件名
+    bool isFile_;          // 带 filename 参数的部分；文件名为空（未选择文件）时丢弃内容
+    std::shared_ptr<TempFile> file_; // 当前文件部分的临时文件，未选择文件时为空
+    std::shared_ptr<DiskChannel> disk_;
+    std::string field_;
+    std::vector<std::string> files_;
+    std::unordered_map<std::string, std::string> fields_;
+};
+
+#endif //MULTIPART_H
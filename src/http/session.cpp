@@ -0,0 +1,74 @@
+#include "session.h"
+
+using namespace std;
+
+const char* const SessionTable::COOKIE = "sid";
+
+SessionTable* SessionTable::Instance() {
+    static SessionTable table;
+    return &table;
+}
+
+SessionTable::Shard& SessionTable::Shard_(const string& token) {
+    return shards_[hash<string>()(token) % SHARDS];
+}
+
+string SessionTable::Create(const string& user, const string& replace) {
+    if(!replace.empty()) {
+        Remove(replace); // 重新登录：客户端的 Cookie 将被新令牌覆盖，旧会话不再有人使用
+    }
+    static const char HEX[] = "0123456789abcdef";
+    unsigned char raw[16];
+    if(getrandom(raw, sizeof(raw), 0) != sizeof(raw)) {
+        LOG_ERROR("SessionTable: getrandom error: %d", errno);
+        return "";
+    }
+    string token(2 * sizeof(raw), '0');
+    for(size_t i = 0; i < sizeof(raw); i++) {
+        token[2 * i] = HEX[raw[i] >> 4];
+        token[2 * i + 1] = HEX[raw[i] & 15];
+    }
+
+    Shard& shard = Shard_(token);
+    auto now = Clock::now();
+    lock_guard<mutex> locker(shard.mtx);
+    /* 队首已过期或分片已满时淘汰，每次新建均摊 O(1) */
+    while(!shard.lru.empty()) {
+        auto it = shard.sessions.find(shard.lru.front());
+        if(it->second.expires > now && shard.sessions.size() < SHARD_CAPACITY) { break; }
+        shard.sessions.erase(it);
+        shard.lru.pop_front();
+    }
+    shard.lru.push_back(token);
+    shard.sessions[token] = Entry{user, now + chrono::seconds(TTL_S), std::prev(shard.lru.end())};
+    return token;
+}
+
+string SessionTable::Find(const string& token) {
+    if(token.empty()) { return ""; }
+    Shard& shard = Shard_(token);
+    auto now = Clock::now();
+    lock_guard<mutex> locker(shard.mtx);
+    auto it = shard.sessions.find(token);
+    if(it == shard.sessions.end()) {
+        return "";
+    }
+    if(it->second.expires <= now) {
+        shard.lru.erase(it->second.lru);
+        shard.sessions.erase(it);
+        return "";
+    }
+    it->second.expires = now + chrono::seconds(TTL_S);
+    shard.lru.splice(shard.lru.end(), shard.lru, it->second.lru); // 移到队尾
+    return it->second.user;
+}
+
+void SessionTable::Remove(const string& token) {
+    Shard& shard = Shard_(token);
+    lock_guard<mutex> locker(shard.mtx);
+    auto it = shard.sessions.find(token);
+    if(it != shard.sessions.end()) {
+        shard.lru.erase(it->second.lru);
+        shard.sessions.erase(it);
+    }
+}
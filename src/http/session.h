@@ -0,0 +1,55 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <unordered_map>
+#include <list>
+#include <string>
+#include <mutex>
+#include <chrono>
+#include <functional>    // std::hash
+#include <sys/random.h>  // getrandom
+#include <errno.h>
+
+#include "../log/log.h"
+
+/* 登录会话表（单例）
+   登录或注册成功后生成随机令牌，以 Cookie 交给客户端；之后的请求带上令牌，查一次哈希表就能认出用户，不再访问数据库。
+   令牌只保存在内存中，服务器重启后需要重新登录。按令牌哈希分片加锁，过期时间随每次使用顺延；
+   各分片按最近使用排成链表，过期与容量淘汰都从队首取，不扫描整个分片 */
+class SessionTable {
+public:
+    static SessionTable* Instance();
+
+    std::string Create(const std::string& user, const std::string& replace = ""); // 返回令牌，失败返回空；replace 为客户端原有的令牌，一并作废
+    std::string Find(const std::string& token);  // 返回用户名，令牌无效或已过期返回空
+    void Remove(const std::string& token);
+
+    static const char* const COOKIE;  // Cookie 名
+    static const int TTL_S = 1800;
+
+private:
+    SessionTable() = default;
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct Entry {
+        std::string user;
+        Clock::time_point expires;
+        std::list<std::string>::iterator lru; // 在 Shard::lru 中的位置
+    };
+
+    struct Shard {
+        std::mutex mtx;
+        std::unordered_map<std::string, Entry> sessions;
+        std::list<std::string> lru; // 令牌按最近使用排列，队首最久未用；TTL 相同，队首也最先过期
+    };
+
+    Shard& Shard_(const std::string& token);
+
+    static const int SHARDS = 16;
+    static const size_t SHARD_CAPACITY = 65536;    // 分片满时淘汰最久未用的会话
+
+    Shard shards_[SHARDS];
+};
+
+#endif //SESSION_H
@@ -0,0 +1,311 @@
+#include "uploadstore.h"
+
+using namespace std;
+
+UploadStore::Session::~Session() {
+    if(!done && !tmp.empty()) { unlink(tmp.c_str()); }
+    EVP_MD_CTX_free(md);
+}
+
+UploadStore* UploadStore::Instance() {
+    static UploadStore store;
+    return &store;
+}
+
+void UploadStore::Init(const string& dir) {
+    assert(!dir.empty() && dir.back() == '/');
+    lock_guard<mutex> locker(mtx_);
+    sessions_.clear();
+    dir_ = dir;
+    store_ = dir + STORE_DIR;
+    if(mkdir(store_.c_str(), 0755) < 0 && errno != EEXIST) {
+        LOG_ERROR("UploadStore: mkdir %s error: %d", store_.c_str(), errno);
+    }
+    /* 会话只保存在内存中，重启后遗留的临时文件无法续传 */
+    if(DIR* pDir = opendir(dir_.c_str())) {
+        while(struct dirent* pEnt = readdir(pDir)) {
+            if(strncmp(pEnt->d_name, TEMP_PREFIX, strlen(TEMP_PREFIX)) == 0) {
+                unlinkat(dirfd(pDir), pEnt->d_name, 0);
+            }
+        }
+        closedir(pDir);
+    }
+    Collect_();
+}
+
+/* 文件名被删除或被覆盖后，内容存储中链接数只剩 1 的对象不再被引用 */
+void UploadStore::Collect_() {
+    DIR* pDir = opendir(store_.c_str());
+    if(!pDir) { return; }
+    int count = 0;
+    while(struct dirent* pEnt = readdir(pDir)) {
+        struct stat st;
+        if(pEnt->d_name[0] != '.' && fstatat(dirfd(pDir), pEnt->d_name, &st, 0) == 0 &&
+                S_ISREG(st.st_mode) && st.st_nlink == 1) {
+            unlinkat(dirfd(pDir), pEnt->d_name, 0);
+            count++;
+        }
+    }
+    closedir(pDir);
+    if(count > 0) {
+        LOG_INFO("UploadStore: removed %d unreferenced objects", count);
+    }
+}
+
+bool UploadStore::ValidName(const string& name) {
+    return !name.empty() && name[0] != '.' && name.size() <= NAME_MAX &&
+           name.find_first_of(string("/\\\0", 3)) == string::npos;
+}
+
+string UploadStore::Hex_(const unsigned char* data, size_t len) {
+    static const char HEX[] = "0123456789abcdef";
+    string hex(len * 2, '0');
+    for(size_t i = 0; i < len; i++) {
+        hex[2 * i] = HEX[data[i] >> 4];
+        hex[2 * i + 1] = HEX[data[i] & 15];
+    }
+    return hex;
+}
+
+string UploadStore::Create(const string& name, uint64_t size) {
+    if(!ValidName(name)) {
+        LOG_WARN("UploadStore: rejected filename %s", name.c_str());
+        return "";
+    }
+    unsigned char raw[16];
+    if(getrandom(raw, sizeof(raw), 0) != sizeof(raw)) {
+        return "";
+    }
+    SessionRef session = make_shared<Session>();
+    session->id = Hex_(raw, sizeof(raw));
+    session->name = name;
+    session->size = size;
+    session->tmp = dir_ + TEMP_PREFIX + session->id;
+    {
+        lock_guard<mutex> locker(mtx_);
+        Sweep_();
+        if(sessions_.size() >= MAX_SESSIONS) {
+            LOG_WARN("UploadStore: too many sessions, rejected %s", name.c_str());
+            return "";
+        }
+    }
+    int fd = open(session->tmp.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
+    if(fd < 0) {
+        LOG_ERROR("UploadStore: open %s error: %d", session->tmp.c_str(), errno);
+        session->tmp.clear();
+        return "";
+    }
+    fchmod(fd, 0644); // 不受 umask 影响，完成后的文件需要能被下载
+    /* 先定下文件长度（稀疏文件），各分块按偏移写入，不要求顺序 */
+    session->md = EVP_MD_CTX_new();
+    bool ok = ftruncate(fd, size) == 0 && session->md && EVP_DigestInit_ex(session->md, EVP_sha256(), nullptr);
+    close(fd);
+    if(!ok) {
+        LOG_ERROR("UploadStore: init %s error: %d", session->tmp.c_str(), errno);
+        return "";
+    }
+    session->touched = time(nullptr);
+    lock_guard<mutex> locker(mtx_);
+    sessions_[session->id] = session;
+    LOG_INFO("UploadStore: session %s for %s (%llu bytes)", session->id.c_str(), name.c_str(),
+             static_cast<unsigned long long>(size));
+    return session->id;
+}
+
+void UploadStore::Sweep_() {
+    time_t now = time(nullptr);
+    for(auto it = sessions_.begin(); it != sessions_.end(); ) {
+        time_t touched;
+        {
+            lock_guard<mutex> locker(it->second->mtx);
+            touched = it->second->touched;
+        }
+        if(now - touched > SESSION_TTL) {
+            LOG_INFO("UploadStore: session %s expired", it->first.c_str());
+            it = sessions_.erase(it); // 正在写入的请求仍持有引用，写完后才删除临时文件
+        } else {
+            ++it;
+        }
+    }
+}
+
+UploadStore::SessionRef UploadStore::Find(const string& id) {
+    lock_guard<mutex> locker(mtx_);
+    auto it = sessions_.find(id);
+    return it == sessions_.end() ? nullptr : it->second;
+}
+
+void UploadStore::Remove(const string& id) {
+    SessionRef session;
+    {
+        lock_guard<mutex> locker(mtx_);
+        auto it = sessions_.find(id);
+        if(it == sessions_.end()) { return; }
+        session = std::move(it->second);
+        sessions_.erase(it);
+    }
+    lock_guard<mutex> locker(session->mtx);
+    session->done = true;
+    unlink(session->tmp.c_str());
+}
+
+void UploadStore::Mark_(map<uint64_t, uint64_t>& received, uint64_t start, uint64_t end) {
+    if(start >= end) { return; }
+    auto it = received.upper_bound(start);
+    if(it != received.begin() && prev(it)->second >= start) {
+        --it;
+        start = it->first;
+        end = max(end, it->second);
+        it = received.erase(it);
+    }
+    while(it != received.end() && it->first <= end) {
+        end = max(end, it->second);
+        it = received.erase(it);
+    }
+    received.emplace(start, end);
+}
+
+/* 同一会话的写入串行：分块一般来自同一个客户端，且写入只是拷贝到页缓存 */
+UploadStore::Status UploadStore::Write(Session& session, uint64_t offset, const char* data, size_t len) {
+    lock_guard<mutex> locker(session.mtx);
+    if(session.done) {
+        return NOT_FOUND;
+    }
+    if(offset > session.size || len > session.size - offset) {
+        return BAD_RANGE;
+    }
+    int fd = open(session.tmp.c_str(), O_WRONLY | O_CLOEXEC);
+    if(fd < 0) {
+        LOG_ERROR("UploadStore: open %s error: %d", session.tmp.c_str(), errno);
+        return IO_ERROR;
+    }
+    for(size_t written = 0; written < len; ) {
+        ssize_t n = pwrite(fd, data + written, len - written, offset + written);
+        if(n < 0) {
+            if(errno == EINTR) { continue; }
+            LOG_ERROR("UploadStore: pwrite %s error: %d", session.tmp.c_str(), errno);
+            close(fd);
+            return IO_ERROR;
+        }
+        written += n;
+    }
+    close(fd);
+    session.touched = time(nullptr);
+    Mark_(session.received, offset, offset + len);
+    /* 重传的数据可能与之前不同：改写了已摘要的前缀时从头重新计算 */
+    if(len > 0 && offset < session.hashed) {
+        EVP_DigestInit_ex(session.md, EVP_sha256(), nullptr);
+        session.hashed = 0;
+    }
+    /* 紧接已摘要前缀的数据直接计入（数据还在内存中） */
+    if(offset <= session.hashed && offset + len > session.hashed) {
+        EVP_DigestUpdate(session.md, data + (session.hashed - offset), offset + len - session.hashed);
+        session.hashed = offset + len;
+    }
+    return OK;
+}
+
+Json::Value UploadStore::Describe(Session& session) {
+    lock_guard<mutex> locker(session.mtx);
+    Json::Value root;
+    root["id"] = session.id;
+    root["name"] = session.name;
+    root["size"] = Json::UInt64(session.size);
+    Json::Value& received = root["received"] = Json::Value(Json::arrayValue);
+    for(const auto& range: session.received) {
+        Json::Value item(Json::arrayValue);
+        item.append(Json::UInt64(range.first));
+        item.append(Json::UInt64(range.second));
+        received.append(item);
+    }
+    return root;
+}
+
+/* 乱序到达的数据未能在写入时计入摘要，从临时文件读出补算 */
+bool UploadStore::CatchUp_(Session& session) {
+    if(session.hashed == session.size) {
+        return true;
+    }
+    int fd = open(session.tmp.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0) {
+        LOG_ERROR("UploadStore: open %s error: %d", session.tmp.c_str(), errno);
+        return false;
+    }
+    vector<char> buf(256 * 1024);
+    while(session.hashed < session.size) {
+        ssize_t n = pread(fd, buf.data(), min<uint64_t>(buf.size(), session.size - session.hashed), session.hashed);
+        if(n <= 0) {
+            if(n < 0 && errno == EINTR) { continue; }
+            LOG_ERROR("UploadStore: pread %s error: %d", session.tmp.c_str(), errno);
+            close(fd);
+            return false;
+        }
+        EVP_DigestUpdate(session.md, buf.data(), n);
+        session.hashed += n;
+    }
+    close(fd);
+    return true;
+}
+
+UploadStore::Status UploadStore::Finalize(const string& id, const string& sha256, Json::Value& result) {
+    SessionRef session = Find(id);
+    if(!session) {
+        return NOT_FOUND;
+    }
+    unique_lock<mutex> locker(session->mtx);
+    if(session->done) {
+        return NOT_FOUND;
+    }
+    const auto& received = session->received;
+    if(session->size > 0 && (received.size() != 1 || received.begin()->first != 0 ||
+                             received.begin()->second != session->size)) {
+        return INCOMPLETE;
+    }
+    unsigned char md[EVP_MAX_MD_SIZE];
+    unsigned int mdLen = 0;
+    if(!CatchUp_(*session) || !EVP_DigestFinal_ex(session->md, md, &mdLen)) {
+        locker.unlock();
+        Remove(id);
+        return IO_ERROR;
+    }
+    const string hash = Hex_(md, mdLen);
+    if(!sha256.empty() && strcasecmp(sha256.c_str(), hash.c_str()) != 0) {
+        LOG_WARN("UploadStore: %s sha256 mismatch", session->name.c_str());
+        locker.unlock();
+        Remove(id);
+        return MISMATCH;
+    }
+
+    Status status = OK;
+    bool dedup = false;
+    {
+        lock_guard<mutex> storeLocker(storeMtx_);
+        const string object = store_ + hash;
+        struct stat st;
+        dedup = stat(object.c_str(), &st) == 0 && static_cast<uint64_t>(st.st_size) == session->size;
+        if(dedup) {
+            unlink(session->tmp.c_str()); // 相同内容已存在，丢弃本次上传的副本
+        } else if(rename(session->tmp.c_str(), object.c_str()) < 0) {
+            LOG_ERROR("UploadStore: rename %s error: %d", object.c_str(), errno);
+            status = IO_ERROR;
+        }
+        /* 先链接到临时名再改名：覆盖同名文件是原子的，下载中的旧文件不受影响。
+           同名文件已指向同一内容时 rename 什么也不做，临时名需要另外删除 */
+        const string link = session->tmp;
+        if(status == OK && (::link(object.c_str(), link.c_str()) < 0 ||
+                            rename(link.c_str(), (dir_ + session->name).c_str()) < 0)) {
+            LOG_ERROR("UploadStore: link %s error: %d", session->name.c_str(), errno);
+            status = IO_ERROR;
+        }
+        unlink(link.c_str());
+    }
+    session->done = true;
+    result["name"] = session->name;
+    result["size"] = Json::UInt64(session->size);
+    result["sha256"] = hash;
+    result["deduplicated"] = dedup;
+    LOG_INFO("UploadStore: %s complete, sha256 %s%s", session->name.c_str(), hash.c_str(), dedup ? " (deduplicated)" : "");
+    locker.unlock();
+    Remove(id);
+    return status;
+}
@@ -0,0 +1,102 @@
+#ifndef UPLOAD_STORE_H
+#define UPLOAD_STORE_H
+
+#include <unordered_map>
+#include <map>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <algorithm>
+#include <fcntl.h>       // open
+#include <unistd.h>      // pwrite, pread, link, unlink, ftruncate
+#include <stdio.h>       // rename
+#include <dirent.h>
+#include <sys/stat.h>    // mkdir, fchmod
+#include <sys/random.h>  // getrandom
+#include <string.h>      // strncmp
+#include <strings.h>     // strcasecmp
+#include <errno.h>
+#include <time.h>
+#include <stdint.h>
+#include <assert.h>
+#include <openssl/evp.h> // SHA-256
+#include <json/json.h>
+
+#include "../log/log.h"
+
+/* 可续传的分块上传（单例）
+   建立会话时创建临时文件，各分块按 Content-Range 给出的偏移 pwrite 写入，连接中断后客户端查询已收到的区间、只补传缺失部分；
+   临时文件只在写入、完成时打开，空闲的会话不占用描述符。
+   SHA-256 随按序到达的数据增量计算，乱序到达的部分在完成时从临时文件补算；重传改写了已摘要的前缀时摘要作废，完成时从头补算。
+   完成的文件按内容存放在上传目录的 .store/<sha256>，文件名是指向它的硬链接，重复上传相同内容只保留一份 */
+class UploadStore {
+public:
+    enum Status {
+        OK,
+        NOT_FOUND,   // 会话不存在或已结束
+        BAD_RANGE,   // 分块超出文件大小
+        INCOMPLETE,  // 还有区间未收到
+        MISMATCH,    // 与客户端给出的 SHA-256 不符，会话作废
+        IO_ERROR,
+    };
+
+    struct Session {
+        Session(): size(0), hashed(0), md(nullptr), touched(0), done(false) {}
+        ~Session();
+
+        std::string id;
+        std::string name;     // 完成后在上传目录中的文件名
+        std::string tmp;      // 临时文件路径
+        uint64_t size;
+
+        std::mutex mtx;
+        std::map<uint64_t, uint64_t> received; // 已写入的区间：起点 -> 终点（不含），相邻或重叠的区间合并
+        uint64_t hashed;      // 已计入摘要的前缀长度
+        EVP_MD_CTX* md;
+        time_t touched;
+        bool done;            // 已完成或作废，临时文件不再属于会话
+    };
+    typedef std::shared_ptr<Session> SessionRef;
+
+    static UploadStore* Instance();
+
+    void Init(const std::string& dir); // dir 以 '/' 结尾；清理上次运行遗留的临时文件与不再被任何文件名引用的内容
+
+    std::string Create(const std::string& name, uint64_t size); // 返回会话 id，失败（含会话数已达上限）返回空
+    SessionRef Find(const std::string& id);
+    void Remove(const std::string& id);
+
+    static Status Write(Session& session, uint64_t offset, const char* data, size_t len);
+    static Json::Value Describe(Session& session); // 会话状态，received 为 [起点, 终点) 数组，客户端据此续传
+
+    /* 所有区间收到后校验摘要（sha256 为空则不校验），存入内容存储并链接到文件名，结束会话 */
+    Status Finalize(const std::string& id, const std::string& sha256, Json::Value& result);
+
+    static bool ValidName(const std::string& name); // 上传目录中的文件名：不含路径分隔符，'.' 开头的名字留给临时文件与内容存储
+
+    static constexpr const char* PREFIX = "/upload/chunked";
+
+private:
+    UploadStore() = default;
+    ~UploadStore() = default;
+
+    static void Mark_(std::map<uint64_t, uint64_t>& received, uint64_t start, uint64_t end);
+    static bool CatchUp_(Session& session);
+    static std::string Hex_(const unsigned char* data, size_t len);
+    void Sweep_();
+    void Collect_();
+
+    static constexpr const char* TEMP_PREFIX = ".chunk-";
+    static constexpr const char* STORE_DIR = ".store/";
+    static const time_t SESSION_TTL = 30 * 60; // 超过 30 分钟没有新分块的会话丢弃
+    static const size_t MAX_SESSIONS = 256;    // 同时进行的会话上限，每个会话占一个与文件等长的临时文件
+
+    std::string dir_;
+    std::string store_;
+    std::mutex mtx_;
+    std::mutex storeMtx_; // 同一内容的并发完成串行化，保证只存一份
+    std::unordered_map<std::string, SessionRef> sessions_;
+};
+
+#endif //UPLOAD_STORE_H
@@ -16,7 +16,14 @@ int main() {
     WebServer server(
         1316, 3, 60000, false,             /* 端口 ET模式 timeoutMs 优雅退出  */
         3306, "root", "qq105311", "testdb", /* Mysql配置 */
-        12, 6, true, 1, 1024);             /* 连接池数量 线程池数量 日志开关 日志等级 日志异步队列容量 */
+        12, 6, true, 1, 1024,              /* 连接池数量 线程池数量 日志开关 日志等级 日志异步队列容量 */
+        0, 1024, false, false,             /* 子Reactor数量（0：单Reactor+线程池，>0：主从Reactor，线程池不再启用） 监听队列长度
+                                              每个子Reactor独立SO_REUSEPORT监听 按CPU分流（BPF） */
+        false, 64, 1024,                   /* io_uring 后端（内核不支持时回退到 epoll） 静态文件缓存容量MB（0：不缓存）
+                                              不小于该大小（KB）的文件用 sendfile 发送，不做内存映射 */
+        1024, 2,                           /* 请求消息体上限MB（上传文件，0：不限制），超出回 413 磁盘I/O线程数（0：上传文件在工作线程中直接写入） */
+        4,                                 /* 连接池启动时建立的连接数（不够用时增加到连接池数量，空闲时收回） */
+        nullptr);                          /* 本地用户存储文件（nullptr：使用上面的 MySQL；设置后不连接数据库，如 "./users.db"） */
     server.Start();
 } 
   
\ No newline at end of file
@@ -0,0 +1,157 @@
+#include "diskio.h"
+
+using namespace std;
+
+void DiskChannel::Submit(function<int()> job, size_t bytes) {
+    if(!DiskIO::Instance()->Enabled()) {
+        int err = job();
+        lock_guard<mutex> locker(mtx_);
+        if(err && !err_) { err_ = err; }
+        return;
+    }
+    bool schedule = false;
+    {
+        lock_guard<mutex> locker(mtx_);
+        jobs_.push_back({ std::move(job), bytes });
+        pending_++;
+        bytes_ += bytes;
+        schedule = !running_;
+        running_ = true;
+    }
+    if(schedule) {
+        DiskIO::Instance()->Schedule(shared_from_this());
+    }
+}
+
+void DiskChannel::Begin() {
+    lock_guard<mutex> locker(mtx_);
+    pending_++;
+}
+
+void DiskChannel::End(int err) {
+    Done_(0, err);
+}
+
+bool DiskChannel::Busy() const {
+    lock_guard<mutex> locker(mtx_);
+    return bytes_ > HIGH_WATER;
+}
+
+bool DiskChannel::Idle() const {
+    lock_guard<mutex> locker(mtx_);
+    return pending_ == 0;
+}
+
+bool DiskChannel::Wait(bool drain) {
+    lock_guard<mutex> locker(mtx_);
+    drain_ = drain;
+    waiting_ = !Ready_();
+    return waiting_;
+}
+
+int DiskChannel::TakeError() {
+    lock_guard<mutex> locker(mtx_);
+    int err = err_;
+    err_ = 0;
+    return err;
+}
+
+void DiskChannel::Run_() {
+    for(int i = 0; i < MAX_BATCH; i++) {
+        Job job;
+        {
+            lock_guard<mutex> locker(mtx_);
+            if(jobs_.empty()) {
+                running_ = false;
+                return;
+            }
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+        int err = job.run();
+        job.run = nullptr; // 任务持有的数据在计入完成之前释放
+        Done_(job.bytes, err);
+    }
+    DiskIO::Instance()->Schedule(shared_from_this()); // 还有任务：排到队尾，其他连接的任务先执行
+}
+
+void DiskChannel::Done_(size_t bytes, int err) {
+    function<void()> resume;
+    {
+        lock_guard<mutex> locker(mtx_);
+        assert(pending_ > 0);
+        pending_--;
+        bytes_ -= bytes;
+        if(err && !err_) { err_ = err; }
+        if(waiting_ && Ready_()) {
+            waiting_ = false;
+            resume = resume_;
+        }
+    }
+    if(resume) {
+        resume(); // 投递到连接所在的事件循环，不在 I/O 线程中处理请求
+    }
+}
+
+DiskIO* DiskIO::Instance() {
+    static DiskIO diskIO;
+    return &diskIO;
+}
+
+void DiskIO::Init(int threadNum) {
+    Close();
+    lock_guard<mutex> locker(mtx_);
+    isClosed_ = false;
+    for(int i = 0; i < threadNum; i++) {
+        threads_.emplace_back(&DiskIO::Worker_, this);
+    }
+    enabled_ = threadNum > 0;
+}
+
+void DiskIO::Schedule(shared_ptr<DiskChannel> channel) {
+    {
+        lock_guard<mutex> locker(mtx_);
+        if(!threads_.empty()) {
+            queue_.push_back(std::move(channel));
+            cond_.notify_one();
+            return;
+        }
+    }
+    channel->Run_(); // 已关闭：在提交线程中直接执行
+}
+
+void DiskIO::Close() {
+    vector<thread> threads;
+    {
+        lock_guard<mutex> locker(mtx_);
+        isClosed_ = true;
+        threads.swap(threads_);
+    }
+    cond_.notify_all();
+    for(auto& t: threads) {
+        t.join();
+    }
+    enabled_ = false;
+    deque<shared_ptr<DiskChannel>> rest;
+    {
+        lock_guard<mutex> locker(mtx_);
+        rest.swap(queue_);
+    }
+    for(auto& channel: rest) {
+        channel->Run_();
+    }
+}
+
+void DiskIO::Worker_() {
+    while(true) {
+        shared_ptr<DiskChannel> channel;
+        {
+            unique_lock<mutex> locker(mtx_);
+            cond_.wait(locker, [this] { return isClosed_ || !queue_.empty(); });
+            if(queue_.empty()) { break; } // 已关闭且没有待执行的任务
+            channel = std::move(queue_.front());
+            queue_.pop_front();
+        }
+        channel->Run_();
+    }
+}
@@ -0,0 +1,93 @@
+#ifndef DISKIO_H
+#define DISKIO_H
+
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <deque>
+#include <vector>
+#include <assert.h>
+
+#include "../log/log.h"
+
+/* 一个连接的磁盘任务队列：任务按提交顺序执行，同一时刻最多一个 I/O 线程在执行，任务之间不需要再加锁。
+   尚未写出的数据超过 HIGH_WATER 时连接应暂停读取（Busy），降到 LOW_WATER 以下（或全部完成）时回调 resume，
+   由连接所在的事件循环继续处理；慢盘只拖慢这个连接的上传，不占用工作线程 */
+class DiskChannel: public std::enable_shared_from_this<DiskChannel> {
+public:
+    explicit DiskChannel(std::function<void()> resume): resume_(std::move(resume)) {}
+
+    void Submit(std::function<int()> job, size_t bytes = 0); // job 成功返回 0，失败返回 errno；bytes 为任务持有的数据量
+
+    /* 不经过 I/O 线程的异步操作（数据库查询）同样计入未完成任务：发起前 Begin()，完成时 End()（可在任意线程） */
+    void Begin();
+    void End(int err = 0);
+
+    bool Busy() const;  // 积压超过上限
+    bool Idle() const;  // 没有未完成的任务
+
+    /* drain 为 true 时等待全部完成，否则等待积压降到下限；条件已满足返回 false，否则登记并在满足时调用一次 resume */
+    bool Wait(bool drain);
+
+    int TakeError(); // 第一个失败任务的 errno（0 表示没有），取出后清零
+
+    static const size_t HIGH_WATER = 1024 * 1024;
+    static const size_t LOW_WATER = 256 * 1024;
+
+private:
+    friend class DiskIO;
+
+    struct Job {
+        std::function<int()> run;
+        size_t bytes;
+    };
+
+    void Run_(); // 由 I/O 线程调用
+    void Done_(size_t bytes, int err);
+    bool Ready_() const { return drain_ ? pending_ == 0 : bytes_ <= LOW_WATER; }
+
+    static const int MAX_BATCH = 16; // 一次连续执行的任务数，之后让出线程给其他连接
+
+    mutable std::mutex mtx_;
+    std::deque<Job> jobs_;
+    size_t pending_ = 0;  // 排队中与执行中的任务数
+    size_t bytes_ = 0;
+    bool running_ = false; // 已交给 I/O 线程
+    bool waiting_ = false;
+    bool drain_ = false;
+    int err_ = 0;
+    std::function<void()> resume_;
+};
+
+/* 磁盘 I/O 线程（单例）
+   上传文件的创建、写入、fsync、改名等阻塞操作由这里的线程执行，工作线程与子 Reactor 只负责把数据交给 DiskChannel。
+   线程数为 0 时不启用，任务在提交时直接执行 */
+class DiskIO {
+public:
+    static DiskIO* Instance();
+
+    void Init(int threadNum);
+    bool Enabled() const { return enabled_; }
+
+    void Schedule(std::shared_ptr<DiskChannel> channel);
+
+    void Close(); // 执行完已提交的任务后退出，此后提交的任务直接执行
+
+private:
+    DiskIO(): enabled_(false), isClosed_(false) {}
+    ~DiskIO() { Close(); }
+
+    void Worker_();
+
+    std::atomic<bool> enabled_;
+    bool isClosed_;
+    std::mutex mtx_;
+    std::condition_variable cond_;
+    std::deque<std::shared_ptr<DiskChannel>> queue_; // 有任务待执行的连接
+    std::vector<std::thread> threads_;
+};
+
+#endif //DISKIO_H
@@ -0,0 +1,213 @@
+#include "localuserstore.h"
+
+using namespace std;
+
+LocalUserStore* LocalUserStore::Instance() {
+    static LocalUserStore store;
+    return &store;
+}
+
+bool LocalUserStore::Init(const string& path) {
+    Close();
+    path_ = path;
+    fd_ = open(path_.c_str(), O_RDWR | O_CREAT | O_APPEND | O_CLOEXEC, 0600);
+    if(fd_ < 0) {
+        LOG_ERROR("LocalUserStore: open %s error: %d", path_.c_str(), errno);
+        return false;
+    }
+    if(!Load_()) {
+        close(fd_);
+        fd_ = -1;
+        return false;
+    }
+    isClose_ = false;
+    writer_ = thread(&LocalUserStore::Writer_, this);
+    LOG_INFO("LocalUserStore: %s, %d users", path_.c_str(), (int)users_.size());
+    return true;
+}
+
+void LocalUserStore::Close() {
+    {
+        lock_guard<mutex> locker(queueMtx_);
+        if(isClose_) { return; }
+        isClose_ = true;
+    }
+    cond_.notify_all();
+    writer_.join(); // 已提交的注册写完再退出
+    close(fd_);
+    fd_ = -1;
+    unique_lock<shared_mutex> locker(mtx_);
+    users_.clear();
+}
+
+void LocalUserStore::Digest_(const unsigned char* salt, const string& pwd, unsigned char* digest) {
+    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+    unsigned int len = 0;
+    EVP_DigestInit_ex(ctx, EVP_sha256(), nullptr);
+    EVP_DigestUpdate(ctx, salt, SALT_LEN);
+    EVP_DigestUpdate(ctx, pwd.data(), pwd.size());
+    EVP_DigestFinal_ex(ctx, digest, &len);
+    EVP_MD_CTX_free(ctx);
+    assert(len == DIGEST_LEN);
+}
+
+/* 记录：CRC32 | 用户名长度 | 用户名 | 盐 | 摘要，整数按本机字节序 */
+void LocalUserStore::Encode_(const string& name, const User& user, string& out) {
+    size_t start = out.size();
+    uint16_t nameLen = static_cast<uint16_t>(name.size());
+    out.resize(start + 4);
+    out.append(reinterpret_cast<const char*>(&nameLen), sizeof(nameLen));
+    out.append(name);
+    out.append(reinterpret_cast<const char*>(user.salt), SALT_LEN);
+    out.append(reinterpret_cast<const char*>(user.digest), DIGEST_LEN);
+    uint32_t crc = crc32(0L, reinterpret_cast<const Bytef*>(out.data() + start + 4), out.size() - start - 4);
+    memcpy(&out[start], &crc, sizeof(crc));
+}
+
+/* 重放日志；只有最后一条记录不完整或校验失败（写入时断电）才截掉，之后的写入从这里接着追加。
+   损坏的记录后面还有数据说明文件本身坏了，截掉会丢失后面的用户，拒绝启动 */
+bool LocalUserStore::Load_() {
+    struct stat st;
+    if(fstat(fd_, &st) < 0) {
+        LOG_ERROR("LocalUserStore: stat %s error: %d", path_.c_str(), errno);
+        return false;
+    }
+    string data(st.st_size, '\0');
+    size_t got = 0;
+    while(got < data.size()) {
+        ssize_t n = pread(fd_, &data[got], data.size() - got, got);
+        if(n < 0 && errno == EINTR) { continue; }
+        if(n <= 0) {
+            LOG_ERROR("LocalUserStore: read %s error: %d", path_.c_str(), errno);
+            return false;
+        }
+        got += n;
+    }
+    unique_lock<shared_mutex> locker(mtx_);
+    users_.clear();
+    size_t pos = 0;
+    while(pos + HEAD_LEN <= data.size()) {
+        uint32_t crc;
+        uint16_t nameLen;
+        memcpy(&crc, &data[pos], sizeof(crc));
+        memcpy(&nameLen, &data[pos + 4], sizeof(nameLen));
+        size_t len = HEAD_LEN + nameLen + SALT_LEN + DIGEST_LEN;
+        bool broken = pos + len > data.size() ||
+                      crc != crc32(0L, reinterpret_cast<const Bytef*>(&data[pos + 4]), len - 4);
+        /* 断电只会留下记录的前一部分，写出的头部不会出错：用户名长度不合法，或损坏的记录后面还有数据，都是文件本身坏了 */
+        if(nameLen > MAX_NAME || (broken && pos + len < data.size())) {
+            LOG_ERROR("LocalUserStore: broken record at offset %lld of %s is not the last one",
+                      (long long)pos, path_.c_str());
+            users_.clear();
+            return false;
+        }
+        if(broken) { break; }
+        User& user = users_[data.substr(pos + HEAD_LEN, nameLen)];
+        memcpy(user.salt, &data[pos + HEAD_LEN + nameLen], SALT_LEN);
+        memcpy(user.digest, &data[pos + HEAD_LEN + nameLen + SALT_LEN], DIGEST_LEN);
+        pos += len;
+    }
+    if(pos < data.size()) {
+        LOG_WARN("LocalUserStore: drop %d broken bytes at offset %lld of %s", (int)(data.size() - pos), (long long)pos, path_.c_str());
+        if(ftruncate(fd_, pos) < 0) {
+            LOG_ERROR("LocalUserStore: truncate %s error: %d", path_.c_str(), errno);
+            return false;
+        }
+    }
+    size_ = pos;
+    return true;
+}
+
+void LocalUserStore::Verify(const string& name, const string& pwd, bool isLogin, function<void(bool)> done) {
+    LOG_INFO("Verify name:%s", name.c_str());
+    if(isLogin) {
+        User user;
+        {
+            shared_lock<shared_mutex> locker(mtx_);
+            auto it = users_.find(name);
+            if(it == users_.end()) {
+                locker.unlock();
+                done(false);
+                return;
+            }
+            user = it->second;
+        }
+        unsigned char digest[DIGEST_LEN];
+        Digest_(user.salt, pwd, digest);
+        bool match = CRYPTO_memcmp(digest, user.digest, DIGEST_LEN) == 0;
+        if(!match) { LOG_DEBUG("password error!"); }
+        done(match);
+        return;
+    }
+
+    Pending reg;
+    reg.name = name;
+    if(name.size() > MAX_NAME || getrandom(reg.user.salt, SALT_LEN, 0) != static_cast<ssize_t>(SALT_LEN)) {
+        done(false);
+        return;
+    }
+    Digest_(reg.user.salt, pwd, reg.user.digest);
+    {
+        lock_guard<mutex> locker(queueMtx_);
+        bool used = pending_.count(name) > 0;
+        if(!used) {
+            shared_lock<shared_mutex> usersLocker(mtx_);
+            used = users_.count(name) > 0;
+        }
+        if(!isClose_ && !used) {
+            pending_.insert(name);
+            reg.done = std::move(done);
+            queue_.push_back(std::move(reg));
+            cond_.notify_one();
+            return;
+        }
+        if(used) { LOG_DEBUG("user used!"); }
+    }
+    done(false);
+}
+
+/* 取出排队的注册一次写入并 fdatasync，落盘后加入哈希表再回调；写入失败时截回原长度，这一批全部失败 */
+void LocalUserStore::Writer_() {
+    while(true) {
+        vector<Pending> batch;
+        {
+            unique_lock<mutex> locker(queueMtx_);
+            cond_.wait(locker, [this] { return isClose_ || !queue_.empty(); });
+            if(queue_.empty()) { break; }
+            batch.swap(queue_);
+        }
+        string data;
+        for(const Pending& reg: batch) {
+            Encode_(reg.name, reg.user, data);
+        }
+        size_t written = 0;
+        while(written < data.size()) {
+            ssize_t n = write(fd_, data.data() + written, data.size() - written);
+            if(n < 0 && errno == EINTR) { continue; }
+            if(n <= 0) { break; }
+            written += n;
+        }
+        bool ok = written == data.size() && fdatasync(fd_) == 0;
+        if(ok) {
+            size_ += data.size();
+            unique_lock<shared_mutex> locker(mtx_);
+            for(const Pending& reg: batch) {
+                users_[reg.name] = reg.user;
+            }
+        } else {
+            LOG_ERROR("LocalUserStore: write %s error: %d", path_.c_str(), errno);
+            if(ftruncate(fd_, size_) < 0) {
+                LOG_ERROR("LocalUserStore: truncate %s error: %d", path_.c_str(), errno);
+            }
+        }
+        {
+            lock_guard<mutex> locker(queueMtx_);
+            for(const Pending& reg: batch) {
+                pending_.erase(reg.name);
+            }
+        }
+        for(Pending& reg: batch) {
+            reg.done(ok);
+        }
+    }
+}
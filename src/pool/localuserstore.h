@@ -0,0 +1,82 @@
+#ifndef LOCALUSERSTORE_H
+#define LOCALUSERSTORE_H
+
+#include <unordered_map>
+#include <unordered_set>
+#include <string>
+#include <vector>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <functional>
+#include <fcntl.h>       // open
+#include <unistd.h>      // write, pread, fdatasync, ftruncate
+#include <sys/stat.h>    // fstat
+#include <sys/random.h>  // getrandom
+#include <string.h>      // memcpy
+#include <errno.h>
+#include <stdint.h>
+#include <zlib.h>        // crc32
+#include <openssl/evp.h>    // SHA-256
+#include <openssl/crypto.h> // CRYPTO_memcmp
+
+#include "userstore.h"
+#include "../log/log.h"
+
+/* 本地用户存储（单例），用户存储的嵌入式后端，不需要 MySQL
+   用户记录保存在只追加的日志文件中，启动时重放到内存哈希表，登录只查内存，在调用线程中直接完成；
+   注册交给写入线程，一段时间内的注册合并成一次 write + fdatasync，落盘后才加入哈希表并回调。
+   文件中只有加盐的 SHA-256，不保存明文密码。每条记录带 CRC32，断电留下的半条记录在启动时截掉，
+   文件中间的记录损坏则拒绝启动 */
+class LocalUserStore: public UserStore {
+public:
+    static LocalUserStore* Instance();
+
+    bool Init(const std::string& path);
+    void Close() override;
+    const char* Name() const override { return "local"; }
+
+    void Verify(const std::string& name, const std::string& pwd, bool isLogin, std::function<void(bool)> done) override;
+
+private:
+    LocalUserStore(): fd_(-1), size_(0), isClose_(true) {}
+    ~LocalUserStore() override { Close(); }
+
+    static const size_t SALT_LEN = 16;
+    static const size_t DIGEST_LEN = 32;
+    static const size_t MAX_NAME = 255;
+    static const size_t HEAD_LEN = 6;   // CRC32（覆盖其后的全部字段） + 用户名长度（2 字节）
+
+    struct User {
+        unsigned char salt[SALT_LEN];
+        unsigned char digest[DIGEST_LEN]; // SHA-256(salt + 密码)
+    };
+
+    struct Pending {
+        std::string name;
+        User user;
+        std::function<void(bool)> done;
+    };
+
+    bool Load_();
+    void Writer_();
+    static void Digest_(const unsigned char* salt, const std::string& pwd, unsigned char* digest);
+    static void Encode_(const std::string& name, const User& user, std::string& out);
+
+    std::string path_;
+    int fd_;
+    off_t size_;        // 文件中完整记录的长度，只由写入线程修改
+
+    std::shared_mutex mtx_;
+    std::unordered_map<std::string, User> users_; // 已落盘的用户
+
+    std::mutex queueMtx_;
+    std::condition_variable cond_;
+    std::vector<Pending> queue_;                  // 等待写入的注册
+    std::unordered_set<std::string> pending_;     // 等待写入与正在写入的用户名
+    bool isClose_;
+    std::thread writer_;
+};
+
+#endif //LOCALUSERSTORE_H
@@ -0,0 +1,570 @@
+#include "sqlasync.h"
+
+using namespace std;
+
+namespace {
+
+const unsigned int DUP_ENTRY = 1062; // ER_DUP_ENTRY：唯一键重复
+
+#ifdef SQL_NONBLOCK
+static_assert(MYSQL_WAIT_READ == 1 && MYSQL_WAIT_WRITE == 2 && MYSQL_WAIT_EXCEPT == 4 && MYSQL_WAIT_TIMEOUT == 8,
+              "SqlAsync: unexpected MYSQL_WAIT_* values");
+
+/* mysql_stmt_xxx_start 发起、mysql_stmt_xxx_cont 在事件就绪后继续；返回需要等待的事件，0 表示已完成 */
+int PrepareStep(int* ret, MYSQL_STMT* stmt, const char* text, bool started, int ready) {
+    return started ? mysql_stmt_prepare_cont(ret, stmt, ready) : mysql_stmt_prepare_start(ret, stmt, text, strlen(text));
+}
+
+int ExecuteStep(int* ret, MYSQL_STMT* stmt, bool started, int ready) {
+    return started ? mysql_stmt_execute_cont(ret, stmt, ready) : mysql_stmt_execute_start(ret, stmt);
+}
+
+int StoreStep(int* ret, MYSQL_STMT* stmt, bool started, int ready) {
+    return started ? mysql_stmt_store_result_cont(ret, stmt, ready) : mysql_stmt_store_result_start(ret, stmt);
+}
+
+int Socket(MYSQL* sql) {
+    return mysql_get_socket(sql);
+}
+
+unsigned int TimeoutMs(MYSQL* sql) {
+    return mysql_get_timeout_value_ms(sql);
+}
+#else
+/* 没有非阻塞 API：阻塞执行，总是立即完成 */
+int PrepareStep(int* ret, MYSQL_STMT* stmt, const char* text, bool, int) {
+    *ret = mysql_stmt_prepare(stmt, text, strlen(text));
+    return 0;
+}
+
+int ExecuteStep(int* ret, MYSQL_STMT* stmt, bool, int) {
+    *ret = mysql_stmt_execute(stmt);
+    return 0;
+}
+
+int StoreStep(int* ret, MYSQL_STMT* stmt, bool, int) {
+    *ret = mysql_stmt_store_result(stmt);
+    return 0;
+}
+
+int Socket(MYSQL*) {
+    return -1;
+}
+
+unsigned int TimeoutMs(MYSQL*) {
+    return 0;
+}
+#endif
+
+} // namespace
+
+SqlAsync* SqlAsync::Instance() {
+    static SqlAsync sqlAsync;
+    return &sqlAsync;
+}
+
+void SqlAsync::Init(SqlConnPool* pool, int workers) {
+    assert(pool && workers > 0);
+    Close();
+    pool_ = pool;
+    epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+    wakeupFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    assert(epollFd_ >= 0 && wakeupFd_ >= 0);
+    struct epoll_event ev = {};
+    ev.events = EPOLLIN;
+    ev.data.fd = wakeupFd_;
+    epoll_ctl(epollFd_, EPOLL_CTL_ADD, wakeupFd_, &ev);
+    isClose_ = false;
+    thread_ = thread(&SqlAsync::Loop_, this);
+#ifndef SQL_NONBLOCK
+    for(int i = 0; i < workers; i++) {
+        workers_.emplace_back(&SqlAsync::Worker_, this);
+    }
+#else
+    (void)workers;
+#endif
+}
+
+void SqlAsync::Close() {
+    if(thread_.joinable()) {
+        {
+            lock_guard<mutex> locker(mtx_);
+            isClose_ = true;
+        }
+        blockingCond_.notify_all();
+        Wakeup_();
+        thread_.join();
+    }
+    for(thread& worker: workers_) { worker.join(); } // 正在执行的查询执行完
+    workers_.clear();
+    /* 线程已退出，剩下的查询不再执行；还在连接池排队的，之后的回调直接归还连接 */
+    vector<TaskPtr> rest;
+    vector<TaskPtr> finished;
+    vector<pair<uint64_t, MYSQL*>> acquired;
+    {
+        lock_guard<mutex> locker(mtx_);
+        rest.swap(incoming_);
+        finished.swap(finished_);
+        acquired.swap(acquired_);
+        for(auto& task: blocking_) { rest.push_back(std::move(task)); }
+        blocking_.clear();
+        if(epollFd_ >= 0) { close(epollFd_); }
+        if(wakeupFd_ >= 0) { close(wakeupFd_); }
+        epollFd_ = wakeupFd_ = -1;
+    }
+    for(auto& item: acquired) {
+        auto it = waiting_.find(item.first);
+        if(it != waiting_.end()) { it->second->sql = item.second; }
+    }
+    for(auto& item: waiting_) { rest.push_back(std::move(item.second)); }
+    if(batch_) { rest.push_back(std::move(batch_)); }
+    for(auto& item: active_) {
+        item.second->broken = true; // 查询进行到一半，连接的状态不确定
+        item.second->watched = false; // epoll 已关闭
+        rest.push_back(std::move(item.second));
+    }
+    waiting_.clear();
+    active_.clear();
+    for(auto& task: rest) {
+        task->ok = false;
+        Finish_(std::move(task));
+    }
+    for(auto& task: finished) {
+        Finish_(std::move(task)); // 已执行完，照常回调结果
+    }
+}
+
+void SqlAsync::Verify(const string& name, const string& pwd, bool isLogin, function<void(bool)> done) {
+    LOG_INFO("Verify name:%s", name.c_str());
+    /* 缓存命中：登录直接得出结果；注册时用户名已存在直接失败，不存在仍要插入数据库 */
+    UserCache::Result cached = UserCache::Instance()->Check(name, pwd);
+    if(cached == UserCache::MATCH || cached == UserCache::MISMATCH || (isLogin && cached == UserCache::NO_USER)) {
+        LOG_DEBUG("UserVerify cache hit");
+        done(isLogin && cached == UserCache::MATCH);
+        return;
+    }
+    TaskPtr task(new Task());
+    task->isLogin = isLogin;
+    task->accounts.emplace_back();
+    task->accounts[0].name = name;
+    task->accounts[0].pwd = pwd;
+    task->accounts[0].done = std::move(done);
+    {
+        lock_guard<mutex> locker(mtx_);
+        if(!isClose_) {
+            incoming_.push_back(std::move(task));
+            Wakeup_();
+            return;
+        }
+    }
+    task->accounts[0].done(false);
+}
+
+void SqlAsync::Wakeup_() {
+    uint64_t one = 1;
+    ssize_t n = ::write(wakeupFd_, &one, sizeof(one));
+    (void)n;
+}
+
+/* 取出新提交的查询、已取得连接的查询与查询线程执行完的查询，直到都为空（取连接的回调可能立即执行） */
+void SqlAsync::Drain_() {
+    while(true) {
+        vector<TaskPtr> tasks;
+        vector<TaskPtr> finished;
+        vector<pair<uint64_t, MYSQL*>> acquired;
+        {
+            lock_guard<mutex> locker(mtx_);
+            tasks.swap(incoming_);
+            finished.swap(finished_);
+            acquired.swap(acquired_);
+        }
+        if(tasks.empty() && finished.empty() && acquired.empty()) { break; }
+        for(auto& task: finished) {
+            Finish_(std::move(task));
+        }
+        for(auto& task: tasks) {
+            if(task->isLogin) {
+                Acquire_(std::move(task));
+            } else {
+                Batch_(std::move(task));
+            }
+        }
+        for(auto& item: acquired) {
+            auto it = waiting_.find(item.first);
+            assert(it != waiting_.end());
+            TaskPtr task = std::move(it->second);
+            waiting_.erase(it);
+            task->sql = item.second;
+            if(!task->sql) {
+                LOG_ERROR("SqlAsync: no usable connection");
+                Finish_(std::move(task));
+                continue;
+            }
+            Start_(std::move(task));
+        }
+    }
+}
+
+/* 向连接池排队取连接，取得（或超时）后回到本线程继续 */
+void SqlAsync::Acquire_(TaskPtr task) {
+    uint64_t id = ++nextId_;
+    waiting_[id] = std::move(task);
+    pool_->GetConnAsync([this, id](MYSQL* sql) {
+        {
+            lock_guard<mutex> locker(mtx_);
+            if(!isClose_) {
+                acquired_.emplace_back(id, sql);
+                Wakeup_();
+                return;
+            }
+        }
+        if(sql) { pool_->FreeConn(sql); }
+    });
+}
+
+/* 用户名按 ASCII 转为小写：与数据库默认排序规则一样，只差大小写的用户名视为相同 */
+string SqlAsync::Fold_(const string& name) {
+    string folded(name);
+    for(char& ch: folded) {
+        if(ch >= 'A' && ch <= 'Z') { ch += 'a' - 'A'; }
+    }
+    return folded;
+}
+
+/* 注册并入当前批次：同名（不区分大小写）的注册正在排队或写入则直接失败，同一批次中也就没有重名；
+   批次满时立即提交，否则等到 batchDeadline_ */
+void SqlAsync::Batch_(TaskPtr task) {
+    Account& account = task->accounts[0];
+    if(!pending_.insert(Fold_(account.name)).second) {
+        LOG_DEBUG("user used!");
+        account.done(false);
+        return;
+    }
+    if(batch_) {
+        batch_->accounts.push_back(std::move(account));
+    } else {
+        batch_ = std::move(task);
+        batchDeadline_ = chrono::steady_clock::now() + chrono::milliseconds(BATCH_WINDOW_MS);
+    }
+    if(batch_->accounts.size() >= static_cast<size_t>(SqlStmtCache::MAX_ROWS)) {
+        Acquire_(std::move(batch_));
+    }
+}
+
+void SqlAsync::Loop_() {
+    pool_->BindThread(); // 本线程保留一个连接，取用不经过连接池的锁
+    struct epoll_event events[MAX_EVENTS];
+    while(!isClose_) {
+        int n = epoll_wait(epollFd_, events, MAX_EVENTS, NextTimeout_());
+        for(int i = 0; i < n; i++) {
+            int fd = events[i].data.fd;
+            if(fd == wakeupFd_) {
+                uint64_t cnt = 0;
+                ssize_t len = ::read(wakeupFd_, &cnt, sizeof(cnt));
+                (void)len;
+                continue;
+            }
+            auto it = active_.find(fd);
+            if(it == active_.end()) { continue; }
+            TaskPtr task = std::move(it->second);
+            active_.erase(it);
+            uint32_t event = events[i].events;
+            int ready = ((event & (EPOLLIN | EPOLLHUP | EPOLLERR)) ? WAIT_READ : 0) |
+                        ((event & (EPOLLOUT | EPOLLHUP | EPOLLERR)) ? WAIT_WRITE : 0) |
+                        ((event & EPOLLPRI) ? WAIT_EXCEPT : 0);
+            Run_(std::move(task), ready);
+        }
+        /* 客户端库要求的超时到期 */
+        auto now = chrono::steady_clock::now();
+        for(auto it = active_.begin(); it != active_.end(); ) {
+            if(it->second->timed && it->second->deadline <= now) {
+                TaskPtr task = std::move(it->second);
+                it = active_.erase(it);
+                Run_(std::move(task), WAIT_TIMEOUT);
+            } else {
+                ++it;
+            }
+        }
+        if(batch_ && batchDeadline_ <= now) {
+            Acquire_(std::move(batch_));
+        }
+        Drain_();
+    }
+    pool_->UnbindThread();
+}
+
+int SqlAsync::NextTimeout_() {
+    int timeout = -1;
+    auto now = chrono::steady_clock::now();
+    if(batch_) {
+        auto left = chrono::duration_cast<chrono::milliseconds>(batchDeadline_ - now).count();
+        timeout = left > 0 ? static_cast<int>(left) : 0;
+    }
+    for(auto& item: active_) {
+        if(!item.second->timed) { continue; }
+        auto left = chrono::duration_cast<chrono::milliseconds>(item.second->deadline - now).count();
+        int ms = left > 0 ? static_cast<int>(left) : 0;
+        if(timeout < 0 || ms < timeout) { timeout = ms; }
+    }
+    return timeout;
+}
+
+void SqlAsync::Start_(TaskPtr task) {
+    task->stmts = pool_->Stmts(task->sql);
+    bool ready = task->isLogin ? Use_(*task, SqlStmtCache::SELECT_USER) :
+                                 Use_(*task, SqlStmtCache::SELECT_NAMES, static_cast<int>(task->accounts.size()));
+    if(!ready) {
+        Finish_(std::move(task));
+        return;
+    }
+#ifdef SQL_NONBLOCK
+    Run_(std::move(task), 0);
+#else
+    {
+        lock_guard<mutex> locker(mtx_);
+        blocking_.push_back(std::move(task));
+    }
+    blockingCond_.notify_one();
+#endif
+}
+
+/* 查询线程：阻塞执行已取得连接的查询（Step_ 一次执行到底），结果交回本线程回调；
+   回调与连接的归还、同名注册的登记都只在本线程中进行 */
+void SqlAsync::Worker_() {
+    while(true) {
+        TaskPtr task;
+        {
+            unique_lock<mutex> locker(mtx_);
+            blockingCond_.wait(locker, [this] { return isClose_ || !blocking_.empty(); });
+            if(isClose_) { break; }
+            task = std::move(blocking_.front());
+            blocking_.pop_front();
+        }
+        int wait = Step_(*task, 0);
+        assert(wait == 0);
+        (void)wait;
+        lock_guard<mutex> locker(mtx_);
+        finished_.push_back(std::move(task));
+        Wakeup_();
+    }
+    mysql_thread_end();
+}
+
+/* 切换到下一条语句：已预处理则直接执行，否则先 prepare */
+bool SqlAsync::Use_(Task& task, SqlStmtCache::STMT id, int rows) {
+    task.id = id;
+    task.rows = rows;
+    task.stmt = task.stmts->Get(id, rows);
+    if(task.stmt) {
+        task.step = EXECUTE;
+        return Bind_(task);
+    }
+    task.text = SqlStmtCache::Text(id, rows);
+    task.stmt = task.stmts->Create(id, rows);
+    task.step = PREPARE;
+    return task.stmt != nullptr;
+}
+
+/* 参数按二进制绑定，不拼接 SQL，也就不需要转义。
+   依次为：SELECT_USER 的用户名；SELECT_NAMES 的各个用户名；INSERT_USER 各个未被使用的用户名与密码 */
+bool SqlAsync::Bind_(Task& task) {
+    bool insert = task.id == SqlStmtCache::INSERT_USER;
+    vector<const string*> values;
+    for(const Account& account: task.accounts) {
+        if(insert && account.used) { continue; }
+        values.push_back(&account.name);
+        if(insert) { values.push_back(&account.pwd); }
+    }
+    assert(values.size() == static_cast<size_t>(task.rows * (insert ? 2 : 1)));
+    task.param.assign(values.size(), MYSQL_BIND());
+    task.paramLen.resize(values.size());
+    for(size_t i = 0; i < values.size(); i++) {
+        task.paramLen[i] = values[i]->size();
+        task.param[i].buffer_type = MYSQL_TYPE_STRING;
+        task.param[i].buffer = const_cast<char*>(values[i]->data());
+        task.param[i].buffer_length = values[i]->size();
+        task.param[i].length = &task.paramLen[i];
+    }
+    if(mysql_stmt_bind_param(task.stmt, task.param.data())) {
+        LOG_ERROR("SqlAsync: bind param error: %s", mysql_stmt_error(task.stmt));
+        return false;
+    }
+    if(insert) { return true; }
+    memset(task.result, 0, sizeof(task.result));
+    task.result[0].buffer_type = MYSQL_TYPE_STRING;
+    task.result[0].buffer = task.passwd;
+    task.result[0].buffer_length = sizeof(task.passwd);
+    task.result[0].length = &task.passwdLen;
+    task.result[0].is_null = &task.passwdNull;
+    task.result[0].error = &task.passwdError;
+    if(mysql_stmt_bind_result(task.stmt, task.result)) {
+        LOG_ERROR("SqlAsync: bind result error: %s", mysql_stmt_error(task.stmt));
+        return false;
+    }
+    return true;
+}
+
+/* 推进查询，需要等待时按要求的事件注册 socket，完成时回调 */
+void SqlAsync::Run_(TaskPtr task, int ready) {
+    int wait = Step_(*task, ready);
+    if(wait == 0) {
+        Finish_(std::move(task));
+        return;
+    }
+    int fd = Socket(task->sql);
+    struct epoll_event ev = {};
+    ev.events = ((wait & WAIT_READ) ? EPOLLIN : 0) | ((wait & WAIT_WRITE) ? EPOLLOUT : 0) |
+                ((wait & WAIT_EXCEPT) ? EPOLLPRI : 0);
+    ev.data.fd = fd;
+    epoll_ctl(epollFd_, task->watched ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &ev);
+    task->watched = true;
+    task->timed = wait & WAIT_TIMEOUT;
+    if(task->timed) {
+        task->deadline = chrono::steady_clock::now() + chrono::milliseconds(TimeoutMs(task->sql));
+    }
+    active_[fd] = std::move(task);
+}
+
+/* 返回需要等待的事件，0 表示查询结束（结果在 task.ok） */
+int SqlAsync::Step_(Task& task, int ready) {
+    while(true) {
+        int wait = 0;
+        switch(task.step) {
+        case PREPARE:
+            wait = PrepareStep(&task.ret, task.stmt, task.text.c_str(), task.started, ready);
+            break;
+        case EXECUTE:
+            wait = ExecuteStep(&task.ret, task.stmt, task.started, ready);
+            break;
+        case STORE:
+            wait = StoreStep(&task.ret, task.stmt, task.started, ready);
+            break;
+        }
+        if(wait) {
+            task.started = true;
+            return wait;
+        }
+        task.started = false;
+        ready = 0;
+
+        if(task.ret) {
+            unsigned int err = mysql_stmt_errno(task.stmt);
+            task.broken = SqlConnPool::Broken(err);
+            /* 服务器端的语句已不存在：重新 prepare 后再执行一次 */
+            if(task.step == EXECUTE && SqlStmtCache::Stale(err) && !task.retried) {
+                LOG_INFO("SqlAsync: statement lost (%u), prepare again", err);
+                task.retried = true;
+                task.stmts->Reset();
+                if(!Use_(task, task.id, task.rows)) { return 0; }
+                continue;
+            }
+            /* 查询之后有同名用户被插入（其他进程）：整条 INSERT 失败，重新查询一次，只插入仍未被使用的 */
+            if(task.id == SqlStmtCache::INSERT_USER && task.step == EXECUTE && err == DUP_ENTRY && !task.requeried) {
+                LOG_INFO("SqlAsync: duplicate name in batch insert, query names again");
+                task.requeried = true;
+                if(!Use_(task, SqlStmtCache::SELECT_NAMES, static_cast<int>(task.accounts.size()))) { return 0; }
+                continue;
+            }
+            if(task.id == SqlStmtCache::INSERT_USER && task.step == EXECUTE) {
+                for(const Account& account: task.accounts) {
+                    UserCache::Instance()->Erase(account.name); // 可能已被别人注册，下次从数据库读取
+                }
+                LOG_DEBUG("MYSQL (user, passwd) insert error: %s", mysql_stmt_error(task.stmt));
+            } else {
+                LOG_ERROR("SqlAsync: %s error: %s", SqlStmtCache::Text(task.id, task.rows).c_str(), mysql_stmt_error(task.stmt));
+            }
+            return 0;
+        }
+
+        if(task.step == PREPARE) {
+            task.stmts->Prepared(task.id, task.rows);
+            if(!Bind_(task)) { return 0; }
+            task.step = EXECUTE;
+        }
+        else if(task.step == EXECUTE) {
+            if(task.id == SqlStmtCache::INSERT_USER) {
+                for(const Account& account: task.accounts) {
+                    if(!account.used) { UserCache::Instance()->Put(account.name, account.pwd.data(), account.pwd.size()); }
+                }
+                task.ok = true;
+                return 0;
+            }
+            task.step = STORE;
+        }
+        else if(task.isLogin) {
+            /* 结果已全部取回，读取不再有网络 I/O */
+            const Account& account = task.accounts[0];
+            int rc = mysql_stmt_fetch(task.stmt);
+            bool match = rc == 0 && !task.passwdNull && task.passwdLen == account.pwd.size() &&
+                         memcmp(task.passwd, account.pwd.data(), task.passwdLen) == 0;
+            if(rc == 1) {
+                LOG_ERROR("SqlAsync: fetch error: %s", mysql_stmt_error(task.stmt));
+            }
+            mysql_stmt_free_result(task.stmt);
+            if(rc == 1) { return 0; }
+            /* 记下查询结果；密码被截断的不缓存 */
+            if(rc == 0 && !task.passwdNull) {
+                UserCache::Instance()->Put(account.name, task.passwd, task.passwdLen);
+            } else if(rc == MYSQL_NO_DATA) {
+                UserCache::Instance()->PutAbsent(account.name);
+            }
+            task.ok = match;
+            if(!match) { LOG_DEBUG("password error!"); }
+            return 0;
+        }
+        else {
+            /* 注册：未被使用的用户名一条语句插入 */
+            if(!FetchNames_(task)) { return 0; }
+            int rows = 0;
+            for(const Account& account: task.accounts) {
+                if(!account.used) { rows++; }
+            }
+            if(rows == 0) { return 0; }
+            if(!Use_(task, SqlStmtCache::INSERT_USER, rows)) { return 0; }
+        }
+    }
+}
+
+/* 取回这一批中已被使用的用户名（比较不区分大小写，与默认排序规则一致） */
+bool SqlAsync::FetchNames_(Task& task) {
+    int rc;
+    while((rc = mysql_stmt_fetch(task.stmt)) == 0 || rc == MYSQL_DATA_TRUNCATED) {
+        if(rc != 0 || task.passwdNull) { continue; }
+        for(Account& account: task.accounts) {
+            if(account.name.size() == task.passwdLen &&
+               strncasecmp(account.name.data(), task.passwd, task.passwdLen) == 0) {
+                LOG_DEBUG("user used!");
+                account.used = true;
+                UserCache::Instance()->Erase(account.name); // 缓存的“不存在”已过时
+            }
+        }
+    }
+    if(rc == 1) {
+        LOG_ERROR("SqlAsync: fetch error: %s", mysql_stmt_error(task.stmt));
+    }
+    mysql_stmt_free_result(task.stmt);
+    return rc != 1;
+}
+
+void SqlAsync::Finish_(TaskPtr task) {
+    if(task->sql) {
+        if(task->watched) {
+            epoll_ctl(epollFd_, EPOLL_CTL_DEL, Socket(task->sql), nullptr);
+        }
+        if(task->broken) {
+            pool_->Discard(task->sql); // 连接已断开，由连接池补建
+        } else {
+            pool_->FreeConn(task->sql);
+        }
+        task->sql = nullptr;
+    }
+    LOG_DEBUG("UserVerify complete !!");
+    if(task->isLogin) {
+        task->accounts[0].done(task->ok);
+        return;
+    }
+    for(Account& account: task->accounts) {
+        pending_.erase(Fold_(account.name));
+        account.done(task->ok && !account.used);
+    }
+}
@@ -0,0 +1,150 @@
+#ifndef SQLASYNC_H
+#define SQLASYNC_H
+
+#include <string>
+#include <memory>
+#include <functional>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <unistd.h>      // close
+#include <string.h>      // memset, memcmp, strlen
+#include <strings.h>     // strncasecmp
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <assert.h>
+
+#include "userstore.h"
+#include "sqlconnpool.h"
+#include "usercache.h"
+#include "../log/log.h"
+
+/* 数据库查询的事件循环（单例），用户存储的 MySQL 后端
+   登录、注册的查询提交到这里，工作线程立即返回；本线程从连接池取连接，查询使用连接上缓存的预处理语句（SqlStmtCache），
+   参数按二进制绑定，完成时在本线程中回调。
+   默认构建链接 MariaDB Connector/C（SQL_NONBLOCK，见 build/Makefile）：用它的非阻塞 API 发起查询，
+   按 API 要求的事件把连接的 socket 注册到本线程的 epoll，事件就绪或超时后继续执行，查询之间互不阻塞。
+   只有 libmysqlclient 时（它的 *_nonblocking 接口不支持预处理语句），取得连接的查询交给 workers 个查询线程阻塞执行，
+   完成后回到本线程回调，同样不占用工作线程。
+   查询结果记入 UserCache，缓存命中的校验不再提交到本线程。
+   注册合并成批：BATCH_WINDOW_MS 内（最多 SqlStmtCache::MAX_ROWS 个）的注册一次查询用户名、一条多行 INSERT 插入，
+   数据库每批只提交一次事务；排队与写入中的用户名（不区分大小写，与数据库的比较一致）记在内存中，同名的注册直接失败。
+   查询之后其他进程插入了同名用户时整条 INSERT 失败，这时重新查询一次，只插入仍未被使用的用户名 */
+class SqlAsync: public UserStore {
+public:
+    static SqlAsync* Instance();
+
+    void Init(SqlConnPool* pool, int workers = 4); // workers：没有非阻塞 API 时的查询线程数，不必多于连接池的连接数
+    void Close() override; // 未完成的查询以失败回调
+    const char* Name() const override { return "mysql"; }
+
+    /* 校验用户名与密码；isLogin 为 false 时注册：用户名未被使用则插入。done(结果) 在数据库线程中调用，
+       缓存命中时在调用线程中直接调用 */
+    void Verify(const std::string& name, const std::string& pwd, bool isLogin, std::function<void(bool)> done) override;
+
+private:
+    SqlAsync(): pool_(nullptr), epollFd_(-1), wakeupFd_(-1), isClose_(true), nextId_(0) {}
+    ~SqlAsync() override { Close(); }
+
+    enum STEP {
+        PREPARE,  // 在连接上预处理语句（每个连接每条语句一次）
+        EXECUTE,  // 执行语句
+        STORE,    // 取回查询结果
+    };
+
+    struct Account {
+        std::string name;
+        std::string pwd;
+        std::function<void(bool)> done;
+        bool used = false;      // 注册：用户名已被使用
+    };
+
+    struct Task {
+        bool isLogin;
+        std::vector<Account> accounts; // 登录一个；注册为一批，用户名各不相同
+
+        MYSQL* sql = nullptr;
+        SqlStmtCache* stmts = nullptr;
+        SqlStmtCache::STMT id = SqlStmtCache::SELECT_USER;
+        int rows = 1;           // 当前语句的行数
+        std::string text;       // 正在预处理的 SQL
+        MYSQL_STMT* stmt = nullptr;
+        STEP step = PREPARE;
+        bool started = false;   // 当前步骤已发起，事件就绪后调用 mysql_stmt_xxx_cont
+        bool watched = false;   // socket 已注册到 epoll
+        bool retried = false;   // 语句失效后已重新 prepare 过一次
+        bool requeried = false; // 注册：INSERT 遇到重复后已重新查询过一次用户名
+        bool broken = false;    // 连接已断开，不再放回连接池
+        bool ok = false;        // 登录：密码一致；注册：整批写入成功
+        int ret = 0;
+
+        /* 绑定的参数与结果缓冲区，执行期间地址不能变 */
+        std::vector<MYSQL_BIND> param;
+        std::vector<unsigned long> paramLen;
+        MYSQL_BIND result[1];
+        char passwd[256];       // SELECT_USER 取回的密码，SELECT_NAMES 取回的用户名
+        unsigned long passwdLen = 0;
+        SqlBool passwdNull = 0;
+        SqlBool passwdError = 0;
+        std::chrono::steady_clock::time_point deadline; // 客户端库要求的超时（MYSQL_WAIT_TIMEOUT）
+        bool timed = false;
+    };
+    typedef std::unique_ptr<Task> TaskPtr;
+
+    /* 与 MYSQL_WAIT_* 取值相同；没有非阻塞 API 时同样使用 */
+    static const int WAIT_READ = 1;
+    static const int WAIT_WRITE = 2;
+    static const int WAIT_EXCEPT = 4;
+    static const int WAIT_TIMEOUT = 8;
+
+    void Loop_();
+    void Start_(TaskPtr task);
+    bool Use_(Task& task, SqlStmtCache::STMT id, int rows = 1);
+    bool Bind_(Task& task);
+    bool FetchNames_(Task& task);
+    void Run_(TaskPtr task, int ready);
+    int Step_(Task& task, int ready);
+    void Finish_(TaskPtr task);
+    void Drain_();
+    void Acquire_(TaskPtr task);
+    void Batch_(TaskPtr task);
+    int NextTimeout_();
+    void Wakeup_();
+    void Worker_();
+    static std::string Fold_(const std::string& name);
+
+    static const int MAX_EVENTS = 64;
+    static const int BATCH_WINDOW_MS = 2; // 注册合并的等待时间
+
+    SqlConnPool* pool_;
+    int epollFd_;
+    int wakeupFd_;
+    std::atomic<bool> isClose_;
+    std::thread thread_;
+
+    std::mutex mtx_;
+    std::vector<TaskPtr> incoming_; // 工作线程提交、尚未开始的查询
+    std::vector<std::pair<uint64_t, MYSQL*>> acquired_; // 连接池交来的连接（nullptr：等待超时）
+
+    /* 没有非阻塞 API 时使用 */
+    std::vector<std::thread> workers_;
+    std::condition_variable blockingCond_;
+    std::deque<TaskPtr> blocking_;   // 已取得连接，等待查询线程执行
+    std::vector<TaskPtr> finished_;  // 查询线程执行完毕，等待本线程回调
+
+    /* 以下只由数据库线程访问 */
+    uint64_t nextId_;
+    std::unordered_map<uint64_t, TaskPtr> waiting_; // 在连接池排队的查询
+    std::unordered_map<int, TaskPtr> active_; // socket -> 等待事件的查询
+    TaskPtr batch_;                           // 正在合并的注册
+    std::chrono::steady_clock::time_point batchDeadline_;
+    std::unordered_set<std::string> pending_; // 排队与写入中的注册用户名（Fold_ 转为小写）
+};
+
+#endif //SQLASYNC_H
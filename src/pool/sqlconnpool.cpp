@@ -1,7 +1,48 @@
 #include "sqlconnpool.h"
 using namespace std;
 
-SqlConnPool::SqlConnPool() {}
+void LatencyHistogram::Record(chrono::steady_clock::duration wait) {
+    long long us = chrono::duration_cast<chrono::microseconds>(wait).count();
+    int i = us <= 0 ? 0 : min(BUCKETS - 1, 64 - __builtin_clzll(us));
+    count_[i].fetch_add(1, memory_order_relaxed);
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::Get() const {
+    Snapshot snapshot;
+    for(int i = 0; i < BUCKETS; i++) {
+        snapshot.count[i] = count_[i].load(memory_order_relaxed);
+    }
+    return snapshot;
+}
+
+uint64_t LatencyHistogram::Snapshot::Total() const {
+    uint64_t total = 0;
+    for(int i = 0; i < BUCKETS; i++) { total += count[i]; }
+    return total;
+}
+
+int64_t LatencyHistogram::Snapshot::Percentile(double p) const {
+    uint64_t total = Total();
+    if(total == 0) { return 0; }
+    uint64_t rank = max<uint64_t>(1, static_cast<uint64_t>(p * total + 0.5));
+    uint64_t seen = 0;
+    for(int i = 0; i < BUCKETS; i++) {
+        seen += count[i];
+        if(seen >= rank) { return int64_t(1) << i; }
+    }
+    return int64_t(1) << (BUCKETS - 1);
+}
+
+LatencyHistogram::Snapshot LatencyHistogram::Snapshot::operator-(const Snapshot& prev) const {
+    Snapshot diff;
+    for(int i = 0; i < BUCKETS; i++) { diff.count[i] = count[i] - prev.count[i]; }
+    return diff;
+}
+
+thread_local SqlConnPool::Affinity SqlConnPool::affinity_;
+
+SqlConnPool::SqlConnPool(): port_(0), minConn_(0), maxConn_(0), waiting_(0), total_(0), connecting_(0),
+    isClose_(true), isDown_(false), timeouts_(0), reportedTimeouts_(0) {}
 
 SqlConnPool* SqlConnPool::Instance() {
     static SqlConnPool connPool;
@@ -10,62 +51,454 @@ SqlConnPool* SqlConnPool::Instance() {
 
 void SqlConnPool::Init(const char* host, int port,
             const char* user,const char* pwd, const char* dbName,
-            int connSize = 10) {
-    assert(connSize > 0);
-    for (int i = 0; i < connSize; i++) {
-        MYSQL *sql = nullptr;
-        sql = mysql_init(sql);
-        if (!sql) {
-            LOG_ERROR("MySql init error!");
-            assert(sql);
-        }
-        sql = mysql_real_connect(sql, host,
-                                 user, pwd,
-                                 dbName, port, nullptr, 0);
-        if (!sql) {
-            LOG_ERROR("MySql Connect error!");
-        }
-        connQue_.push(sql);
+            int maxConn, int minConn) {
+    assert(maxConn > 0);
+    ClosePool();
+    mysql_library_init(0, nullptr, nullptr); // 之后多个线程同时 mysql_init
+    host_ = host;
+    user_ = user;
+    pwd_ = pwd;
+    dbName_ = dbName;
+    port_ = port;
+    maxConn_ = maxConn;
+    minConn_ = max(0, min(minConn, maxConn));
+    unique_lock<mutex> locker(mtx_);
+    isClose_ = false;
+    isDown_ = false;
+    lastReport_ = chrono::steady_clock::now();
+    /* 并行建立初始连接，启动耗时约为一次建连，而不是 minConn 次 */
+    Grow_();
+    vector<future<void>> connectors;
+    connectors.swap(connectors_);
+    locker.unlock();
+    for(auto& connector: connectors) {
+        connector.wait();
+    }
+    locker.lock();
+    if(total_ < minConn_) {
+        LOG_ERROR("SqlConnPool: only %d of %d connections established", total_, minConn_);
     }
-    MAX_CONN_ = connSize;
-    sem_init(&semId_, 0, MAX_CONN_); // semId_ 初始化 MAX_CONN_
+    maintainer_ = thread(&SqlConnPool::Maintain_, this);
 }
 
-MYSQL* SqlConnPool::GetConn() {
-    MYSQL *sql = nullptr;
-    if(connQue_.empty()){
-        LOG_WARN("SqlConnPool busy!");
+MYSQL* SqlConnPool::Connect_() {
+    MYSQL* sql = mysql_init(nullptr);
+    if (!sql) {
+        LOG_ERROR("MySql init error!");
         return nullptr;
     }
-    sem_wait(&semId_); // 等待 semId_ > 0 后 - 1
-    {
+    unsigned int timeout = CONNECT_TIMEOUT_S;
+    mysql_options(sql, MYSQL_OPT_CONNECT_TIMEOUT, &timeout);
+    unsigned int ioTimeout = IO_TIMEOUT_S; // 服务器无响应时查询、ping 出错返回，不一直占用线程
+    mysql_options(sql, MYSQL_OPT_READ_TIMEOUT, &ioTimeout);
+    mysql_options(sql, MYSQL_OPT_WRITE_TIMEOUT, &ioTimeout);
+#ifdef SQL_NONBLOCK
+    mysql_options(sql, MYSQL_OPT_NONBLOCK, 0); // 连接前设置；阻塞 API 仍可照常使用
+#endif
+    if (!mysql_real_connect(sql, host_.c_str(), user_.c_str(), pwd_.c_str(),
+                            dbName_.c_str(), port_, nullptr, 0)) {
         lock_guard<mutex> locker(mtx_);
-        sql = connQue_.front();
-        connQue_.pop();
+        if(!isDown_) {
+            LOG_ERROR("MySql Connect error: %s", mysql_error(sql));
+        }
+        isDown_ = true;
+        mysql_close(sql);
+        return nullptr;
     }
     return sql;
 }
 
+/* 在独立线程中建立一个连接，加入连接池（有等待者时直接交给它） */
+void SqlConnPool::Connector_() {
+    MYSQL* sql = Connect_();
+    Handoffs handoffs;
+    {
+        lock_guard<mutex> locker(mtx_);
+        connecting_--;
+        if(!sql || isClose_) {
+            total_--;
+        } else {
+            if(isDown_) {
+                LOG_INFO("SqlConnPool: database reachable again");
+                isDown_ = false;
+            }
+            Conn* conn = new Conn(sql);
+            conn->lastUsed = conn->lastChecked = chrono::steady_clock::now();
+            conns_[sql].reset(conn);
+            Release_(conn, handoffs);
+            sql = nullptr;
+        }
+    }
+    if(sql) { mysql_close(sql); }
+    Run_(handoffs);
+    mysql_thread_end();
+}
+
+/* 持有 mtx_ 调用：连接数补到 minConn，等待者多于正在建立的连接时继续新建，不超过 maxConn */
+void SqlConnPool::Grow_() {
+    int want = max(minConn_ - total_, static_cast<int>(waiters_.size()) - connecting_);
+    want = min(want, maxConn_ - total_);
+    for(int i = 0; i < want; i++) {
+        total_++;
+        connecting_++;
+        connectors_.push_back(async(launch::async, &SqlConnPool::Connector_, this));
+    }
+}
+
+MYSQL* SqlConnPool::GetConn(int timeoutMs) {
+    struct Result {
+        bool done = false;
+        MYSQL* sql = nullptr;
+    };
+    shared_ptr<Result> result = make_shared<Result>();
+    GetConnAsync([this, result](MYSQL* sql) {
+        lock_guard<mutex> locker(mtx_);
+        result->sql = sql;
+        result->done = true;
+        cond_.notify_all();
+    }, timeoutMs);
+    unique_lock<mutex> locker(mtx_);
+    cond_.wait(locker, [&result] { return result->done; }); // 超时由维护线程回调
+    return result->sql;
+}
+
+void SqlConnPool::GetConnAsync(function<void(MYSQL*)> done, int timeoutMs) {
+    auto now = chrono::steady_clock::now();
+    Affinity& affinity = affinity_;
+    if(affinity.pool == this && affinity.conn && !affinity.busy) {
+        Conn* conn = affinity.conn;
+        if(waiting_ == 0 && now - max(conn->lastUsed, conn->lastChecked) < chrono::seconds(CHECK_IDLE_S)) {
+            affinity.busy = true;
+            wait_.Record(chrono::steady_clock::duration::zero());
+            done(conn->sql);
+            return;
+        }
+        /* 有人在排队（不插队），或长时间未用（还给连接池，由维护线程检查） */
+        affinity.conn = nullptr;
+        Handoffs handoffs;
+        {
+            lock_guard<mutex> locker(mtx_);
+            Release_(conn, handoffs, false);
+        }
+        Run_(handoffs);
+    }
+    unique_lock<mutex> locker(mtx_);
+    if(!isClose_ && !free_.empty()) {
+        Conn* conn = free_.back(); // 取最近用过的连接，其余的保持空闲以便收缩
+        free_.pop_back();
+        wait_.Record(chrono::steady_clock::now() - now);
+        locker.unlock();
+        done(conn->sql); // 回调不在锁内执行
+        return;
+    }
+    if(!isClose_ && timeoutMs > 0) {
+        waiters_.push_back({ std::move(done), now, now + chrono::milliseconds(timeoutMs) });
+        waiting_++;
+        Grow_();
+        maintainCond_.notify_one(); // 维护线程按最早的期限醒来
+        return;
+    }
+    if(!isClose_) {
+        timeouts_++;
+        wait_.Record(chrono::steady_clock::duration::zero());
+    }
+    locker.unlock();
+    LOG_WARN("SqlConnPool busy!");
+    done(nullptr);
+}
+
 void SqlConnPool::FreeConn(MYSQL* sql) {
     assert(sql);
-    lock_guard<mutex> locker(mtx_);
-    connQue_.push(sql);
-    sem_post(&semId_); // semId_ + 1
+    auto now = chrono::steady_clock::now();
+    Affinity& affinity = affinity_;
+    if(affinity.pool == this) {
+        if(affinity.conn && affinity.conn->sql == sql) {
+            affinity.conn->lastUsed = now;
+            affinity.busy = false;
+            if(waiting_ == 0) { return; }
+            affinity.conn = nullptr; // 有等待者：交还连接池
+        }
+        else if(!affinity.conn && waiting_ == 0) {
+            /* 留给本线程，之后取用不加锁 */
+            lock_guard<mutex> locker(mtx_);
+            affinity.conn = Find_(sql);
+            affinity.conn->lastUsed = now;
+            affinity.busy = false;
+            return;
+        }
+    }
+    Handoffs handoffs;
+    {
+        lock_guard<mutex> locker(mtx_);
+        Conn* conn = Find_(sql);
+        conn->lastUsed = now;
+        Release_(conn, handoffs);
+    }
+    Run_(handoffs);
 }
 
-void SqlConnPool::ClosePool() {
+void SqlConnPool::Discard(MYSQL* sql) {
+    assert(sql);
+    Affinity& affinity = affinity_;
+    if(affinity.pool == this && affinity.conn && affinity.conn->sql == sql) {
+        affinity.conn = nullptr;
+        affinity.busy = false;
+    }
+    unique_ptr<Conn> conn;
+    {
+        lock_guard<mutex> locker(mtx_);
+        LOG_WARN("SqlConnPool: discard broken connection");
+        conn = Take_(Find_(sql));
+        total_--;
+        maintainCond_.notify_one(); // 按需补建
+    }
+}
+
+/* 持有 mtx_ 调用：有等待者时交给最早的等待者，回调记入 handoffs 在锁外执行；否则放回空闲队列 */
+void SqlConnPool::Release_(Conn* conn, Handoffs& handoffs, bool recent) {
+    if(isClose_) {
+        free_.push_back(conn);
+        return;
+    }
+    if(!waiters_.empty()) {
+        Waiter& waiter = waiters_.front();
+        wait_.Record(chrono::steady_clock::now() - waiter.since);
+        handoffs.emplace_back(std::move(waiter.done), conn->sql);
+        waiters_.pop_front();
+        waiting_--;
+        return;
+    }
+    if(recent) {
+        free_.push_back(conn);
+    } else {
+        free_.push_front(conn);
+    }
+}
+
+unique_ptr<SqlConnPool::Conn> SqlConnPool::Take_(Conn* conn) {
+    auto it = conns_.find(conn->sql);
+    assert(it != conns_.end());
+    unique_ptr<Conn> taken = std::move(it->second);
+    conns_.erase(it);
+    return taken;
+}
+
+SqlConnPool::Conn* SqlConnPool::Find_(MYSQL* sql) {
+    auto it = conns_.find(sql);
+    assert(it != conns_.end());
+    return it->second.get();
+}
+
+void SqlConnPool::Run_(Handoffs& handoffs) {
+    for(auto& handoff: handoffs) {
+        handoff.first(handoff.second);
+    }
+    handoffs.clear();
+}
+
+void SqlConnPool::BindThread() {
+    Affinity& affinity = affinity_;
+    assert(!affinity.pool || affinity.pool == this);
+    affinity.pool = this;
+}
+
+void SqlConnPool::UnbindThread() {
+    Affinity& affinity = affinity_;
+    if(affinity.pool != this) { return; }
+    Conn* conn = affinity.conn;
+    bool busy = affinity.busy;
+    affinity = Affinity();
+    if(conn && !busy) {
+        Handoffs handoffs;
+        {
+            lock_guard<mutex> locker(mtx_);
+            Release_(conn, handoffs);
+        }
+        Run_(handoffs);
+    }
+}
+
+SqlStmtCache* SqlConnPool::Stmts(MYSQL* sql) {
+    Affinity& affinity = affinity_;
+    if(affinity.pool == this && affinity.conn && affinity.conn->sql == sql) {
+        return affinity.conn->stmts.get();
+    }
     lock_guard<mutex> locker(mtx_);
-    while(!connQue_.empty()) {
-        auto item = connQue_.front();
-        connQue_.pop();
-        mysql_close(item);
+    return Find_(sql)->stmts.get();
+}
+
+bool SqlConnPool::Broken(unsigned int err) {
+    /* CR_SERVER_GONE_ERROR、CR_SERVER_LOST、CR_SERVER_LOST_EXTENDED */
+    return err == 2006 || err == 2013 || err == 2055;
+}
+
+/* 维护线程：等待超时、补建连接、检查与收缩空闲连接、定期记录统计 */
+void SqlConnPool::Maintain_() {
+    unique_lock<mutex> locker(mtx_);
+    while(!isClose_) {
+        auto wake = chrono::steady_clock::now() + chrono::seconds(1);
+        for(auto& waiter: waiters_) {
+            wake = min(wake, waiter.deadline);
+        }
+        maintainCond_.wait_until(locker, wake);
+        if(isClose_) { break; }
+        Handoffs handoffs;
+        Expire_(handoffs);
+        for(auto it = connectors_.begin(); it != connectors_.end(); ) {
+            if(it->wait_for(chrono::seconds(0)) == future_status::ready) {
+                it = connectors_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        Grow_();
+        Check_(locker);
+        locker.unlock();
+        Run_(handoffs);
+        Report_();
+        locker.lock();
+    }
+    locker.unlock();
+    mysql_thread_end();
+}
+
+void SqlConnPool::Expire_(Handoffs& handoffs) {
+    auto now = chrono::steady_clock::now();
+    int expired = 0;
+    for(auto it = waiters_.begin(); it != waiters_.end(); ) {
+        if(it->deadline <= now) {
+            wait_.Record(now - it->since);
+            handoffs.emplace_back(std::move(it->done), nullptr);
+            it = waiters_.erase(it);
+            waiting_--;
+            expired++;
+        } else {
+            ++it;
+        }
+    }
+    if(expired > 0) {
+        timeouts_ += expired;
+        LOG_WARN("SqlConnPool: %d acquires timed out (%d conns, %d connecting)", expired, total_, connecting_);
+    }
+}
+
+/* 关闭空闲过久的多余连接；长时间未用的空闲连接交给独立线程 ping，维护线程不等待，等待者照常按时超时 */
+void SqlConnPool::Check_(unique_lock<mutex>& locker) {
+    auto now = chrono::steady_clock::now();
+    vector<unique_ptr<Conn>> closing;
+    while(total_ > minConn_ && !free_.empty() && now - free_.front()->lastUsed > chrono::seconds(IDLE_TIMEOUT_S)) {
+        closing.push_back(Take_(free_.front()));
+        free_.pop_front();
+        total_--;
     }
-    mysql_library_end();        
+    vector<Conn*> checking;
+    for(auto it = free_.begin(); it != free_.end(); ) {
+        if(now - max((*it)->lastUsed, (*it)->lastChecked) > chrono::seconds(CHECK_IDLE_S)) {
+            checking.push_back(*it);
+            it = free_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+    if(!checking.empty()) {
+        connectors_.push_back(async(launch::async, &SqlConnPool::Ping_, this, std::move(checking)));
+    }
+    if(closing.empty()) { return; }
+    locker.unlock();
+    closing.clear();
+    locker.lock();
+}
+
+/* ping 时不持有锁；成功的放回连接池，失败的关闭（之后由 Grow_ 补建） */
+void SqlConnPool::Ping_(vector<Conn*> checking) {
+    vector<bool> alive;
+    for(Conn* conn: checking) {
+        alive.push_back(mysql_ping(conn->sql) == 0);
+    }
+    Handoffs handoffs;
+    vector<unique_ptr<Conn>> closing;
+    {
+        lock_guard<mutex> locker(mtx_);
+        auto now = chrono::steady_clock::now();
+        for(size_t i = 0; i < checking.size(); i++) {
+            if(alive[i]) {
+                checking[i]->lastChecked = now;
+                Release_(checking[i], handoffs, false);
+            } else {
+                LOG_WARN("SqlConnPool: ping failed: %s", mysql_error(checking[i]->sql));
+                closing.push_back(Take_(checking[i]));
+                total_--;
+            }
+        }
+        if(!closing.empty() && !isClose_) {
+            Grow_();
+        }
+    }
+    closing.clear();
+    Run_(handoffs);
+    mysql_thread_end();
+}
+
+void SqlConnPool::Report_() {
+    auto now = chrono::steady_clock::now();
+    if(now - lastReport_ < chrono::seconds(REPORT_S)) { return; }
+    lastReport_ = now;
+    LatencyHistogram::Snapshot current = wait_.Get();
+    LatencyHistogram::Snapshot diff = current - reported_;
+    uint64_t timeouts = timeouts_ - reportedTimeouts_;
+    reported_ = current;
+    reportedTimeouts_ += timeouts;
+    if(diff.Total() == 0) { return; }
+    int total, idle, waiting;
+    {
+        lock_guard<mutex> locker(mtx_);
+        total = total_;
+        idle = free_.size();
+        waiting = waiters_.size();
+    }
+    LOG_INFO("SqlConnPool: %d conns (%d idle, %d waiting), %llu acquires, %llu timeouts, wait p50 <%lldus p99 <%lldus max <%lldus",
+             total, idle, waiting, (unsigned long long)diff.Total(), (unsigned long long)timeouts,
+             (long long)diff.Percentile(0.5), (long long)diff.Percentile(0.99), (long long)diff.Percentile(1.0));
 }
 
 int SqlConnPool::GetFreeConnCount() {
     lock_guard<mutex> locker(mtx_);
-    return connQue_.size();
+    return free_.size();
+}
+
+void SqlConnPool::ClosePool() {
+    vector<future<void>> connectors;
+    Handoffs handoffs;
+    {
+        lock_guard<mutex> locker(mtx_);
+        if(isClose_) { return; }
+        isClose_ = true;
+        connectors.swap(connectors_);
+        for(auto& waiter: waiters_) {
+            handoffs.emplace_back(std::move(waiter.done), nullptr);
+        }
+        waiters_.clear();
+        waiting_ = 0;
+    }
+    maintainCond_.notify_all();
+    if(maintainer_.joinable()) {
+        maintainer_.join();
+    }
+    for(auto& connector: connectors) {
+        connector.wait();
+    }
+    Run_(handoffs);
+    Affinity& affinity = affinity_;
+    if(affinity.pool == this) {
+        affinity = Affinity();
+    }
+    {
+        lock_guard<mutex> locker(mtx_);
+        free_.clear();
+        conns_.clear(); // 关闭全部连接
+        total_ = connecting_ = 0;
+    }
+    mysql_library_end();
 }
 
 SqlConnPool::~SqlConnPool() {
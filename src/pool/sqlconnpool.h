@@ -1,37 +1,154 @@
 #ifndef SQLCONNPOOL_H
 #define SQLCONNPOOL_H
 
-#include <mysql/mysql.h>
+#include <mysql.h>         // 头文件目录由 Makefile 按客户端库给出
 #include <string>
-#include <queue>
+#include <deque>
+#include <vector>
 #include <mutex>
-#include <semaphore.h>
+#include <condition_variable>
 #include <thread>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <unordered_map>
+#include "sqlstmt.h"
 #include "../log/log.h"
 
+/* MariaDB Connector/C 提供非阻塞 API（mysql_xxx_start/mysql_xxx_cont），查询由 SqlAsync 的事件循环驱动；
+   构建时有 Connector/C 就链接它（见 build/Makefile），只有 libmysqlclient 时查询由 SqlAsync 的查询线程阻塞执行 */
+#if defined(LIBMARIADB) || defined(MARIADB_BASE_VERSION)
+#define SQL_NONBLOCK 1
+#endif
+
+/* 等待时间的直方图：第 i 个桶统计 [2^(i-1), 2^i) 微秒，只做原子加，记录不加锁 */
+class LatencyHistogram {
+public:
+    static const int BUCKETS = 32;
+
+    void Record(std::chrono::steady_clock::duration wait);
+
+    struct Snapshot {
+        uint64_t count[BUCKETS] = {};
+        uint64_t Total() const;
+        int64_t Percentile(double p) const; // 所在桶的上界（微秒），没有记录返回 0
+        Snapshot operator-(const Snapshot& prev) const;
+    };
+    Snapshot Get() const;
+
+private:
+    std::atomic<uint64_t> count_[BUCKETS] = {};
+};
+
+/* 数据库连接池（单例）
+   启动时并行建立 minConn 个连接，不够用时由维护线程补建，最多 maxConn 个，空闲超过 IDLE_TIMEOUT_S 的多余连接关闭；
+   维护线程定期把长时间未用的空闲连接交给独立线程 ping，失败的关闭重连；连接设置了读写超时，ping 与查询不会无限阻塞。取连接可以设置等待上限，也可以排队异步取得；
+   等待时间记入直方图，与连接数、超时次数一起定期写入日志 */
 class SqlConnPool {
 public:
     static SqlConnPool *Instance();
 
-    MYSQL *GetConn();
+    /* 取得连接，最多等待 timeoutMs 毫秒（0：不等待），超时返回 nullptr */
+    MYSQL *GetConn(int timeoutMs = ACQUIRE_TIMEOUT_MS);
+    /* 异步取得连接：有空闲连接时立即回调，否则按先后排队，连接归还或新建后交给排在最前的等待者，超时回调 nullptr。
+       回调恰好执行一次，可能在归还连接的线程或维护线程中执行，不能阻塞 */
+    void GetConnAsync(std::function<void(MYSQL*)> done, int timeoutMs = ACQUIRE_TIMEOUT_MS);
     void FreeConn(MYSQL * conn);
+    void Discard(MYSQL * conn); // 连接已断开：关闭，由维护线程按需补建
     int GetFreeConnCount();
 
+    /* 调用线程保留一个连接：之后本线程归还的第一个连接留给自己，再取连接时直接使用，不经过锁与排队 */
+    void BindThread();
+    void UnbindThread();
+
+    SqlStmtCache* Stmts(MYSQL* sql); // 连接的预处理语句
+
+    static bool Broken(unsigned int err); // 错误码表示连接已断开
+
     void Init(const char* host, int port,
-              const char* user,const char* pwd, 
-              const char* dbName, int connSize);
+              const char* user,const char* pwd,
+              const char* dbName, int maxConn, int minConn);
     void ClosePool();
 
+    static const int ACQUIRE_TIMEOUT_MS = 3000;
+
 private:
     SqlConnPool();
     ~SqlConnPool();
 
-    int MAX_CONN_;
+    struct Conn {
+        explicit Conn(MYSQL* conn): sql(conn), stmts(new SqlStmtCache(conn)) {}
+        ~Conn() {
+            stmts.reset(); // 语句句柄先于连接关闭
+            mysql_close(sql);
+        }
+
+        MYSQL* sql;
+        std::unique_ptr<SqlStmtCache> stmts;
+        std::chrono::steady_clock::time_point lastUsed;    // 最近一次归还
+        std::chrono::steady_clock::time_point lastChecked; // 最近一次确认可用（建立、ping 成功）
+    };
+
+    struct Waiter {
+        std::function<void(MYSQL*)> done;
+        std::chrono::steady_clock::time_point since;
+        std::chrono::steady_clock::time_point deadline;
+    };
+    typedef std::vector<std::pair<std::function<void(MYSQL*)>, MYSQL*>> Handoffs;
+
+    struct Affinity {
+        SqlConnPool* pool = nullptr;
+        Conn* conn = nullptr;
+        bool busy = false;
+    };
+    static thread_local Affinity affinity_;
+
+    MYSQL* Connect_();
+    void Connector_();
+    void Grow_();
+    void Release_(Conn* conn, Handoffs& handoffs, bool recent = true);
+    std::unique_ptr<Conn> Take_(Conn* conn);
+    Conn* Find_(MYSQL* sql);
+    void Maintain_();
+    void Expire_(Handoffs& handoffs);
+    void Check_(std::unique_lock<std::mutex>& locker);
+    void Ping_(std::vector<Conn*> checking);
+    void Report_();
+    static void Run_(Handoffs& handoffs);
+
+    static const int CHECK_IDLE_S = 30;    // 空闲超过这个时间的连接使用前先 ping
+    static const int IDLE_TIMEOUT_S = 60;  // 多于 minConn 的连接空闲超过这个时间关闭
+    static const int REPORT_S = 60;        // 统计写入日志的间隔
+    static const int CONNECT_TIMEOUT_S = 3;
+    static const int IO_TIMEOUT_S = 5;     // 连接上每次读写的超时（客户端库读超时时会重试，实际等待可能是数倍）
+
+    std::string host_, user_, pwd_, dbName_;
+    int port_;
+    int minConn_;
+    int maxConn_;
 
-    std::queue<MYSQL *> connQue_;
     std::mutex mtx_;
-    sem_t semId_;
+    std::condition_variable cond_;        // 同步等待者
+    std::condition_variable maintainCond_;
+    std::unordered_map<MYSQL *, std::unique_ptr<Conn>> conns_; // 全部连接
+    std::deque<Conn*> free_;              // 空闲连接，队尾最近用过
+    std::deque<Waiter> waiters_;
+    std::atomic<int> waiting_;
+    int total_;                           // 已建立与正在建立的连接数
+    int connecting_;
+    bool isClose_;
+    bool isDown_;                         // 最近一次建立连接失败，恢复前不再重复记录错误
+    std::thread maintainer_;
+    std::vector<std::future<void>> connectors_; // 正在建立连接、检查连接的线程
+
+    LatencyHistogram wait_;
+    std::atomic<uint64_t> timeouts_;
+    LatencyHistogram::Snapshot reported_;
+    uint64_t reportedTimeouts_;
+    std::chrono::steady_clock::time_point lastReport_;
 };
 
 
-#endif // SQLCONNPOOL_H
\ No newline at end of file
+#endif // SQLCONNPOOL_H
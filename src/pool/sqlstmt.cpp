@@ -0,0 +1,101 @@
+#include "sqlstmt.h"
+
+namespace {
+
+/* 服务器端没有这个语句：ER_UNKNOWN_STMT_HANDLER、ER_NEED_REPREPARE（表结构改变）、CR_NO_PREPARE_STMT */
+const unsigned int STALE_ERRORS[] = { 1243, 1615, 2030 };
+
+} // namespace
+
+SqlStmtCache::SqlStmtCache(MYSQL* sql): sql_(sql), threadId_(0) {
+    assert(sql_);
+    for(int i = 0; i < STMT_COUNT; i++) {
+        for(int j = 0; j < MAX_ROWS; j++) {
+            stmts_[i][j] = nullptr;
+            prepared_[i][j] = false;
+        }
+    }
+}
+
+SqlStmtCache::~SqlStmtCache() {
+    for(auto& row: stmts_) {
+        for(MYSQL_STMT* stmt: row) {
+            if(stmt) { mysql_stmt_close(stmt); }
+        }
+    }
+}
+
+std::string SqlStmtCache::Text(STMT id, int rows) {
+    assert(id >= 0 && id < STMT_COUNT && rows >= 1 && rows <= MAX_ROWS);
+    std::string text;
+    switch(id) {
+    case SELECT_USER:
+        text = "SELECT passwd FROM user WHERE username = ? LIMIT 1";
+        break;
+    case INSERT_USER:
+        text = "INSERT INTO user(username, passwd) VALUES(?, ?)";
+        for(int i = 1; i < rows; i++) { text += ", (?, ?)"; }
+        break;
+    default:
+        text = "SELECT username FROM user WHERE username IN (?";
+        for(int i = 1; i < rows; i++) { text += ", ?"; }
+        text += ")";
+        break;
+    }
+    return text;
+}
+
+MYSQL_STMT* SqlStmtCache::Get(STMT id, int rows) {
+    assert(id >= 0 && id < STMT_COUNT && rows >= 1 && rows <= MAX_ROWS);
+    if(prepared_[id][rows - 1] && mysql_thread_id(sql_) != threadId_) {
+        LOG_INFO("SqlStmtCache: connection reconnected, prepare statements again");
+        Reset();
+    }
+    return prepared_[id][rows - 1] ? stmts_[id][rows - 1] : nullptr;
+}
+
+MYSQL_STMT* SqlStmtCache::Create(STMT id, int rows) {
+    assert(id >= 0 && id < STMT_COUNT && rows >= 1 && rows <= MAX_ROWS);
+    MYSQL_STMT*& stmt = stmts_[id][rows - 1];
+    if(stmt) {
+        mysql_stmt_close(stmt);
+    }
+    prepared_[id][rows - 1] = false;
+    stmt = mysql_stmt_init(sql_);
+    if(!stmt) {
+        LOG_ERROR("SqlStmtCache: mysql_stmt_init error: %s", mysql_error(sql_));
+    }
+    return stmt;
+}
+
+void SqlStmtCache::Prepared(STMT id, int rows) {
+    assert(id >= 0 && id < STMT_COUNT && rows >= 1 && rows <= MAX_ROWS && stmts_[id][rows - 1]);
+    unsigned long threadId = mysql_thread_id(sql_);
+    if(threadId != threadId_) {
+        /* 其他语句是在重连前预处理的 */
+        for(auto& row: prepared_) {
+            for(bool& prepared: row) { prepared = false; }
+        }
+        threadId_ = threadId;
+    }
+    prepared_[id][rows - 1] = true;
+}
+
+void SqlStmtCache::Reset() {
+    for(int i = 0; i < STMT_COUNT; i++) {
+        for(int j = 0; j < MAX_ROWS; j++) {
+            if(stmts_[i][j]) {
+                mysql_stmt_close(stmts_[i][j]);
+                stmts_[i][j] = nullptr;
+            }
+            prepared_[i][j] = false;
+        }
+    }
+}
+
+bool SqlStmtCache::Stale(unsigned int err) {
+    for(unsigned int code: STALE_ERRORS) {
+        if(err == code) { return true; }
+    }
+    return false;
+}
@@ -0,0 +1,50 @@
+#ifndef SQLSTMT_H
+#define SQLSTMT_H
+
+#include <mysql.h>         // 头文件目录由 Makefile 按客户端库给出
+#include <string>
+#include <type_traits>
+#include <assert.h>
+
+#include "../log/log.h"
+
+/* MYSQL_BIND 中 is_null/error 指向的类型：MariaDB 为 my_bool，MySQL 8 为 bool */
+typedef std::remove_pointer<decltype(MYSQL_BIND::is_null)>::type SqlBool;
+
+/* 一个连接上预处理过的语句（懒加载）
+   语句第一次使用时才在该连接上 prepare，之后只发送语句句柄与二进制参数，服务器不再重复解析 SQL；
+   MYSQL_STMT 属于创建它的连接，和连接一样只由持有者使用，不需要加锁。
+   连接重连后（mysql_thread_id 改变）服务器端的语句已不存在，旧句柄全部作废，下次使用时重新 prepare。
+   批量语句按行数（1 ~ MAX_ROWS）各自预处理 */
+class SqlStmtCache {
+public:
+    enum STMT {
+        SELECT_USER,  // 按用户名查询密码
+        INSERT_USER,  // 注册新用户，一次插入 rows 行
+        SELECT_NAMES, // rows 个用户名中已被使用的
+        STMT_COUNT,
+    };
+
+    static const int MAX_ROWS = 16;
+
+    explicit SqlStmtCache(MYSQL* sql);
+    ~SqlStmtCache();
+
+    static std::string Text(STMT id, int rows = 1);
+
+    MYSQL_STMT* Get(STMT id, int rows = 1);     // 已预处理的句柄；尚未预处理或已作废时返回 nullptr
+    MYSQL_STMT* Create(STMT id, int rows = 1);  // 新建句柄（替换旧句柄），由调用方 prepare，成功后调用 Prepared
+    void Prepared(STMT id, int rows = 1);
+    void Reset();                               // 作废全部句柄
+
+    /* 执行失败是否因为服务器端的语句已不存在（连接断开或重连），这时重新 prepare 后可以重试 */
+    static bool Stale(unsigned int err);
+
+private:
+    MYSQL* sql_;
+    unsigned long threadId_; // 预处理时连接的 thread id
+    MYSQL_STMT* stmts_[STMT_COUNT][MAX_ROWS]; // [语句][行数 - 1]
+    bool prepared_[STMT_COUNT][MAX_ROWS];
+};
+
+#endif //SQLSTMT_H
@@ -0,0 +1,55 @@
+#ifndef TASK_H
+#define TASK_H
+
+#include <new>          // placement new
+#include <type_traits>
+#include <utility>
+#include <stddef.h>
+#include <assert.h>
+
+/* 线程池任务：定长内联存储的可调用对象，取代 std::function<void()>，派发任务时不再有堆分配
+   可调用对象必须可平凡复制、可平凡析构且不超过 CAPACITY 字节，否则编译报错；
+   如 [this, handle] { OnRead_(handle); }。这样 Task 本身也是可平凡复制的，可以直接存入无锁的 WorkStealingDeque */
+class Task {
+public:
+    static const size_t CAPACITY = 32; // 足够容纳 this + ConnHandle，或一个成员函数指针 + 两个参数
+
+    Task(): invoke_(nullptr) {}
+
+    template<class F, class = typename std::enable_if<
+                !std::is_same<typename std::decay<F>::type, Task>::value>::type>
+    Task(F&& func) { // 不加 explicit：与 std::function 一样可以由 lambda 隐式构造
+        typedef typename std::decay<F>::type Fn;
+        static_assert(sizeof(Fn) <= CAPACITY, "callable too large for Task inline storage");
+        static_assert(alignof(Fn) <= alignof(max_align_t), "callable over-aligned for Task inline storage");
+        static_assert(std::is_trivially_copyable<Fn>::value && std::is_trivially_destructible<Fn>::value,
+                      "Task only stores trivially copyable callables (capture pointers and handles by value)");
+        new (storage_) Fn(std::forward<F>(func));
+        invoke_ = &Invoke_<Fn>;
+    }
+
+    /* 只允许移动，避免同一个任务被无意中复制执行两次 */
+    Task(const Task&) = delete;
+    Task& operator=(const Task&) = delete;
+    Task(Task&&) = default;
+    Task& operator=(Task&&) = default;
+    ~Task() = default;
+
+    explicit operator bool() const { return invoke_ != nullptr; }
+
+    void operator()() {
+        assert(invoke_);
+        invoke_(storage_);
+    }
+
+private:
+    template<class Fn>
+    static void Invoke_(void* storage) {
+        (*static_cast<Fn*>(storage))();
+    }
+
+    void (*invoke_)(void*);
+    alignas(max_align_t) unsigned char storage_[CAPACITY];
+};
+
+#endif //TASK_H
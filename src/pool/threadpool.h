@@ -3,29 +3,28 @@
 
 #include <mutex>
 #include <condition_variable>
-#include <queue>
 #include <thread>
-#include <functional>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <assert.h>
+
+#include "wsdeque.h"
+#include "task.h"
+
+/* 工作窃取线程池
+   每个工作线程一个无锁本地队列（WorkStealingDeque），工作线程内提交的任务进本地队列；
+   外部线程（epoll 主线程）提交的任务进全局注入队列，工作线程取全局任务时顺带搬一批到本地队列供其他线程窃取。
+   空闲线程依次：本地队列 -> 窃取其他线程 -> 全局队列 -> 自旋 -> 睡眠，只有确实有线程在睡眠时才 notify。
+   任务类型为定长内联存储的 Task，本地队列和全局环形队列都按值存放，稳定运行时派发任务没有堆分配 */
 class ThreadPool {
 public:
-    explicit ThreadPool(size_t threadCount = 8): pool_(std::make_shared<Pool>()) {
+    explicit ThreadPool(size_t threadCount = 8): pool_(std::make_shared<Pool>(threadCount)) {
             assert(threadCount > 0);
             for(size_t i = 0; i < threadCount; i++) {
-                // 使用匿名函数创建线程，实现从线程池的任务队列中循环取任务并运行，匿名函数如果没有参数,空的圆括号()可以省略
-                // 创建 threadCount 个这样的线程
-                std::thread([pool = pool_] {
-                    std::unique_lock<std::mutex> locker(pool->mtx);
-                    while(true) {
-                        if(!pool->tasks.empty()) {
-                            auto task = std::move(pool->tasks.front());
-                            pool->tasks.pop();
-                            locker.unlock();
-                            task();
-                            locker.lock();
-                        } 
-                        else if(pool->isClosed) break;
-                        else pool->cond.wait(locker); // 如果线程池任务队列为空，且线程池不处于关闭状态，则先释放锁等待条件变量通知再获取锁
-                    }
+                // 使用匿名函数创建线程，每个线程绑定自己的本地队列下标 i
+                std::thread([pool = pool_, i] {
+                    Worker_(pool, i);
                 }).detach();
             }
     }
@@ -33,7 +32,7 @@ public:
     ThreadPool() = default;
 
     ThreadPool(ThreadPool&&) = default;
-    
+
     ~ThreadPool() {
         if(static_cast<bool>(pool_)) {
             {
@@ -46,22 +45,172 @@ public:
 
     template<class F>
     void AddTask(F&& task) {
+        Task newTask(std::forward<F>(task));
+        WorkerContext& ctx = Context_();
+        if(ctx.pool == pool_.get()) {
+            /* 工作线程内提交：放入自己的本地队列，无需加锁；满了则退回全局队列 */
+            if(pool_->queues[ctx.index]->Push(std::move(newTask))) {
+                /* 与 Worker_ 睡眠前的 fence 配对：要么这里看到 sleeping > 0，要么睡眠线程复查时看到这个任务 */
+                std::atomic_thread_fence(std::memory_order_seq_cst);
+                if(pool_->sleeping.load(std::memory_order_relaxed) > 0) {
+                    /* 睡眠线程从 sleeping 加一到进入 wait 一直持有 mtx，先取一次锁，保证 notify 不会落在它 wait 之前 */
+                    { std::lock_guard<std::mutex> locker(pool_->mtx); }
+                    pool_->cond.notify_one();
+                }
+                return;
+            }
+        }
+        bool wake = false;
         {
             std::lock_guard<std::mutex> locker(pool_->mtx);
-            pool_->tasks.emplace(std::forward<F>(task));
+            pool_->tasks.Push(std::move(newTask));
+            pool_->injected.fetch_add(1, std::memory_order_relaxed);
+            wake = pool_->sleeping.load(std::memory_order_relaxed) > 0;
+        }
+        if(wake) {
+            pool_->cond.notify_one();
         }
-        pool_->cond.notify_one();
     }
 
 private:
+    static const int SPIN_COUNT = 128;  // 睡眠前的自旋次数
+    static const size_t MAX_BATCH = 16; // 从全局队列一次最多搬到本地队列的任务数
+
+    /* 全局注入队列：按 2 的幂扩容的环形数组，扩容只发生在积压创新高时，稳定运行时不分配内存 */
+    struct TaskRing {
+        TaskRing(): ring(1024), head(0), count(0) {}
+        bool empty() const { return count == 0; }
+        size_t size() const { return count; }
+        void Push(Task&& task) {
+            if(count == ring.size()) {
+                std::vector<Task> bigger(ring.size() * 2);
+                for(size_t i = 0; i < count; i++) {
+                    bigger[i] = std::move(ring[(head + i) & (ring.size() - 1)]);
+                }
+                ring.swap(bigger);
+                head = 0;
+            }
+            ring[(head + count) & (ring.size() - 1)] = std::move(task);
+            count++;
+        }
+        Task& Front() { return ring[head]; }
+        void Pop() {
+            head = (head + 1) & (ring.size() - 1);
+            count--;
+        }
+        std::vector<Task> ring;
+        size_t head;
+        size_t count;
+    };
+
     struct Pool {
+        explicit Pool(size_t threadCount): isClosed(false), sleeping(0), injected(0) {
+            for(size_t i = 0; i < threadCount; i++) {
+                queues.emplace_back(new WorkStealingDeque<Task>());
+            }
+        }
         std::mutex mtx;
         std::condition_variable cond;
         bool isClosed;
-        std::queue<std::function<void()>> tasks;
+        std::atomic<int> sleeping;      // 正在 cond 上等待的线程数
+        std::atomic<size_t> injected;   // 全局队列长度，供自旋时无锁探测
+        TaskRing tasks;                 // 全局注入队列
+        std::vector<std::unique_ptr<WorkStealingDeque<Task>>> queues; // 各工作线程的本地队列
+    };
+
+    struct WorkerContext {
+        Pool* pool;
+        size_t index;
     };
+
+    static WorkerContext& Context_() {
+        static thread_local WorkerContext ctx = { nullptr, 0 };
+        return ctx;
+    }
+
+    static void CpuRelax_() {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#else
+        std::this_thread::yield();
+#endif
+    }
+
+    static bool Steal_(Pool& pool, size_t index, Task& task) {
+        size_t n = pool.queues.size();
+        for(size_t i = 1; i < n; i++) {
+            if(pool.queues[(index + i) % n]->Steal(task)) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /* 从全局队列取一个任务，并按线程数均分搬一批到本地队列，减少全局锁的争用 */
+    static bool TakeGlobal_(Pool& pool, size_t index, Task& task) {
+        if(pool.injected.load(std::memory_order_relaxed) == 0) {
+            return false;
+        }
+        std::lock_guard<std::mutex> locker(pool.mtx);
+        if(pool.tasks.empty()) {
+            return false;
+        }
+        task = std::move(pool.tasks.Front());
+        pool.tasks.Pop();
+        size_t batch = pool.tasks.size() / pool.queues.size();
+        if(batch > MAX_BATCH) { batch = MAX_BATCH; }
+        for(size_t i = 0; i < batch; i++) {
+            if(!pool.queues[index]->Push(std::move(pool.tasks.Front()))) {
+                break;
+            }
+            pool.tasks.Pop();
+        }
+        pool.injected.store(pool.tasks.size(), std::memory_order_relaxed);
+        return true;
+    }
+
+    static bool HasWork_(Pool& pool) {
+        if(pool.injected.load(std::memory_order_relaxed) > 0) {
+            return true;
+        }
+        for(auto& queue: pool.queues) {
+            if(!queue->Empty()) { return true; }
+        }
+        return false;
+    }
+
+    static void Worker_(std::shared_ptr<Pool> pool, size_t index) {
+        Context_() = { pool.get(), index };
+        WorkStealingDeque<Task>& local = *pool->queues[index];
+        Task task;
+        while(true) {
+            if(local.Pop(task) || Steal_(*pool, index, task) || TakeGlobal_(*pool, index, task)) {
+                task();
+                continue;
+            }
+            /* 短暂自旋：任务往往马上就到，避免睡眠/唤醒的系统调用开销 */
+            bool found = false;
+            for(int spin = 0; spin < SPIN_COUNT && !found; spin++) {
+                CpuRelax_();
+                found = HasWork_(*pool);
+            }
+            if(found) { continue; }
+
+            std::unique_lock<std::mutex> locker(pool->mtx);
+            if(!pool->tasks.empty()) { continue; }
+            if(pool->isClosed) { break; }
+            pool->sleeping.fetch_add(1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+            /* 登记睡眠后复查各本地队列：工作线程本地提交不经过 mtx，可能正好在自旋结束后入队 */
+            if(!HasWork_(*pool)) {
+                pool->cond.wait(locker); // 所有队列为空且线程池未关闭，释放锁等待条件变量通知
+            }
+            pool->sleeping.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
     std::shared_ptr<Pool> pool_;
 };
 
 
-#endif //THREADPOOL_H
\ No newline at end of file
+#endif //THREADPOOL_H
@@ -0,0 +1,78 @@
+#include "usercache.h"
+
+using namespace std;
+
+UserCache* UserCache::Instance() {
+    static UserCache cache;
+    return &cache;
+}
+
+UserCache::Shard& UserCache::Shard_(const string& name) {
+    return shards_[hash<string>()(name) % SHARDS];
+}
+
+void UserCache::Digest_(const char* pwd, size_t len, unsigned char* digest) {
+    unsigned int mdLen = 0;
+    EVP_Digest(pwd, len, digest, &mdLen, EVP_sha256(), nullptr);
+    assert(mdLen == 32);
+}
+
+UserCache::Result UserCache::Check(const string& name, const string& pwd) {
+    unsigned char digest[32];
+    Digest_(pwd.data(), pwd.size(), digest); // 锁外计算
+    Shard& shard = Shard_(name);
+    lock_guard<mutex> locker(shard.mtx);
+    auto it = shard.users.find(name);
+    if(it == shard.users.end()) {
+        return MISS;
+    }
+    if(it->second.expires <= Clock::now()) {
+        shard.users.erase(it);
+        return MISS;
+    }
+    if(!it->second.exists) {
+        return NO_USER;
+    }
+    return CRYPTO_memcmp(digest, it->second.digest, sizeof(digest)) == 0 ? MATCH : MISMATCH;
+}
+
+void UserCache::Put(const string& name, const char* pwd, size_t len) {
+    Entry entry;
+    entry.exists = true;
+    Digest_(pwd, len, entry.digest);
+    entry.expires = Clock::now() + chrono::seconds(POSITIVE_TTL_S);
+    Insert_(name, std::move(entry));
+}
+
+void UserCache::PutAbsent(const string& name) {
+    Entry entry;
+    entry.exists = false;
+    entry.expires = Clock::now() + chrono::seconds(NEGATIVE_TTL_S);
+    Insert_(name, std::move(entry));
+}
+
+void UserCache::Erase(const string& name) {
+    Shard& shard = Shard_(name);
+    lock_guard<mutex> locker(shard.mtx);
+    shard.users.erase(name);
+}
+
+void UserCache::Insert_(const string& name, Entry&& entry) {
+    Shard& shard = Shard_(name);
+    lock_guard<mutex> locker(shard.mtx);
+    auto it = shard.users.find(name);
+    if(it != shard.users.end()) {
+        it->second = std::move(entry);
+        return;
+    }
+    if(shard.users.size() >= SHARD_CAPACITY) {
+        auto now = Clock::now();
+        for(auto iter = shard.users.begin(); iter != shard.users.end(); ) {
+            iter = iter->second.expires <= now ? shard.users.erase(iter) : std::next(iter);
+        }
+        if(shard.users.size() >= SHARD_CAPACITY) {
+            shard.users.erase(shard.users.begin());
+        }
+    }
+    shard.users.emplace(name, std::move(entry));
+}
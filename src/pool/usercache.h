@@ -0,0 +1,64 @@
+#ifndef USERCACHE_H
+#define USERCACHE_H
+
+#include <unordered_map>
+#include <string>
+#include <mutex>
+#include <chrono>
+#include <functional>   // std::hash
+#include <openssl/evp.h>    // SHA-256
+#include <openssl/crypto.h> // CRYPTO_memcmp
+
+#include "../log/log.h"
+
+/* 用户记录缓存（单例）
+   数据库查询过的用户名连同密码的 SHA-256 保存在内存中，重复登录直接比对，不再访问数据库；
+   不存在的用户名也缓存一段较短的时间（负缓存），反复尝试未知用户名不会打到数据库。
+   按用户名哈希分片，每个分片一把锁，并发登录很少互相等待。
+   数据库之外改动的密码在 POSITIVE_TTL_S 内可能仍按旧值校验 */
+class UserCache {
+public:
+    enum Result {
+        MISS,      // 没有缓存（或已过期），需要查询数据库
+        NO_USER,   // 用户名不存在
+        MATCH,     // 用户存在，密码一致
+        MISMATCH,  // 用户存在，密码不一致
+    };
+
+    static UserCache* Instance();
+
+    Result Check(const std::string& name, const std::string& pwd);
+
+    void Put(const std::string& name, const char* pwd, size_t len); // 数据库中的用户记录
+    void PutAbsent(const std::string& name);                         // 数据库中没有这个用户名
+    void Erase(const std::string& name);
+
+private:
+    UserCache() = default;
+
+    typedef std::chrono::steady_clock Clock;
+
+    struct Entry {
+        bool exists;
+        unsigned char digest[32];
+        Clock::time_point expires;
+    };
+
+    struct Shard {
+        std::mutex mtx;
+        std::unordered_map<std::string, Entry> users;
+    };
+
+    Shard& Shard_(const std::string& name);
+    static void Digest_(const char* pwd, size_t len, unsigned char* digest);
+    void Insert_(const std::string& name, Entry&& entry);
+
+    static const int SHARDS = 16;
+    static const size_t SHARD_CAPACITY = 8192; // 分片满时先清掉过期的，仍满则随意淘汰一个
+    static const int POSITIVE_TTL_S = 300;
+    static const int NEGATIVE_TTL_S = 30;
+
+    Shard shards_[SHARDS];
+};
+
+#endif //USERCACHE_H
@@ -0,0 +1,3 @@
+#include "userstore.h"
+
+std::atomic<UserStore*> UserStore::current_(nullptr);
@@ -0,0 +1,32 @@
+#ifndef USERSTORE_H
+#define USERSTORE_H
+
+#include <string>
+#include <functional>
+#include <atomic>
+#include <assert.h>
+
+/* 用户存储后端：登录、注册通过这里校验，HttpRequest 不再依赖具体的数据库。
+   启动时选定一个后端：SqlAsync（MySQL）或 LocalUserStore（本地文件） */
+class UserStore {
+public:
+    virtual ~UserStore() = default;
+
+    /* 校验用户名与密码；isLogin 为 false 时注册：用户名未被使用则保存。
+       done(结果) 恰好调用一次，可能在调用线程中直接调用，也可能在后端自己的线程中调用，不能阻塞 */
+    virtual void Verify(const std::string& name, const std::string& pwd, bool isLogin, std::function<void(bool)> done) = 0;
+    virtual void Close() = 0; // 未完成的校验以失败回调
+    virtual const char* Name() const = 0;
+
+    static UserStore* Instance() {
+        UserStore* store = current_.load(std::memory_order_acquire);
+        assert(store);
+        return store;
+    }
+    static void Use(UserStore* store) { current_.store(store, std::memory_order_release); }
+
+private:
+    static std::atomic<UserStore*> current_;
+};
+
+#endif //USERSTORE_H
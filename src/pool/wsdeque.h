@@ -0,0 +1,92 @@
+#ifndef WSDEQUE_H
+#define WSDEQUE_H
+
+#include <atomic>
+#include <vector>
+#include <type_traits>
+#include <utility>
+#include <assert.h>
+
+/* Chase-Lev 工作窃取双端队列（固定容量）
+   所有者线程在 bottom 端 Push/Pop（LIFO，缓存友好），其他线程在 top 端 Steal（FIFO），全程无锁。
+   窃取时对元素的读取可能与所有者的写入并发，由 top 上的 CAS 判定是否有效，因此要求 T 可平凡复制 */
+template<class T>
+class WorkStealingDeque {
+    static_assert(std::is_trivially_copyable<T>::value, "WorkStealingDeque element must be trivially copyable");
+public:
+    explicit WorkStealingDeque(size_t capacity = 1024);
+
+    bool Push(T&& item); // 仅所有者调用，满时返回 false（item 保持不变）
+
+    bool Pop(T& item); // 仅所有者调用
+
+    bool Steal(T& item); // 任意线程调用
+
+    bool Empty() const;
+
+private:
+    /* top_ 与 bottom_ 分处不同 cache line，避免窃取者与所有者伪共享（C++14 的 new 不支持 alignas(64)，手动填充） */
+    std::atomic<int64_t> top_;
+    char pad0_[64 - sizeof(std::atomic<int64_t>)];
+    std::atomic<int64_t> bottom_;
+    char pad1_[64 - sizeof(std::atomic<int64_t>)];
+    std::vector<T> buffer_;
+    int64_t mask_;
+};
+
+template<class T>
+WorkStealingDeque<T>::WorkStealingDeque(size_t capacity): top_(0), pad0_(), bottom_(0), pad1_(), buffer_(capacity), mask_(capacity - 1) {
+    assert(capacity > 0 && (capacity & (capacity - 1)) == 0); // 容量必须是 2 的幂
+}
+
+template<class T>
+bool WorkStealingDeque<T>::Push(T&& item) {
+    int64_t b = bottom_.load(std::memory_order_relaxed);
+    int64_t t = top_.load(std::memory_order_acquire);
+    if(b - t > mask_) {
+        return false;
+    }
+    buffer_[b & mask_] = std::move(item);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom_.store(b + 1, std::memory_order_relaxed);
+    return true;
+}
+
+template<class T>
+bool WorkStealingDeque<T>::Pop(T& item) {
+    int64_t b = bottom_.load(std::memory_order_relaxed) - 1;
+    bottom_.store(b, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t t = top_.load(std::memory_order_relaxed);
+    if(t > b) { // 队列为空
+        bottom_.store(b + 1, std::memory_order_relaxed);
+        return false;
+    }
+    item = std::move(buffer_[b & mask_]);
+    if(t == b) {
+        /* 只剩最后一个元素，与窃取者竞争 */
+        bool won = top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+        bottom_.store(b + 1, std::memory_order_relaxed);
+        return won;
+    }
+    return true;
+}
+
+template<class T>
+bool WorkStealingDeque<T>::Steal(T& item) {
+    int64_t t = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t b = bottom_.load(std::memory_order_acquire);
+    if(t >= b) {
+        return false;
+    }
+    item = std::move(buffer_[t & mask_]); // T 可平凡复制，move 即按位复制，不会改动队列中的元素
+    return top_.compare_exchange_strong(t, t + 1, std::memory_order_seq_cst, std::memory_order_relaxed);
+}
+
+template<class T>
+bool WorkStealingDeque<T>::Empty() const {
+    return bottom_.load(std::memory_order_relaxed) <= top_.load(std::memory_order_relaxed);
+}
+
+#endif // WSDEQUE_H
@@ -0,0 +1,91 @@
+#include "connslab.h"
+
+ConnSlab::ConnSlab(int maxFd): maxFd_(maxFd) {
+    assert(maxFd_ > 0);
+    /* C++14 的 new 不保证超过 16 字节的对齐，手动按 cache line 分配 */
+    slots_ = static_cast<Slot*>(aligned_alloc(alignof(Slot), sizeof(Slot) * maxFd_));
+    assert(slots_);
+    for(int i = 0; i < maxFd_; i++) {
+        new (&slots_[i]) Slot();
+        slots_[i].state.store(0, std::memory_order_relaxed);
+    }
+}
+
+ConnSlab::~ConnSlab() {
+    for(int i = 0; i < maxFd_; i++) {
+        slots_[i].~Slot();
+    }
+    free(slots_);
+}
+
+ConnHandle ConnSlab::Open(int fd) {
+    assert(fd >= 0 && fd < maxFd_);
+    Slot& slot = slots_[fd];
+    if(!slot.conn) {
+        slot.conn.reset(new HttpConn());
+    }
+    /* 旧连接关闭时已经换代，且 fd 被 close 后才可能被复用，此时槽位不会处于 BUSY */
+    uint32_t gen = (slot.state.load(std::memory_order_relaxed) >> GEN_SHIFT) + 1;
+    slot.state.store(gen << GEN_SHIFT, std::memory_order_release);
+    return ConnHandle{fd, gen};
+}
+
+HttpConn* ConnSlab::Get(const ConnHandle& handle) {
+    assert(handle.fd >= 0 && handle.fd < maxFd_);
+    Slot& slot = slots_[handle.fd];
+    if((slot.state.load(std::memory_order_acquire) >> GEN_SHIFT) != handle.gen) {
+        return nullptr;
+    }
+    return slot.conn.get();
+}
+
+ConnHandle ConnSlab::Handle(int fd) const {
+    assert(fd >= 0 && fd < maxFd_);
+    return ConnHandle{fd, slots_[fd].state.load(std::memory_order_acquire) >> GEN_SHIFT};
+}
+
+HttpConn* ConnSlab::Lock(const ConnHandle& handle) {
+    assert(handle.fd >= 0 && handle.fd < maxFd_);
+    Slot& slot = slots_[handle.fd];
+    uint32_t idle = handle.gen << GEN_SHIFT;
+    for(int spin = 0; ; spin++) {
+        uint32_t state = slot.state.load(std::memory_order_acquire);
+        if((state >> GEN_SHIFT) != handle.gen || (state & EXPIRED)) {
+            return nullptr;
+        }
+        /* 上一个工作线程已重新注册 EPOLLONESHOT、尚未 Unlock，稍等即可 */
+        if(state & BUSY) {
+            if(spin > 64) { std::this_thread::yield(); }
+            continue;
+        }
+        if(slot.state.compare_exchange_weak(idle, idle | BUSY, std::memory_order_acq_rel)) {
+            return slot.conn.get();
+        }
+        idle = handle.gen << GEN_SHIFT;
+    }
+}
+
+bool ConnSlab::Unlock(const ConnHandle& handle) {
+    assert(handle.fd >= 0 && handle.fd < maxFd_);
+    uint32_t busy = (handle.gen << GEN_SHIFT) | BUSY;
+    return slots_[handle.fd].state.compare_exchange_strong(busy, handle.gen << GEN_SHIFT, std::memory_order_acq_rel);
+}
+
+bool ConnSlab::Retire(const ConnHandle& handle, bool locked) {
+    assert(handle.fd >= 0 && handle.fd < maxFd_);
+    Slot& slot = slots_[handle.fd];
+    uint32_t next = (handle.gen + 1) << GEN_SHIFT;
+    uint32_t state = slot.state.load(std::memory_order_acquire);
+    while((state >> GEN_SHIFT) == handle.gen) {
+        if(!locked && (state & BUSY)) {
+            /* 工作线程正在处理：只做标记，由它在 Unlock 时负责关闭 */
+            if(slot.state.compare_exchange_weak(state, state | EXPIRED, std::memory_order_acq_rel)) {
+                return false;
+            }
+        }
+        else if(slot.state.compare_exchange_weak(state, next, std::memory_order_acq_rel)) {
+            return true;
+        }
+    }
+    return false;
+}
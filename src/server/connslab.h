@@ -0,0 +1,60 @@
+#ifndef CONNSLAB_H
+#define CONNSLAB_H
+
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <new>       // placement new
+#include <stdlib.h>  // aligned_alloc
+#include <assert.h>
+
+#include "../http/httpconn.h"
+
+/* 连接句柄：定时器回调、线程池任务只持有 (fd, gen)，fd 被复用后 gen 不一致，回调直接作废 */
+struct ConnHandle {
+    int fd;
+    uint32_t gen;
+};
+
+/* 以 fd 为下标的连接表，取代 unordered_map<int, HttpConn>
+   槽位按 cache line 对齐并在启动时一次性分配，HttpConn 对象首次使用时创建、此后随 fd 复用；
+   每个槽位一个原子状态字：高位为代数 gen，低两位为 BUSY（工作线程正在处理）和 EXPIRED（处理期间被要求关闭），
+   超时关闭与工作线程之间靠 CAS 协调，不加锁 */
+class ConnSlab {
+public:
+    explicit ConnSlab(int maxFd);
+
+    ~ConnSlab();
+
+    ConnHandle Open(int fd); // 新连接：换代并返回句柄
+
+    HttpConn* Get(int fd) { // 事件分发：fd 直接作为下标
+        assert(fd >= 0 && fd < maxFd_);
+        return slots_[fd].conn.get();
+    }
+
+    HttpConn* Get(const ConnHandle& handle); // 代数不一致（连接已关闭或 fd 已复用）返回 nullptr
+
+    ConnHandle Handle(int fd) const;
+
+    HttpConn* Lock(const ConnHandle& handle); // 工作线程独占连接，过期返回 nullptr
+
+    bool Unlock(const ConnHandle& handle); // 返回 false：处理期间被要求关闭，由调用者负责关闭
+
+    bool Retire(const ConnHandle& handle, bool locked = false); // 换代使句柄失效，成功者负责关闭连接
+
+private:
+    static const uint32_t BUSY = 1;
+    static const uint32_t EXPIRED = 2;
+    static const int GEN_SHIFT = 2;
+
+    struct alignas(64) Slot {
+        std::atomic<uint32_t> state;
+        std::unique_ptr<HttpConn> conn;
+    };
+
+    int maxFd_;
+    Slot* slots_;
+};
+
+#endif //CONNSLAB_H
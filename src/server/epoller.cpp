@@ -1,15 +1,26 @@
 #include "epoller.h"
 
-Epoller::Epoller(int maxEvent):epollFd_(epoll_create(512)), events_(maxEvent){
-    assert(epollFd_ >= 0 && events_.size() > 0);
+Epoller::Epoller(int maxEvent, bool useUring):epollFd_(-1), events_(maxEvent){
+    assert(events_.size() > 0);
+    if(useUring) {
+        uring_.reset(new UringPoller(maxEvent));
+        if(!uring_->IsOpen()) {
+            uring_.reset(); // 内核过旧或禁用了 io_uring，回退到 epoll
+        }
+    }
+    if(!uring_) {
+        epollFd_ = epoll_create(512);
+        assert(epollFd_ >= 0);
+    }
 }
 
 Epoller::~Epoller() {
-    close(epollFd_);
+    if(epollFd_ >= 0) { close(epollFd_); }
 }
 
 bool Epoller::AddFd(int fd, uint32_t events) {
     if(fd < 0) return false;
+    if(uring_) return uring_->AddFd(fd, events);
     epoll_event ev = {0};
     ev.data.fd = fd;
     ev.events = events;
@@ -18,6 +29,7 @@ bool Epoller::AddFd(int fd, uint32_t events) {
 
 bool Epoller::ModFd(int fd, uint32_t events) {
     if(fd < 0) return false;
+    if(uring_) return uring_->ModFd(fd, events);
     epoll_event ev = {0};
     ev.data.fd = fd;
     ev.events = events;
@@ -26,11 +38,13 @@ bool Epoller::ModFd(int fd, uint32_t events) {
 
 bool Epoller::DelFd(int fd) {
     if(fd < 0) return false;
+    if(uring_) return uring_->DelFd(fd);
     epoll_event ev = {0};
     return 0 == epoll_ctl(epollFd_, EPOLL_CTL_DEL, fd, &ev);
 }
 
 int Epoller::Wait(int timeoutMs) {
+    if(uring_) return uring_->Wait(events_, completions_, timeoutMs);
     return epoll_wait(epollFd_, &events_[0], static_cast<int>(events_.size()), timeoutMs);
 }
 
@@ -42,4 +56,32 @@ int Epoller::GetEventFd(size_t i) const {
 uint32_t Epoller::GetEvents(size_t i) const {
     assert(i < events_.size() && i >= 0);
     return events_[i].events;
-}
\ No newline at end of file
+}
+bool Epoller::EnableCompletion(unsigned bufCount, unsigned bufSize) {
+    return uring_ && uring_->EnableCompletion(bufCount, bufSize);
+}
+
+bool Epoller::Accept(int listenFd) {
+    return IsCompletion() && uring_->Accept(listenFd);
+}
+
+bool Epoller::Recv(int fd) {
+    return IsCompletion() && uring_->Recv(fd);
+}
+
+bool Epoller::Send(int fd, struct msghdr* msgs, int n, int flags) {
+    return IsCompletion() && uring_->Send(fd, msgs, n, flags);
+}
+
+bool Epoller::Cancel(int fd) {
+    return IsCompletion() && uring_->Cancel(fd);
+}
+
+void Epoller::Recycle(const UringCompletion& done) {
+    if(done.data) { uring_->Recycle(done.bid); }
+}
+
+const UringCompletion& Epoller::GetCompletion(size_t i) const {
+    assert(i < completions_.size());
+    return completions_[i];
+}
@@ -6,11 +6,15 @@
 #include <unistd.h> // close()
 #include <assert.h> // close()
 #include <vector>
+#include <memory>
 #include <errno.h>
 
+#include "uringpoller.h"
+
 class Epoller {
 public:
-    explicit Epoller(int maxEvent = 1024);
+    /* useUring：使用 io_uring 后端，内核不支持时自动回退到 epoll */
+    explicit Epoller(int maxEvent = 1024, bool useUring = false);
 
     ~Epoller();
 
@@ -25,11 +29,36 @@ public:
     int GetEventFd(size_t i) const;
 
     uint32_t GetEvents(size_t i) const;
-        
+
+    bool IsUring() const { return static_cast<bool>(uring_); }
+
+    /* io_uring 完成模式（见 UringPoller）：Wait() 之后除了就绪事件，还要处理 GetCompletion() 给出的已完成的操作；
+       bufCount 个 bufSize 字节的缓冲区供 Recv() 使用，为 0 时只用 Accept()。epoll 后端或内核不支持时返回 false */
+    bool EnableCompletion(unsigned bufCount = 0, unsigned bufSize = 0);
+
+    bool IsCompletion() const { return uring_ && uring_->IsCompletion(); }
+
+    bool Accept(int listenFd);
+
+    bool Recv(int fd);
+
+    bool Send(int fd, struct msghdr* msgs, int n, int flags = 0);
+
+    bool Cancel(int fd);
+
+    void Recycle(const UringCompletion& done); // RECV 的数据处理完后归还缓冲区
+
+    size_t GetCompletionCount() const { return completions_.size(); }
+
+    const UringCompletion& GetCompletion(size_t i) const;
+
 private:
     int epollFd_;
 
     std::vector<struct epoll_event> events_;    
+    std::vector<UringCompletion> completions_;
+
+    std::unique_ptr<UringPoller> uring_; // 非空时所有操作转交 io_uring 后端
 };
 
-#endif //EPOLLER_H
\ No newline at end of file
+#endif //EPOLLER_H
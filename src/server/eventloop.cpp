@@ -0,0 +1,430 @@
+#include "eventloop.h"
+
+using namespace std;
+
+EventLoop::EventLoop(int timeoutMS, uint32_t connEvent, ConnSlab* users, bool useUring):
+            timeoutMS_(timeoutMS), connEvent_(connEvent), listenFd_(-1), listenEvent_(0), isClose_(false),
+            timer_(new TimingWheel()), epoller_(new Epoller(1024, useUring)), users_(users), completion_(false) {
+    assert(users_);
+    completion_ = epoller_->EnableCompletion(URING_BUFS, URING_BUF_SIZE);
+    wakeupFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    assert(wakeupFd_ >= 0);
+    epoller_->AddFd(wakeupFd_, EPOLLIN);
+}
+
+EventLoop::~EventLoop() {
+    Stop();
+    close(wakeupFd_);
+    if(listenFd_ >= 0) { close(listenFd_); }
+}
+
+void EventLoop::AddListener(int listenFd, uint32_t listenEvent) {
+    assert(listenFd_ < 0 && listenFd >= 0);
+    listenFd_ = listenFd;
+    listenEvent_ = listenEvent;
+    if(!completion_ || !epoller_->Accept(listenFd_)) {
+        epoller_->AddFd(listenFd_, listenEvent_ | EPOLLIN);
+    }
+}
+
+void EventLoop::Start(int cpu) {
+    thread_ = std::thread(&EventLoop::Loop_, this);
+    BindCpu_(thread_.native_handle(), cpu);
+}
+
+void EventLoop::Run(int cpu) {
+    BindCpu_(pthread_self(), cpu);
+    Loop_();
+}
+
+void EventLoop::BindCpu_(pthread_t thread, int cpu) {
+    if(cpu < 0) { return; }
+    cpu_set_t cpuset;
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu % std::thread::hardware_concurrency(), &cpuset);
+    if(pthread_setaffinity_np(thread, sizeof(cpuset), &cpuset) != 0) {
+        LOG_WARN("Bind event loop to cpu %d error!", cpu);
+    }
+}
+
+void EventLoop::Stop() {
+    isClose_ = true;
+    Wakeup_();
+    if(thread_.joinable()) {
+        thread_.join();
+    }
+}
+
+void EventLoop::QueueConn(int fd, const sockaddr_in& addr) {
+    {
+        lock_guard<mutex> locker(mtx_);
+        pending_.emplace_back(fd, addr);
+    }
+    Wakeup_();
+}
+
+void EventLoop::QueueTask(function<void()> task) {
+    {
+        lock_guard<mutex> locker(mtx_);
+        tasks_.push_back(std::move(task));
+    }
+    Wakeup_();
+}
+
+void EventLoop::Wakeup_() {
+    uint64_t one = 1;
+    ssize_t n = ::write(wakeupFd_, &one, sizeof(one));
+    (void)n;
+}
+
+void EventLoop::HandleWakeup_() {
+    uint64_t cnt = 0;
+    ssize_t n = ::read(wakeupFd_, &cnt, sizeof(cnt));
+    (void)n;
+    vector<pair<int, sockaddr_in>> conns;
+    vector<function<void()>> tasks;
+    {
+        lock_guard<mutex> locker(mtx_);
+        conns.swap(pending_);
+        tasks.swap(tasks_);
+    }
+    for(auto& conn: conns) {
+        AddClient_(conn.first, conn.second);
+    }
+    for(auto& task: tasks) {
+        task();
+    }
+}
+
+void EventLoop::Loop_() {
+    int timeMS = -1;
+    while(!isClose_) {
+        if(timeoutMS_ > 0) {
+            timeMS = timer_->GetNextTick();
+        }
+        int eventCnt = epoller_->Wait(timeMS);
+        for(int i = 0; i < eventCnt; i++) {
+            int fd = epoller_->GetEventFd(i);
+            uint32_t event = epoller_->GetEvents(i);
+            if(fd == listenFd_) {
+                DealListen_();
+            }
+            else if(fd == wakeupFd_) {
+                HandleWakeup_();
+            }
+            else if(event & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
+                CloseConn_(users_->Handle(fd));
+            }
+            else if(event & EPOLLIN) {
+                DealRead_(users_->Handle(fd));
+            }
+            else if(event & EPOLLOUT) {
+                DealWrite_(users_->Handle(fd));
+            } else {
+                LOG_ERROR("Unexpected event");
+            }
+        }
+        for(size_t i = 0; i < epoller_->GetCompletionCount(); i++) {
+            const UringCompletion& done = epoller_->GetCompletion(i);
+            if(done.op == UringCompletion::ACCEPT) {
+                OnAccept_(done);
+            }
+            else if(done.op == UringCompletion::RECV) {
+                OnRecv_(done);
+            }
+            else {
+                OnSend_(done);
+            }
+        }
+    }
+}
+
+void EventLoop::DealListen_() {
+    struct sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    do {
+        int fd = accept4(listenFd_, (struct sockaddr *)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if(fd <= 0 || !Accepted_(fd, addr)) {
+            return;
+        }
+    } while(listenEvent_ & EPOLLET);
+}
+
+/* 新连接：连接数已满时回复后关闭，返回 false */
+bool EventLoop::Accepted_(int fd, const sockaddr_in& addr) {
+    if(HttpConn::userCount >= MAX_FD || fd >= MAX_FD) {
+        send(fd, "Server busy!", 12, 0);
+        close(fd);
+        LOG_WARN("Clients is full!");
+        return false;
+    }
+    AddClient_(fd, addr);
+    return true;
+}
+
+void EventLoop::AddClient_(int fd, sockaddr_in addr) {
+    assert(fd > 0);
+    ConnHandle handle = users_->Open(fd);
+    users_->Get(fd)->init(fd, addr);
+    users_->Get(fd)->SetResume([this, handle] { QueueTask([this, handle] { Resume_(handle); }); });
+    if(timeoutMS_ > 0) {
+        timer_->add(fd, timeoutMS_, std::bind(&EventLoop::CloseConn_, this, handle)); // 连接已关闭时句柄过期，回调为空操作
+    }
+    if(completion_) {
+        UringConn& conn = Uring_(fd);
+        conn.polling = false;
+        StartRecv_(fd);
+        return;
+    }
+    epoller_->AddFd(fd, EPOLLIN | connEvent_);
+}
+
+void EventLoop::CloseConn_(ConnHandle handle) {
+    if(!users_->Retire(handle)) {
+        return;
+    }
+    timer_->cancel(handle.fd); // 超时回调里调用时结点已摘除，为空操作
+    HttpConn* client = users_->Get(handle.fd);
+    LOG_INFO("Client[%d] quit!", client->GetFd());
+    epoller_->DelFd(client->GetFd());
+    if(completion_) {
+        UringConn& conn = Uring_(handle.fd);
+        conn.polling = false;
+        if(conn.recving || conn.sending > 0) {
+            conn.closing = true; // 取消未完成的读写，全部结束后由 FinishClose_ 关闭
+            epoller_->Cancel(handle.fd);
+            return;
+        }
+    }
+    client->Close();
+}
+
+void EventLoop::ExtentTime_(int fd) {
+    if(timeoutMS_ > 0) { timer_->adjust(fd, timeoutMS_); }
+}
+
+/* 读事件：读入 -> 解析 -> 直接尝试写出，只有写不完时才改为监听 EPOLLOUT */
+void EventLoop::DealRead_(ConnHandle handle) {
+    HttpConn* client = users_->Get(handle.fd);
+    ExtentTime_(handle.fd);
+    int readErrno = 0;
+    ssize_t ret = client->read(&readErrno);
+    if(ret <= 0 && readErrno != EAGAIN) {
+        CloseConn_(handle);
+        return;
+    }
+    int state = 0;
+    while(state == 0 && client->process()) { // 请求不完整时 process() 返回 false，继续监听读
+        state = Flush_(client);
+    }
+    if(state > 0) {
+        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
+    } else if(state < 0) {
+        CloseConn_(handle);
+    } else if(client->IsPaused()) {
+        epoller_->ModFd(client->GetFd(), connEvent_); // 等待磁盘任务，暂不读，完成后由 Resume_ 恢复
+    }
+}
+
+void EventLoop::DealWrite_(ConnHandle handle) {
+    HttpConn* client = users_->Get(handle.fd);
+    ExtentTime_(handle.fd);
+    if(completion_) {
+        Send_(handle, client); // sendfile 等到了可写
+        return;
+    }
+    int state = Flush_(client);
+    while(state == 0 && client->process()) {
+        state = Flush_(client);
+    }
+    if(state == 0) {
+        epoller_->ModFd(client->GetFd(), connEvent_ | (client->IsPaused() ? 0 : EPOLLIN)); // 发送完毕，恢复监听读
+    } else if(state < 0) {
+        CloseConn_(handle);
+    }
+}
+
+/* 磁盘任务完成：只处理暂停中的连接；还有响应没写完的，等可写事件时再处理 */
+void EventLoop::Resume_(ConnHandle handle) {
+    HttpConn* client = users_->Get(handle);
+    if(!client || !client->IsPaused() || client->ToWriteBytes() > 0) {
+        return;
+    }
+    ExtentTime_(handle.fd);
+    if(completion_) {
+        Process_(handle, client);
+        return;
+    }
+    int state = 0;
+    while(state == 0 && client->process()) {
+        state = Flush_(client);
+    }
+    if(state > 0) {
+        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
+    } else if(state < 0) {
+        CloseConn_(handle);
+    } else {
+        epoller_->ModFd(client->GetFd(), connEvent_ | (client->IsPaused() ? 0 : EPOLLIN));
+    }
+}
+
+/* 返回值：0 发送完毕且保持连接；1 内核缓冲区满，等待可写；-1 需要关闭连接 */
+int EventLoop::Flush_(HttpConn* client) {
+    int writeErrno = 0;
+    ssize_t ret = client->write(&writeErrno);
+    if(client->ToWriteBytes() == 0) {
+        return client->IsKeepAlive() || client->Linger() ? 0 : -1; // 413 之后半关闭，排空对端的消息体再关闭
+    }
+    if(ret > 0 || writeErrno == EAGAIN) {
+        return 1;
+    }
+    return -1;
+}
+
+EventLoop::UringConn& EventLoop::Uring_(int fd) {
+    if(static_cast<size_t>(fd) >= uconns_.size()) {
+        uconns_.resize(fd + 1);
+    }
+    if(!uconns_[fd]) {
+        uconns_[fd].reset(new UringConn());
+    }
+    return *uconns_[fd];
+}
+
+void EventLoop::OnAccept_(const UringCompletion& done) {
+    if(done.res >= 0) {
+        struct sockaddr_in addr = {};
+        socklen_t len = sizeof(addr);
+        getpeername(done.res, (struct sockaddr *)&addr, &len); // 多次触发的 accept 不回填对端地址
+        Accepted_(done.res, addr);
+    } else {
+        LOG_WARN("Accept error: %d", -done.res);
+    }
+    if(!done.more) {
+        epoller_->Accept(listenFd_); // 出错或 CQ 溢出时内核结束了多次触发的 accept，重新提交
+    }
+}
+
+/* 连接空闲、等待请求时挂一个 RECV，数据到达前不占用缓冲区 */
+void EventLoop::StartRecv_(int fd) {
+    UringConn& conn = Uring_(fd);
+    if(!conn.recving && epoller_->Recv(fd)) {
+        conn.recving = true;
+    }
+}
+
+/* RECV 完成：数据从内核选用的缓冲区复制进读缓冲区，随即归还缓冲区 */
+void EventLoop::OnRecv_(const UringCompletion& done) {
+    UringConn& conn = Uring_(done.fd);
+    conn.recving = false;
+    HttpConn* client = users_->Get(done.fd);
+    bool ok = done.res > 0 && !conn.closing && client->Feed(done.data, done.res);
+    epoller_->Recycle(done);
+    if(conn.closing) {
+        FinishClose_(done.fd);
+        return;
+    }
+    ConnHandle handle = users_->Handle(done.fd);
+    if(done.res == -ENOBUFS) {
+        StartRecv_(done.fd); // 缓冲区暂时用完：本批完成事件处理完时都已归还，随下一次 Wait() 重新提交
+        return;
+    }
+    if(!ok) {
+        CloseConn_(handle); // 对端关闭、出错，或半关闭后丢弃过多
+        return;
+    }
+    ExtentTime_(done.fd);
+    Process_(handle, client);
+}
+
+/* 一组链接的 SENDMSG 各有一个完成事件，全部到齐后才记账：出错时链中其余的以 -ECANCELED 完成 */
+void EventLoop::OnSend_(const UringCompletion& done) {
+    UringConn& conn = Uring_(done.fd);
+    conn.sending--;
+    if(done.res < 0) {
+        conn.failed = true;
+    } else {
+        conn.sent += done.res;
+    }
+    if(conn.sending > 0) {
+        return;
+    }
+    if(conn.closing) {
+        FinishClose_(done.fd);
+        return;
+    }
+    ConnHandle handle = users_->Handle(done.fd);
+    if(conn.failed) {
+        CloseConn_(handle);
+        return;
+    }
+    HttpConn* client = users_->Get(done.fd);
+    client->Sent(conn.sent);
+    ExtentTime_(done.fd);
+    Send_(handle, client);
+}
+
+void EventLoop::Process_(ConnHandle handle, HttpConn* client) {
+    if(client->process()) {
+        Send_(handle, client);
+    } else if(!client->IsPaused()) {
+        StartRecv_(handle.fd); // 请求不完整，或半关闭后继续读入丢弃；等待磁盘任务时不读，由 Resume_ 恢复
+    }
+}
+
+/* 发送队列前部能由 iovec 覆盖的部分作为一组链接的 SENDMSG 提交，完成后由 OnSend_ 接着发送；队首走 sendfile 的片段直接发送。
+   队列发完后与 Flush_ 返回 0 时相同：处理流水线中剩余的请求，没有了再挂 RECV */
+void EventLoop::Send_(ConnHandle handle, HttpConn* client) {
+    UringConn& conn = Uring_(handle.fd);
+    do {
+        while(client->ToWriteBytes() > 0) {
+            bool beforeFile = false;
+            int iovCnt = client->Gather(conn.iov, URING_LINK * URING_IOV, &beforeFile);
+            if(iovCnt > 0) {
+                int n = 0;
+                for(int i = 0; i < iovCnt; i += URING_IOV, n++) {
+                    conn.msgs[n] = {};
+                    conn.msgs[n].msg_iov = conn.iov + i;
+                    conn.msgs[n].msg_iovlen = std::min(URING_IOV, iovCnt - i);
+                }
+                conn.sending = n;
+                conn.sent = 0;
+                conn.failed = false;
+                // 停在 sendfile 片段之前时带 MSG_MORE，响应头与随后的文件数据合并成满载的报文段
+                if(!epoller_->Send(handle.fd, conn.msgs, n, beforeFile ? MSG_MORE : 0)) {
+                    conn.sending = 0;
+                    CloseConn_(handle);
+                }
+                return;
+            }
+            int writeErrno = 0;
+            if(client->SendFile(&writeErrno) < 0) {
+                if(writeErrno != EAGAIN) {
+                    CloseConn_(handle);
+                } else if(conn.polling) {
+                    epoller_->ModFd(handle.fd, EPOLLOUT | EPOLLONESHOT); // 可写后由 DealWrite_ 继续
+                } else {
+                    conn.polling = epoller_->AddFd(handle.fd, EPOLLOUT | EPOLLONESHOT);
+                }
+                return;
+            }
+        }
+        if(!client->IsKeepAlive() && !client->Linger()) { // 413 之后半关闭，排空对端的消息体再关闭
+            CloseConn_(handle);
+            return;
+        }
+    } while(client->process());
+    if(!client->IsPaused()) {
+        StartRecv_(handle.fd);
+    }
+}
+
+/* 已关闭的连接在内核中的操作全部结束，才真正关闭 fd */
+void EventLoop::FinishClose_(int fd) {
+    UringConn& conn = Uring_(fd);
+    if(conn.recving || conn.sending > 0) {
+        return;
+    }
+    conn.closing = false;
+    users_->Get(fd)->Close();
+}
@@ -0,0 +1,116 @@
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <unistd.h>      // close()
+#include <assert.h>
+#include <errno.h>
+#include <sys/eventfd.h> // eventfd()
+#include <netinet/in.h>
+#include <sys/socket.h>  // accept4()
+#include <pthread.h>     // pthread_setaffinity_np()
+
+#include "epoller.h"
+#include "../log/log.h"
+#include "../timer/timingwheel.h"
+#include "../http/httpconn.h"
+#include "connslab.h"
+
+/* 子 Reactor：每个线程独占一个 Epoller、定时器和连接表
+   主 Reactor（WebServer::Start）只负责 accept，新连接通过 QueueConn() 交给某个 EventLoop（reuseport 模式下各 EventLoop 自己 accept），
+   此后该连接的读、解析、写全部在同一个线程内完成，不再经过线程池，也不需要 EPOLLONESHOT 反复注册。
+   io_uring 后端支持完成模式时（5.19），读写不再是“就绪通知 + 系统调用”：监听 socket 上是多次触发的 ACCEPT，
+   连接空闲时挂一个从 provided buffer ring 取缓冲区的 RECV，响应由一组链接的 SENDMSG 发出，
+   都在下一次 Wait() 的 io_uring_enter 中与其他连接的操作一并提交；只有走 sendfile 的大文件片段仍直接发送 */
+class EventLoop {
+public:
+    EventLoop(int timeoutMS, uint32_t connEvent, ConnSlab* users, bool useUring = false);
+
+    ~EventLoop();
+
+    void AddListener(int listenFd, uint32_t listenEvent); // reuseport 模式：本线程独占的监听 socket，需在 Start() 前调用
+
+    void Start(int cpu = -1); // 创建 loop 线程，cpu >= 0 时绑定到该核
+
+    void Run(int cpu = -1); // 在调用线程中运行 loop，直到 Stop()（reuseport 模式下由主线程承担一个子 Reactor）
+
+    void Stop();
+
+    void QueueConn(int fd, const sockaddr_in& addr); // 由 acceptor 线程调用，线程安全
+
+    void QueueTask(std::function<void()> task); // 在 loop 线程中执行 task，线程安全（磁盘 I/O 线程恢复连接）
+
+    bool IsCompletion() const { return completion_; }
+
+private:
+    void Loop_();
+    static void BindCpu_(pthread_t thread, int cpu);
+    void Wakeup_();
+    void HandleWakeup_();
+    void DealListen_();
+    bool Accepted_(int fd, const sockaddr_in& addr);
+
+    void AddClient_(int fd, sockaddr_in addr);
+    void CloseConn_(ConnHandle handle);
+    void ExtentTime_(int fd);
+
+    void DealRead_(ConnHandle handle);
+    void DealWrite_(ConnHandle handle);
+    void Resume_(ConnHandle handle);
+    int Flush_(HttpConn* client);
+
+    /* 完成模式 */
+    void OnAccept_(const UringCompletion& done);
+    void OnRecv_(const UringCompletion& done);
+    void OnSend_(const UringCompletion& done);
+    void StartRecv_(int fd);
+    void Process_(ConnHandle handle, HttpConn* client);
+    void Send_(ConnHandle handle, HttpConn* client);
+    void FinishClose_(int fd);
+
+    static const int URING_IOV = 64;    // 每个 SENDMSG 的 iovec 数
+    static const int URING_LINK = 4;    // 一次最多链接提交的 SENDMSG 数，流水线中的多个 multipart 响应可能超过一个 SENDMSG 的 iovec 上限
+    static const unsigned URING_BUFS = 256;            // provided buffer 个数，限制的是同一批完成的 RECV 数，而不是连接数
+    static const unsigned URING_BUF_SIZE = 16 * 1024;
+
+    /* 完成模式下一个连接在内核中未完成的操作：内核直接读写连接的缓冲区，连接关闭后要等这些操作结束才 close(fd)，
+       否则 fd 被新连接复用、HttpConn 重新初始化时内核可能仍在访问旧连接的数据 */
+    struct UringConn {
+        bool recving;
+        int sending;     // 本次提交中尚未完成的 SENDMSG 数
+        size_t sent;     // 本次提交中已写出的字节数
+        bool failed;
+        bool polling;    // 已注册等待可写（sendfile 遇到 EAGAIN）
+        bool closing;    // 已关闭，等待上述操作结束
+        struct iovec iov[URING_LINK * URING_IOV];
+        struct msghdr msgs[URING_LINK];
+    };
+    UringConn& Uring_(int fd);
+
+    int timeoutMS_;
+    uint32_t connEvent_;
+    static const int MAX_FD = 65536;
+
+    int listenFd_; // reuseport 模式下本线程的监听 socket，否则为 -1
+    uint32_t listenEvent_;
+    int wakeupFd_; // eventfd：通知 loop 线程有新连接或任务
+    std::atomic<bool> isClose_;
+
+    std::unique_ptr<TimingWheel> timer_;
+    std::unique_ptr<Epoller> epoller_;
+    ConnSlab* users_; // 全进程共享的连接表，本线程只访问自己的 fd
+    bool completion_;
+    std::vector<std::unique_ptr<UringConn>> uconns_; // 完成模式下以 fd 为下标，首次使用时分配
+
+    std::mutex mtx_;
+    std::vector<std::pair<int, sockaddr_in>> pending_; // acceptor 投递、尚未注册的新连接
+    std::vector<std::function<void()>> tasks_;
+    std::thread thread_;
+};
+
+#endif //EVENTLOOP_H
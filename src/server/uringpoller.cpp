@@ -0,0 +1,407 @@
+#include "uringpoller.h"
+
+using namespace std;
+
+UringPoller::UringPoller(unsigned entries):
+            ringFd_(-1), multishot_(false), waitSeq_(0), sqPtr_(MAP_FAILED), sqSize_(0), sqes_(nullptr), sqesSize_(0), pending_(0),
+            cqPtr_(MAP_FAILED), cqSize_(0), bufRing_(nullptr), bufRingSize_(0), bufBase_(nullptr), bufCount_(0), bufSize_(0) {
+    if(!Setup_(entries)) {
+        Release_();
+    }
+}
+
+UringPoller::~UringPoller() {
+    Release_();
+}
+
+bool UringPoller::Setup_(unsigned entries) {
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    p.flags = IORING_SETUP_CQSIZE;
+    p.cq_entries = entries * 2; // 重新注册、多次触发的 poll 会产生额外的完成事件，CQ 留出余量
+    ringFd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &p));
+    if(ringFd_ < 0) {
+        return false;
+    }
+    /* EXT_ARG：io_uring_enter 直接带超时（5.11）；POLL_32BITS：支持 EPOLLRDHUP 等高位事件（5.9） */
+    if(!(p.features & IORING_FEAT_EXT_ARG) || !(p.features & IORING_FEAT_POLL_32BITS)) {
+        return false;
+    }
+    /* 多次触发的 poll 与 RSRC_TAGS 同在 5.13 引入，内核没有单独的特性位 */
+    multishot_ = p.features & IORING_FEAT_RSRC_TAGS;
+
+    sqSize_ = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    cqSize_ = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if(p.features & IORING_FEAT_SINGLE_MMAP) {
+        sqSize_ = cqSize_ = max(sqSize_, cqSize_);
+    }
+    sqPtr_ = mmap(nullptr, sqSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQ_RING);
+    if(sqPtr_ == MAP_FAILED) {
+        return false;
+    }
+    if(p.features & IORING_FEAT_SINGLE_MMAP) {
+        cqPtr_ = sqPtr_;
+    } else {
+        cqPtr_ = mmap(nullptr, cqSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_CQ_RING);
+        if(cqPtr_ == MAP_FAILED) {
+            return false;
+        }
+    }
+    sqesSize_ = p.sq_entries * sizeof(struct io_uring_sqe);
+    void* sqes = mmap(nullptr, sqesSize_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ringFd_, IORING_OFF_SQES);
+    if(sqes == MAP_FAILED) {
+        return false;
+    }
+    sqes_ = static_cast<struct io_uring_sqe*>(sqes);
+
+    char* sq = static_cast<char*>(sqPtr_);
+    sqHead_ = reinterpret_cast<unsigned*>(sq + p.sq_off.head);
+    sqTail_ = reinterpret_cast<unsigned*>(sq + p.sq_off.tail);
+    sqMask_ = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_mask);
+    sqEntries_ = reinterpret_cast<unsigned*>(sq + p.sq_off.ring_entries);
+    sqArray_ = reinterpret_cast<unsigned*>(sq + p.sq_off.array);
+
+    char* cq = static_cast<char*>(cqPtr_);
+    cqHead_ = reinterpret_cast<unsigned*>(cq + p.cq_off.head);
+    cqTail_ = reinterpret_cast<unsigned*>(cq + p.cq_off.tail);
+    cqMask_ = reinterpret_cast<unsigned*>(cq + p.cq_off.ring_mask);
+    cqes_ = reinterpret_cast<struct io_uring_cqe*>(cq + p.cq_off.cqes);
+    return true;
+}
+
+void UringPoller::Release_() {
+    if(sqes_) {
+        munmap(sqes_, sqesSize_);
+        sqes_ = nullptr;
+    }
+    if(cqPtr_ != MAP_FAILED && cqPtr_ != sqPtr_) {
+        munmap(cqPtr_, cqSize_);
+    }
+    cqPtr_ = MAP_FAILED;
+    if(sqPtr_ != MAP_FAILED) {
+        munmap(sqPtr_, sqSize_);
+        sqPtr_ = MAP_FAILED;
+    }
+    if(ringFd_ >= 0) {
+        close(ringFd_);
+        ringFd_ = -1;
+    }
+    /* 关闭 ring 后内核不再引用 provided buffer */
+    if(bufBase_) {
+        munmap(bufBase_, static_cast<size_t>(bufCount_) * bufSize_);
+        bufBase_ = nullptr;
+    }
+    if(bufRing_) {
+        munmap(bufRing_, bufRingSize_);
+        bufRing_ = nullptr;
+    }
+}
+
+bool UringPoller::EnableCompletion(unsigned bufCount, unsigned bufSize) {
+    assert((bufCount & (bufCount - 1)) == 0 && (bufCount == 0 || bufSize > 0));
+    if(!IsOpen() || IsCompletion()) {
+        return IsCompletion();
+    }
+    lock_guard<mutex> locker(mtx_);
+    /* 只启用 Accept() 时也注册一个空的 ring：provided buffer ring 与多次触发的 accept 同在 5.19 引入，注册成功即说明内核支持 */
+    unsigned entries = bufCount > 0 ? bufCount : 1;
+    size_t ringSize = entries * sizeof(struct io_uring_buf);
+    void* ring = mmap(nullptr, ringSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0); // 须按页对齐
+    if(ring == MAP_FAILED) {
+        return false;
+    }
+    struct io_uring_buf_reg reg;
+    memset(&reg, 0, sizeof(reg));
+    reg.ring_addr = reinterpret_cast<uint64_t>(ring);
+    reg.ring_entries = entries;
+    reg.bgid = BUF_GROUP;
+    if(syscall(__NR_io_uring_register, ringFd_, IORING_REGISTER_PBUF_RING, &reg, 1) < 0) {
+        munmap(ring, ringSize);
+        return false;
+    }
+    void* bufs = nullptr;
+    if(bufCount > 0) {
+        bufs = mmap(nullptr, static_cast<size_t>(bufCount) * bufSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(bufs == MAP_FAILED) {
+            syscall(__NR_io_uring_register, ringFd_, IORING_UNREGISTER_PBUF_RING, &reg, 1);
+            munmap(ring, ringSize);
+            return false;
+        }
+    }
+    bufRing_ = static_cast<struct io_uring_buf_ring*>(ring);
+    bufRingSize_ = ringSize;
+    bufBase_ = static_cast<char*>(bufs);
+    bufCount_ = bufCount;
+    bufSize_ = bufSize;
+    for(unsigned i = 0; i < bufCount_; i++) {
+        Recycle(static_cast<uint16_t>(i));
+    }
+    return true;
+}
+
+/* 缓冲区放回 ring 的尾部，只在 Wait() 所在线程调用 */
+void UringPoller::Recycle(uint16_t bid) {
+    assert(bid < bufCount_);
+    unsigned short tail = bufRing_->tail;
+    /* 不用 bufRing_->bufs：C++ 中 __DECLARE_FLEX_ARRAY 的空结构体占 1 字节，bufs 被推后 8 字节，与内核的布局不一致 */
+    struct io_uring_buf* buf = reinterpret_cast<struct io_uring_buf*>(bufRing_) + (tail & (bufCount_ - 1));
+    buf->addr = reinterpret_cast<uint64_t>(bufBase_ + static_cast<size_t>(bid) * bufSize_);
+    buf->len = bufSize_;
+    buf->bid = bid;
+    __atomic_store_n(&bufRing_->tail, static_cast<unsigned short>(tail + 1), __ATOMIC_RELEASE);
+}
+
+int UringPoller::Enter_(unsigned toSubmit, unsigned minComplete, unsigned flags, void* arg, size_t argSize) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, ringFd_, toSubmit, minComplete, flags, arg, argSize));
+}
+
+UringPoller::FdEntry& UringPoller::Entry_(int fd) {
+    if(static_cast<size_t>(fd) >= fds_.size()) {
+        fds_.resize(fd + 1, FdEntry{0, 0, false, false, false, 0, 0});
+    }
+    return fds_[fd];
+}
+
+/* 保证 SQ 中还能放下 n 个 SQE：链接的一组 SQE 不能被拆到两次提交中，否则链在提交边界处断开 */
+void UringPoller::Reserve_(unsigned n) {
+    if(*sqTail_ - __atomic_load_n(sqHead_, __ATOMIC_ACQUIRE) + n > *sqEntries_) {
+        /* SQ 已满：先把已有的提交掉 */
+        Enter_(pending_, 0, 0, nullptr, 0);
+        pending_ = 0;
+    }
+}
+
+struct io_uring_sqe* UringPoller::GetSqe_() {
+    Reserve_(1);
+    unsigned idx = *sqTail_ & *sqMask_;
+    struct io_uring_sqe* sqe = &sqes_[idx];
+    memset(sqe, 0, sizeof(*sqe));
+    sqArray_[idx] = idx;
+    return sqe;
+}
+
+void UringPoller::PrepPollAdd_(int fd, FdEntry& entry) {
+    struct io_uring_sqe* sqe = GetSqe_();
+    sqe->opcode = IORING_OP_POLL_ADD;
+    sqe->fd = fd;
+    /* ET/ONESHOT 由 poll 的注册方式体现，不能作为事件位传给内核 */
+    sqe->poll32_events = entry.events & ~(EPOLLET | EPOLLONESHOT);
+    if(Multishot_(entry)) {
+        sqe->len = IORING_POLL_ADD_MULTI;
+    }
+    sqe->user_data = UserData_(fd, entry.gen);
+    Push_();
+    entry.armed = true;
+    entry.rearm = false;
+}
+
+void UringPoller::PrepPollRemove_(int fd, const FdEntry& entry) {
+    struct io_uring_sqe* sqe = GetSqe_();
+    sqe->opcode = IORING_OP_POLL_REMOVE;
+    sqe->fd = -1;
+    sqe->addr = UserData_(fd, entry.gen);
+    sqe->user_data = REMOVE_TAG;
+    Push_();
+}
+
+void UringPoller::Push_() {
+    __atomic_store_n(sqTail_, *sqTail_ + 1, __ATOMIC_RELEASE);
+    pending_++;
+}
+
+struct io_uring_sqe* UringPoller::PrepOp_(uint8_t opcode, UringCompletion::Op op, int fd) {
+    struct io_uring_sqe* sqe = GetSqe_();
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->user_data = OpData_(op, fd);
+    return sqe;
+}
+
+/* 由非 Wait() 线程（线程池中的工作线程）发起的修改不能等到下一次 Wait()，否则可能永远等不到该 fd 的事件 */
+void UringPoller::SubmitIfForeign_(unique_lock<mutex>& locker) {
+    if(owner_ == std::thread::id() || owner_ == this_thread::get_id() || pending_ == 0) {
+        return;
+    }
+    unsigned toSubmit = pending_;
+    pending_ = 0;
+    locker.unlock();
+    Enter_(toSubmit, 0, 0, nullptr, 0);
+}
+
+bool UringPoller::AddFd(int fd, uint32_t events) {
+    if(fd < 0 || !IsOpen()) return false;
+    unique_lock<mutex> locker(mtx_);
+    FdEntry& entry = Entry_(fd);
+    if(entry.registered) return false;
+    entry.events = events;
+    entry.gen++;
+    entry.registered = true;
+    PrepPollAdd_(fd, entry);
+    SubmitIfForeign_(locker);
+    return true;
+}
+
+bool UringPoller::ModFd(int fd, uint32_t events) {
+    if(fd < 0 || !IsOpen()) return false;
+    unique_lock<mutex> locker(mtx_);
+    FdEntry& entry = Entry_(fd);
+    if(!entry.registered) return false;
+    entry.events = events;
+    if(entry.armed) {
+        PrepPollRemove_(fd, entry);
+        entry.gen++;
+        PrepPollAdd_(fd, entry);
+    } else if(!entry.rearm) {
+        PrepPollAdd_(fd, entry); // ONESHOT 事件已触发，重新注册
+    } // 否则等 Wait() 统一按新的 events 重新注册
+    SubmitIfForeign_(locker);
+    return true;
+}
+
+bool UringPoller::DelFd(int fd) {
+    if(fd < 0 || !IsOpen()) return false;
+    unique_lock<mutex> locker(mtx_);
+    FdEntry& entry = Entry_(fd);
+    if(!entry.registered) return false;
+    if(entry.armed) {
+        PrepPollRemove_(fd, entry);
+    }
+    entry.gen++;
+    entry.registered = entry.armed = entry.rearm = false;
+    SubmitIfForeign_(locker);
+    return true;
+}
+
+bool UringPoller::Accept(int listenFd) {
+    if(listenFd < 0 || !IsCompletion()) return false;
+    unique_lock<mutex> locker(mtx_);
+    struct io_uring_sqe* sqe = PrepOp_(IORING_OP_ACCEPT, UringCompletion::ACCEPT, listenFd);
+    sqe->ioprio = IORING_ACCEPT_MULTISHOT; // 不取对端地址：多次触发的 accept 共用同一块地址缓冲区
+    sqe->accept_flags = SOCK_NONBLOCK | SOCK_CLOEXEC;
+    Push_();
+    SubmitIfForeign_(locker);
+    return true;
+}
+
+bool UringPoller::Recv(int fd) {
+    if(fd < 0 || bufCount_ == 0) return false;
+    unique_lock<mutex> locker(mtx_);
+    struct io_uring_sqe* sqe = PrepOp_(IORING_OP_RECV, UringCompletion::RECV, fd);
+    sqe->flags = IOSQE_BUFFER_SELECT; // 数据到达时才占用缓冲区，空闲连接不占内存
+    sqe->buf_group = BUF_GROUP;
+    Push_();
+    SubmitIfForeign_(locker);
+    return true;
+}
+
+bool UringPoller::Send(int fd, struct msghdr* msgs, int n, int flags) {
+    if(fd < 0 || n <= 0 || !IsCompletion()) return false;
+    unique_lock<mutex> locker(mtx_);
+    Reserve_(n);
+    for(int i = 0; i < n; i++) {
+        struct io_uring_sqe* sqe = PrepOp_(IORING_OP_SENDMSG, UringCompletion::SEND, fd);
+        sqe->addr = reinterpret_cast<uint64_t>(&msgs[i]);
+        sqe->len = 1;
+        sqe->msg_flags = flags | MSG_WAITALL | MSG_NOSIGNAL;
+        if(i + 1 < n) {
+            sqe->flags = IOSQE_IO_LINK;
+        }
+        Push_();
+    }
+    SubmitIfForeign_(locker);
+    return true;
+}
+
+bool UringPoller::Cancel(int fd) {
+    if(fd < 0 || !IsCompletion()) return false;
+    unique_lock<mutex> locker(mtx_);
+    struct io_uring_sqe* sqe = GetSqe_();
+    sqe->opcode = IORING_OP_ASYNC_CANCEL;
+    sqe->fd = fd;
+    sqe->cancel_flags = IORING_ASYNC_CANCEL_FD | IORING_ASYNC_CANCEL_ALL;
+    sqe->user_data = REMOVE_TAG;
+    Push_();
+    SubmitIfForeign_(locker);
+    return true;
+}
+
+int UringPoller::Wait(vector<struct epoll_event>& events, vector<UringCompletion>& completions, int timeoutMs) {
+    unsigned toSubmit = 0;
+    {
+        lock_guard<mutex> locker(mtx_);
+        owner_ = this_thread::get_id();
+        for(int fd: rearm_) {
+            FdEntry& entry = fds_[fd];
+            if(entry.registered && entry.rearm) {
+                PrepPollAdd_(fd, entry);
+            }
+        }
+        rearm_.clear();
+        toSubmit = pending_;
+        pending_ = 0;
+    }
+
+    /* CQ 里还有上次没取完的事件，或者 timeoutMs == 0 时不阻塞 */
+    bool ready = *cqHead_ != __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    unsigned minComplete = (ready || timeoutMs == 0) ? 0 : 1;
+    int ret = 0;
+    if(minComplete > 0 && timeoutMs > 0) {
+        struct __kernel_timespec ts;
+        ts.tv_sec = timeoutMs / 1000;
+        ts.tv_nsec = (timeoutMs % 1000) * 1000000LL;
+        struct io_uring_getevents_arg arg;
+        memset(&arg, 0, sizeof(arg));
+        arg.ts = reinterpret_cast<uint64_t>(&ts);
+        ret = Enter_(toSubmit, minComplete, IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG, &arg, sizeof(arg));
+    } else if(minComplete > 0 || toSubmit > 0) {
+        ret = Enter_(toSubmit, minComplete, minComplete ? IORING_ENTER_GETEVENTS : 0, nullptr, 0);
+    }
+    if(ret < 0 && errno != ETIME && errno != EINTR) {
+        return -1;
+    }
+
+    /* 收割完成事件：poll 的转换成 epoll_event 供 Epoller 原有接口读取，完成模式的操作原样放进 completions */
+    lock_guard<mutex> locker(mtx_);
+    completions.clear();
+    int cnt = 0;
+    waitSeq_++;
+    unsigned head = *cqHead_;
+    unsigned tail = __atomic_load_n(cqTail_, __ATOMIC_ACQUIRE);
+    while(head != tail && cnt < static_cast<int>(events.size())) {
+        const struct io_uring_cqe& cqe = cqes_[head & *cqMask_];
+        head++;
+        if(cqe.user_data == REMOVE_TAG) continue;
+        int fd = static_cast<int>(cqe.user_data & 0xffffffffu);
+        uint32_t gen = static_cast<uint32_t>(cqe.user_data >> 32) & GEN_MASK;
+        if(cqe.user_data & OP_TAG) {
+            UringCompletion done = { static_cast<UringCompletion::Op>(gen), fd, cqe.res, nullptr, 0, (cqe.flags & IORING_CQE_F_MORE) != 0 };
+            if(cqe.flags & IORING_CQE_F_BUFFER) {
+                done.bid = static_cast<uint16_t>(cqe.flags >> IORING_CQE_BUFFER_SHIFT);
+                done.data = bufBase_ + static_cast<size_t>(done.bid) * bufSize_;
+            }
+            completions.push_back(done);
+            continue;
+        }
+        if(static_cast<size_t>(fd) >= fds_.size()) continue;
+        FdEntry& entry = fds_[fd];
+        if(!entry.registered || (entry.gen & GEN_MASK) != gen) continue; // 已删除或已修改，过期事件
+        uint32_t revents = cqe.res < 0 ? EPOLLERR : static_cast<uint32_t>(cqe.res);
+        if(entry.seq == waitSeq_) {
+            events[entry.slot].events |= revents;
+        } else {
+            entry.seq = waitSeq_;
+            entry.slot = cnt;
+            events[cnt].data.fd = fd;
+            events[cnt].events = revents;
+            cnt++;
+        }
+        if(cqe.flags & IORING_CQE_F_MORE) continue; // 多次触发的 poll 仍在内核中
+        entry.armed = false;
+        if(!(entry.events & EPOLLONESHOT) && !entry.rearm) {
+            entry.rearm = true;
+            rearm_.push_back(fd);
+        }
+    }
+    __atomic_store_n(cqHead_, head, __ATOMIC_RELEASE);
+    return cnt;
+}
@@ -0,0 +1,147 @@
+#ifndef URINGPOLLER_H
+#define URINGPOLLER_H
+
+#include <linux/io_uring.h> // io_uring_params, io_uring_sqe, io_uring_cqe
+#include <sys/syscall.h>    // __NR_io_uring_setup, __NR_io_uring_enter, __NR_io_uring_register
+#include <sys/mman.h>       // mmap, munmap
+#include <sys/epoll.h>      // epoll_event
+#include <sys/socket.h>     // msghdr, SOCK_NONBLOCK
+#include <unistd.h>         // close(), syscall()
+#include <assert.h>
+#include <errno.h>
+#include <string.h>
+#include <vector>
+#include <mutex>
+#include <thread>
+
+/* io_uring 后端：用 IORING_OP_POLL_ADD 实现与 epoll 相同的就绪通知语义
+   事件注册/修改/删除只是往 SQ 里填 SQE，由下一次 Wait() 的 io_uring_enter 一并提交并等待完成，
+   即“epoll_ctl + epoll_wait”合并为一次系统调用。三种注册方式分别对应 epoll 的三种语义：
+     EPOLLET（非 ONESHOT）：多次触发的 poll（IORING_POLL_ADD_MULTI，5.13），只在 fd 被唤醒（有新数据、可写）时产生完成事件，
+                            与 epoll 的边缘触发一致，且注册一次后不再重复提交；内核提前结束（CQE 无 F_MORE）时才重新注册
+     EPOLLONESHOT：单次 poll，触发后由调用方 ModFd() 重新注册
+     其余（水平触发）：单次 poll，事件送出后在下一次 Wait() 中重新注册，fd 仍就绪时立即再次触发
+   内核不支持多次触发的 poll 时 EPOLLET 退化为水平触发（与重新注册的单次 poll 相同）。
+   完成模式（EnableCompletion，5.19）：accept、读、写本身也交给内核，Wait() 收割的结果放进 completions，不再是“就绪通知 + 系统调用”：
+     Accept()：多次触发的 IORING_OP_ACCEPT，一次提交持续产生新连接
+     Recv()：单次 IORING_OP_RECV，不指定缓冲区，数据到达时内核从注册的 provided buffer ring 中选一块写入，用完后 Recycle() 归还
+     Send()：一组 IORING_OP_SENDMSG 以 IOSQE_IO_LINK 链接，按顺序执行；带 MSG_WAITALL，流 socket 上内核会把短写续完，
+             只在出错时中断，链中其余的以 -ECANCELED 完成
+   就绪通知仍可与完成模式同时使用（eventfd、等待 sendfile 可写）。
+   直接使用系统调用和 mmap 出来的环形队列，不依赖 liburing */
+
+/* 完成模式下一个操作的结果 */
+struct UringCompletion {
+    enum Op { ACCEPT, RECV, SEND };
+    Op op;
+    int fd;            // ACCEPT 为监听 socket，其余为连接
+    int res;           // 新连接 / 读入的字节数（0 为对端关闭）/ 写出的字节数，< 0 为 -errno
+    const char* data;  // RECV 读入的数据，所在缓冲区处理完后须 Recycle()；没有占用缓冲区时为 nullptr
+    uint16_t bid;
+    bool more;         // ACCEPT 仍在内核中；为 false 时需重新 Accept()
+};
+
+class UringPoller {
+public:
+    explicit UringPoller(unsigned entries = 1024);
+
+    ~UringPoller();
+
+    bool IsOpen() const { return ringFd_ >= 0; }
+
+    bool AddFd(int fd, uint32_t events);
+
+    bool ModFd(int fd, uint32_t events);
+
+    bool DelFd(int fd);
+
+    int Wait(std::vector<struct epoll_event>& events, std::vector<UringCompletion>& completions, int timeoutMs);
+
+    /* 注册 bufCount（2 的幂）个 bufSize 字节的 provided buffer，bufCount 为 0 时只启用 Accept()；内核不支持时返回 false */
+    bool EnableCompletion(unsigned bufCount, unsigned bufSize);
+
+    bool IsCompletion() const { return bufRing_ != nullptr; }
+
+    bool Accept(int listenFd); // 新连接为非阻塞、close-on-exec
+
+    bool Recv(int fd);
+
+    bool Send(int fd, struct msghdr* msgs, int n, int flags); // msgs 及其 iovec 在全部完成前须保持有效
+
+    bool Cancel(int fd); // 取消 fd 上全部未完成的操作，被取消的仍有完成事件
+
+    void Recycle(uint16_t bid);
+
+private:
+    struct FdEntry {
+        uint32_t events;
+        uint32_t gen;    // 每次重新注册加一，user_data 中的 gen 不一致的 CQE 视为过期直接丢弃
+        bool registered;
+        bool armed;      // 内核中有一个未完成的 POLL_ADD
+        bool rearm;      // 事件已送出，等待下一次 Wait() 时重新注册
+        int slot;        // 本次 Wait() 中该 fd 在 events 里的下标，多次触发的 poll 同一批可能有多个完成事件，合并为一个
+        unsigned seq;    // slot 所属的 Wait() 序号
+    };
+
+    bool Setup_(unsigned entries);
+    bool Multishot_(const FdEntry& entry) const { return multishot_ && (entry.events & (EPOLLET | EPOLLONESHOT)) == EPOLLET; }
+    void Release_();
+
+    FdEntry& Entry_(int fd);
+    void Reserve_(unsigned n);
+    struct io_uring_sqe* GetSqe_();
+    void PrepPollAdd_(int fd, FdEntry& entry);
+    void PrepPollRemove_(int fd, const FdEntry& entry);
+    void SubmitIfForeign_(std::unique_lock<std::mutex>& locker);
+    int Enter_(unsigned toSubmit, unsigned minComplete, unsigned flags, void* arg, size_t argSize);
+
+    struct io_uring_sqe* PrepOp_(uint8_t opcode, UringCompletion::Op op, int fd);
+    void Push_(); // 填好的 SQE 计入 SQ
+
+    /* poll 的 user_data：gen 只取低 31 位，最高位留给完成模式的操作 */
+    static uint64_t UserData_(int fd, uint32_t gen) { return (static_cast<uint64_t>(gen & GEN_MASK) << 32) | static_cast<uint32_t>(fd); }
+    static uint64_t OpData_(UringCompletion::Op op, int fd) { return OP_TAG | (static_cast<uint64_t>(op) << 32) | static_cast<uint32_t>(fd); }
+
+    static const uint64_t REMOVE_TAG = ~0ULL; // POLL_REMOVE、ASYNC_CANCEL 自身的完成事件
+    static const uint64_t OP_TAG = 1ULL << 63;
+    static const uint32_t GEN_MASK = 0x7fffffff;
+    static const uint16_t BUF_GROUP = 0;
+
+    int ringFd_;
+    bool multishot_; // 内核支持 IORING_POLL_ADD_MULTI
+    unsigned waitSeq_;
+
+    /* SQ */
+    void* sqPtr_;
+    size_t sqSize_;
+    unsigned* sqHead_;
+    unsigned* sqTail_;
+    unsigned* sqMask_;
+    unsigned* sqEntries_;
+    unsigned* sqArray_;
+    struct io_uring_sqe* sqes_;
+    size_t sqesSize_;
+    unsigned pending_; // 已填入 SQ 尚未提交的 SQE 数
+
+    /* CQ */
+    void* cqPtr_;
+    size_t cqSize_;
+    unsigned* cqHead_;
+    unsigned* cqTail_;
+    unsigned* cqMask_;
+    struct io_uring_cqe* cqes_;
+
+    /* provided buffer ring：前 bufCount_ 个 io_uring_buf 供内核选取，缓冲区本身连续分配在 bufBase_ */
+    struct io_uring_buf_ring* bufRing_;
+    size_t bufRingSize_;
+    char* bufBase_;
+    unsigned bufCount_;
+    unsigned bufSize_;
+
+    std::vector<FdEntry> fds_;
+    std::vector<int> rearm_;
+    std::thread::id owner_; // 调用 Wait() 的线程，其余线程（如线程池）修改事件时立即提交
+    std::mutex mtx_;
+};
+
+#endif //URINGPOLLER_H
@@ -6,18 +6,47 @@ WebServer::WebServer(
             int port, int trigMode, int timeoutMS, bool OptLinger,
             int sqlPort, const char* sqlUser, const  char* sqlPwd,
             const char* dbName, int connPoolNum, int threadNum,
-            bool openLog, int logLevel, int logQueSize):
+            bool openLog, int logLevel, int logQueSize,
+            int reactorNum, int backlog, bool reusePort, bool cpuSteering,
+            bool useUring, int fileCacheMB, int sendfileKB, int maxBodyMB, int diskThreadNum, int connPoolMin,
+            const char* userDbPath):
             port_(port), openLinger_(OptLinger), timeoutMS_(timeoutMS), isClose_(false),
-            timer_(new HeapTimer()), threadpool_(new ThreadPool(threadNum)), epoller_(new Epoller()) // timer_ threadpool_ epoller_ 初始化
+            backlog_(backlog), reusePort_(reusePort), cpuSteering_(cpuSteering),
+            timer_(new TimingWheel()), epoller_(new Epoller(1024, useUring)), nextLoop_(0) // timer_ epoller_ 初始化
     {
     srcDir_ = getcwd(nullptr, 256); // 当前工作路径：启动 server 时，终端中显示的当前路径
     assert(srcDir_);
     strncat(srcDir_, "/resources/", 16);
     HttpConn::userCount = 0;
     HttpConn::srcDir = srcDir_;
-    SqlConnPool::Instance()->Init("localhost", sqlPort, sqlUser, sqlPwd, dbName, connPoolNum); // sql 连接池初始化
+    // 静态文件缓存（0 表示不缓存）；不小于 sendfileKB 的文件不映射，发送时走 sendfile
+    FileCache::Instance()->Init(srcDir_, static_cast<size_t>(fileCacheMB) << 20, static_cast<size_t>(sendfileKB) << 10);
+    HttpRequest::uploadDir = string(srcDir_) + "files/"; // 上传目录
+    FileIndex::Instance()->Init(HttpRequest::uploadDir); // /list.json 的文件索引
+    UploadStore::Instance()->Init(HttpRequest::uploadDir); // 分块上传的会话与内容存储
+    HttpRequest::maxBodySize = maxBodyMB > 0 ? static_cast<size_t>(maxBodyMB) << 20 : SIZE_MAX; // 超出的请求在读消息体之前即回 413；0 表示不限制
+    DiskIO::Instance()->Init(diskThreadNum); // 上传文件的写入、fsync、改名在磁盘 I/O 线程中执行（0：在工作线程中直接执行）
+    if(userDbPath && *userDbPath) {
+        // 本地用户存储：用户记录在本地文件中，不连接 MySQL
+        if(!LocalUserStore::Instance()->Init(userDbPath)) { isClose_ = true; }
+        UserStore::Use(LocalUserStore::Instance());
+    } else {
+        // sql 连接池初始化：并行建立 connPoolMin 个连接，按需增加到 connPoolNum 个
+        SqlConnPool::Instance()->Init("localhost", sqlPort, sqlUser, sqlPwd, dbName, connPoolNum, connPoolMin);
+        SqlAsync::Instance()->Init(SqlConnPool::Instance(), connPoolNum); // 登录、注册的查询由数据库线程异步执行
+        UserStore::Use(SqlAsync::Instance());
+    }
 
     InitEventMode_(trigMode); // 事件模式初始化
+    users_.reset(new ConnSlab(MAX_FD)); // 以 fd 为下标的连接表，主从 Reactor 模式下由各子 Reactor 共享（fd 全进程唯一）
+    if(reactorNum > 0) {
+        // 主从 Reactor：子 Reactor 线程自己完成读写，连接不会在线程间迁移，无需 EPOLLONESHOT
+        for(int i = 0; i < reactorNum; i++) {
+            loops_.emplace_back(new EventLoop(timeoutMS_, connEvent_ & ~EPOLLONESHOT, users_.get(), useUring));
+        }
+    } else {
+        threadpool_.reset(new ThreadPool(threadNum)); // 单 Reactor + 线程池
+    }
     if(!InitSocket_()) { isClose_ = true;} // 监听 socket 初始化（创建 listenFd_ 并加入到 epoller_ 监听事件集合中）
 
     if(openLog) {
@@ -25,13 +54,23 @@ WebServer::WebServer(
         if(isClose_) { LOG_ERROR("========== Server init error!=========="); }
         else {
             LOG_INFO("========== Server init ==========");
-            LOG_INFO("Port:%d, OpenLinger: %s", port_, OptLinger? "true":"false");
+            LOG_INFO("Port:%d, OpenLinger: %s, ReusePort: %s, CpuSteering: %s", port_, OptLinger? "true":"false",
+                            reusePort_? "true":"false", cpuSteering_? "true":"false");
             LOG_INFO("Listen Mode: %s, OpenConn Mode: %s",
                             (listenEvent_ & EPOLLET ? "ET": "LT"),
                             (connEvent_ & EPOLLET ? "ET": "LT"));
+            // 完成模式：子 Reactor 的 accept、读、写都由 io_uring 完成；单 Reactor + 线程池时只有 accept，连接由工作线程读写，仍用 poll 通知就绪
+            const char* uringMode = (!loops_.empty() && loops_[0]->IsCompletion()) ? " (accept/recv/send completions)" :
+                                    (epoller_->IsCompletion() ? " (accept completions, poll)" : " (poll)");
+            LOG_INFO("I/O backend: %s%s", epoller_->IsUring() ? "io_uring" : "epoll",
+                            epoller_->IsUring() ? uringMode : (useUring ? " (io_uring unavailable)" : ""));
+            LOG_INFO("Request scanner: %s", CharScan::Isa());
             LOG_INFO("LogSys level: %d", logLevel);
-            LOG_INFO("srcDir: %s", HttpConn::srcDir);
-            LOG_INFO("SqlConnPool num: %d, ThreadPool num: %d", connPoolNum, threadNum);
+            LOG_INFO("srcDir: %s, FileCache: %dMB, sendfile threshold: %dKB, max body: %dMB",
+                            HttpConn::srcDir, fileCacheMB, sendfileKB, maxBodyMB);
+            LOG_INFO("User store: %s, SqlConnPool num: %d-%d, ThreadPool num: %d, Reactor num: %d, DiskIO num: %d",
+                            UserStore::Instance()->Name(), connPoolMin, connPoolNum,
+                            loops_.empty() ? threadNum : 0, (int)loops_.size(), diskThreadNum);
         }
     }
 }
@@ -39,6 +78,10 @@ WebServer::WebServer(
 WebServer::~WebServer() {
     close(listenFd_);
     isClose_ = true;
+    DiskIO::Instance()->Close(); // 先完成已提交的磁盘任务与数据库查询，其完成回调还会投递到子 Reactor 或线程池
+    UserStore::Instance()->Close(); // 完成已提交的注册（本地存储）或以失败结束未完成的查询（MySQL）
+    SqlConnPool::Instance()->ClosePool(); // 停止维护线程，关闭全部连接
+    loops_.clear(); // 停止并回收子 Reactor 线程
     free(srcDir_);
 }
 
@@ -75,6 +118,16 @@ void WebServer::Start() {
     /* Reactor: DealListen() 没有调用线程池中的线程，DealRead_() 和 DealWrite_() 则交由线程池中的线程处理 */
     int timeMS = -1;  /* epoll wait timeout == -1 无事件将阻塞 */
     if(!isClose_) { LOG_INFO("========== Server start =========="); }
+    // reuseport 模式下各子 Reactor 自己 accept，主线程没有要监听的 fd：由主线程直接运行第 0 个子 Reactor，不再空转 epoll
+    size_t first = (reusePort_ && !isClose_) ? 1 : 0;
+    for(size_t i = first; i < loops_.size(); i++) {
+        // 启用 CPU 分流时子 Reactor 线程绑核，与 BPF 程序选出的 socket 下标一一对应
+        loops_[i]->Start(cpuSteering_ ? static_cast<int>(i) : -1);
+    }
+    if(first == 1) {
+        loops_[0]->Run(cpuSteering_ ? 0 : -1);
+        return;
+    }
     while(!isClose_) {
         if(timeoutMS_ > 0) {
             timeMS = timer_->GetNextTick();
@@ -88,20 +141,20 @@ void WebServer::Start() {
                 DealListen_();
             }
             else if(event & (EPOLLRDHUP | EPOLLHUP | EPOLLERR)) {
-                assert(users_.count(fd) > 0);
-                CloseConn_(&users_[fd]);
+                CloseConn_(users_->Handle(fd));
             }
             else if(event & EPOLLIN) { // http 连接发来读请求
-                assert(users_.count(fd) > 0);
-                DealRead_(&users_[fd]);
+                DealRead_(users_->Handle(fd));
             }
             else if(event & EPOLLOUT) { // http 连接发来写请求
-                assert(users_.count(fd) > 0);
-                DealWrite_(&users_[fd]);
+                DealWrite_(users_->Handle(fd));
             } else {
                 LOG_ERROR("Unexpected event");
             }
         }
+        for(size_t i = 0; i < epoller_->GetCompletionCount(); i++) {
+            OnAccept_(epoller_->GetCompletion(i)); // 主线程只提交 accept
+        }
     }
 }
 
@@ -114,7 +167,13 @@ void WebServer::SendError_(int fd, const char*info) {
     close(fd);
 }
 
-void WebServer::CloseConn_(HttpConn* client) {
+/* 超时回调与关闭事件只持有句柄：连接已关闭（fd 可能已被复用）时直接作废；
+   工作线程正在处理该连接时只做标记，由工作线程在 Unlock_ 时关闭（locked == true） */
+void WebServer::CloseConn_(ConnHandle handle, bool locked) {
+    if(!users_->Retire(handle, locked)) {
+        return;
+    }
+    HttpConn* client = users_->Get(handle.fd);
     assert(client);
     LOG_INFO("Client[%d] quit!", client->GetFd());
     epoller_->DelFd(client->GetFd());
@@ -123,13 +182,14 @@ void WebServer::CloseConn_(HttpConn* client) {
 
 void WebServer::AddClient_(int fd, sockaddr_in addr) {
     assert(fd > 0);
-    users_[fd].init(fd, addr); // HttpConn 初始化 （内部包含 request_ 的初始化）
+    ConnHandle handle = users_->Open(fd);
+    users_->Get(fd)->init(fd, addr); // HttpConn 初始化 （内部包含 request_ 的初始化）
+    users_->Get(fd)->SetResume([this, handle] { threadpool_->AddTask([this, handle] { OnResume_(handle); }); });
     if(timeoutMS_ > 0) {
-        timer_->add(fd, timeoutMS_, std::bind(&WebServer::CloseConn_, this, &users_[fd])); // std::bind() 返回一个新的可调用对象
+        timer_->add(fd, timeoutMS_, std::bind(&WebServer::CloseConn_, this, handle, false)); // std::bind() 返回一个新的可调用对象
     }
-    epoller_->AddFd(fd, EPOLLIN | connEvent_);
-    SetFdNonblock(fd);
-    LOG_INFO("Client[%d] in!", users_[fd].GetFd());
+    epoller_->AddFd(fd, EPOLLIN | connEvent_); // fd 已由 accept4 设为非阻塞
+    LOG_INFO("Client[%d] in!", fd);
 }
 
 void WebServer::DealListen_() {
@@ -138,47 +198,82 @@ void WebServer::DealListen_() {
     do {
         // 等待监听 socket(listenFd_) 来 http 连接，打开一个新的 socket(fd) 与之交流, addr 存储对端的 ip:port
         // 如果没有新的 http 连接到来, 返回的 fd = -1
-        int fd = accept(listenFd_, (struct sockaddr *)&addr, &len); 
+        // accept4 直接得到非阻塞、close-on-exec 的 fd，省去一次 fcntl
+        int fd = accept4(listenFd_, (struct sockaddr *)&addr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
         if(fd <= 0) { 
             LOG_INFO("No new http connection arrived! current http connection userCount: %d", (int)HttpConn::userCount);
             return;
         }
-        else if(HttpConn::userCount >= MAX_FD) {
-            SendError_(fd, "Server busy!");
-            LOG_WARN("Clients is full!");
+        else if(!Accepted_(fd, addr)) {
             return;
         }
-        AddClient_(fd, addr); // 参数解释： 服务端（webserver）处理浏览器 http 连接的 socket fd, 客户端（浏览器）对应的 socket address ip:port
     } while(listenEvent_ & EPOLLET); // 当监听事件处于边缘触发模式时
 }
 
-void WebServer::DealRead_(HttpConn* client) {
-    assert(client);
-    ExtentTime_(client);
-    threadpool_->AddTask(std::bind(&WebServer::OnRead_, this, client)); // std::bind() 返回一个新的可调用对象
+/* 新连接交给子 Reactor 或注册到本线程；连接数已满时回复后关闭，返回 false */
+bool WebServer::Accepted_(int fd, const sockaddr_in& addr) {
+    if(HttpConn::userCount >= MAX_FD || fd >= MAX_FD) { // fd 同时是连接表下标
+        SendError_(fd, "Server busy!");
+        LOG_WARN("Clients is full!");
+        return false;
+    }
+    if(!loops_.empty()) {
+        // 主从 Reactor 模式：主线程只负责 accept，连接轮询交给子 Reactor
+        loops_[nextLoop_++ % loops_.size()]->QueueConn(fd, addr);
+    } else {
+        AddClient_(fd, addr); // 参数解释： 服务端（webserver）处理浏览器 http 连接的 socket fd, 客户端（浏览器）对应的 socket address ip:port
+    }
+    return true;
 }
 
-void WebServer::DealWrite_(HttpConn* client) {
-    assert(client);
-    ExtentTime_(client);
-    threadpool_->AddTask(std::bind(&WebServer::OnWrite_, this, client));
+/* io_uring 完成模式下多次触发的 accept：一次提交持续产生新连接，不再是“可读通知 + accept4” */
+void WebServer::OnAccept_(const UringCompletion& done) {
+    if(done.res >= 0) {
+        struct sockaddr_in addr = {};
+        socklen_t len = sizeof(addr);
+        getpeername(done.res, (struct sockaddr *)&addr, &len); // 多次触发的 accept 不回填对端地址
+        Accepted_(done.res, addr);
+    } else {
+        LOG_WARN("Accept error: %d", -done.res);
+    }
+    if(!done.more) {
+        epoller_->Accept(listenFd_); // 出错或 CQ 溢出时内核结束了多次触发的 accept，重新提交
+    }
 }
 
-void WebServer::ExtentTime_(HttpConn* client) {
-    assert(client);
-    if(timeoutMS_ > 0) { timer_->adjust(client->GetFd(), timeoutMS_); }
+void WebServer::DealRead_(ConnHandle handle) {
+    ExtentTime_(handle.fd);
+    threadpool_->AddTask([this, handle] { OnRead_(handle); }); // 任务只持有句柄，执行时连接已关闭则直接返回
 }
 
-void WebServer::OnRead_(HttpConn* client) {
-    assert(client);
+void WebServer::DealWrite_(ConnHandle handle) {
+    ExtentTime_(handle.fd);
+    threadpool_->AddTask([this, handle] { OnWrite_(handle); });
+}
+
+void WebServer::ExtentTime_(int fd) {
+    if(timeoutMS_ > 0) { timer_->adjust(fd, timeoutMS_); }
+}
+
+/* 工作线程处理完毕：EPOLLONESHOT 已重新注册，释放独占；若期间超时则由本线程关闭 */
+void WebServer::Unlock_(ConnHandle handle) {
+    if(!users_->Unlock(handle)) {
+        CloseConn_(handle, true);
+    }
+}
+
+void WebServer::OnRead_(ConnHandle handle) {
+    HttpConn* client = users_->Lock(handle);
+    if(!client) { return; } // 连接已关闭
     int ret = -1;
     int readErrno = 0;
     ret = client->read(&readErrno); // request 内容从 fd_ 读入读缓冲区 readBuff_
     if(ret <= 0 && readErrno != EAGAIN) {
-        CloseConn_(client);
+        CloseConn_(handle, true);
         return;
     }
     onProcess_(client); // 完成解析 request,生成 response 写入写缓冲区, 将事件改为 EPOLL_OUT, 让 epoller_ 下一次检测到写事件，把写缓冲区的内容写到 fd
+    Unlock_(handle);
 }
 
 /* 处理函数：判断读入的请求报文是否完整，决定是继续监听读还是监听写 */
@@ -187,41 +282,99 @@ void WebServer::onProcess_(HttpConn* client) {
     if(client->process()) {
         epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
     } else {
-        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLIN);
+        // 等待磁盘任务时不监听读（EPOLLONESHOT 下不会再有读事件），完成后由 OnResume_ 继续
+        epoller_->ModFd(client->GetFd(), connEvent_ | (client->IsPaused() ? 0 : EPOLLIN));
     }
 }
 
-void WebServer::OnWrite_(HttpConn* client) {
-    assert(client);
+/* 磁盘任务完成，由磁盘 I/O 线程投递：只处理暂停中的连接；还有响应没写完的，由 OnWrite_ 写完后处理 */
+void WebServer::OnResume_(ConnHandle handle) {
+    HttpConn* client = users_->Lock(handle);
+    if(!client) { return; } // 连接已关闭
+    if(client->IsPaused() && client->ToWriteBytes() == 0) {
+        onProcess_(client);
+    }
+    Unlock_(handle);
+}
+
+void WebServer::OnWrite_(ConnHandle handle) {
+    HttpConn* client = users_->Lock(handle);
+    if(!client) { return; } // 连接已关闭
     int ret = -1;
     int writeErrno = 0;
     ret = client->write(&writeErrno);
     if(client->ToWriteBytes() == 0) {
         //发送完毕
-        if(client->IsKeepAlive()) {
+        if(client->IsKeepAlive() || client->Linger()) { // 413 之后半关闭，排空对端的消息体再关闭
             onProcess_(client);
+            Unlock_(handle);
             return;
         }
     }
-    else if(ret < 0) {
-        //缓存满导致的，继续监听写
-        if(writeErrno == EAGAIN) { // EAGAIN: try again 再次尝试传输
-            epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
-            return;
-        }
+    else if(ret > 0 || writeErrno == EAGAIN) { // EAGAIN: try again 再次尝试传输
+        //缓存满，或未写完（LT 模式下剩余不足 10240 字节即返回），继续监听写
+        epoller_->ModFd(client->GetFd(), connEvent_ | EPOLLOUT);
+        Unlock_(handle);
+        return;
     }
     //其他原因导致，关闭连接
-    CloseConn_(client);
+    CloseConn_(handle, true);
 }
 
 /* Create listenFd */
 bool WebServer::InitSocket_() {
-    int ret;
-    struct sockaddr_in addr;
     if(port_ > 65535 || port_ < 1024) {
         LOG_ERROR("Port:%d error!",  port_);
         return false;
     }
+    if(reusePort_ && loops_.empty()) {
+        LOG_WARN("SO_REUSEPORT requires sub reactors, fall back to single listener");
+        reusePort_ = false;
+    }
+
+    if(reusePort_) {
+        /* 每个子 Reactor 一个 SO_REUSEPORT 监听 socket，由内核按四元组哈希（或 BPF 程序）分发新连接，
+           各线程自己 accept；主线程在 Start() 中运行第 0 个子 Reactor */
+        listenFd_ = -1;
+        std::vector<int> fds;
+        for(size_t i = 0; i < loops_.size(); i++) {
+            int fd = CreateListenFd_();
+            if(fd < 0) {
+                for(int opened: fds) { close(opened); }
+                return false;
+            }
+            fds.push_back(fd);
+        }
+        if(cpuSteering_ && !AttachCpuSteering_(fds[0], fds.size())) {
+            LOG_WARN("Attach reuseport cbpf error, use kernel hash instead!");
+            cpuSteering_ = false;
+        }
+        for(size_t i = 0; i < loops_.size(); i++) {
+            loops_[i]->AddListener(fds[i], listenEvent_);
+        }
+        LOG_INFO("Server port:%d, %d reuseport listeners, backlog:%d", port_, (int)fds.size(), backlog_);
+        return true;
+    }
+
+    listenFd_ = CreateListenFd_();
+    if(listenFd_ < 0) {
+        return false;
+    }
+    // io_uring 完成模式下提交多次触发的 accept（主线程不读写连接，不需要 provided buffer）；
+    // 否则将监听套接字添加到 epoller_ 事件监听集合中，同时传入 listenEvent_ | EPOLLIN 作为要关注的事件
+    int ret = (epoller_->EnableCompletion() && epoller_->Accept(listenFd_)) || epoller_->AddFd(listenFd_,  listenEvent_ | EPOLLIN);
+    if(ret == 0) {
+        LOG_ERROR("Add listen error!");
+        close(listenFd_);
+        return false;
+    }
+    LOG_INFO("Server port:%d, backlog:%d", port_, backlog_);
+    return true;
+}
+
+int WebServer::CreateListenFd_() {
+    int ret;
+    struct sockaddr_in addr;
     /* 配置服务器网络地址结构体 */
     addr.sin_family = AF_INET; // 使用 IPv4 协议
     addr.sin_addr.s_addr = htonl(INADDR_ANY); // 服务器可以接受来自任意本地网络接口的连接请求，即绑定到所有可用的本地 IP 地址上
@@ -234,52 +387,66 @@ bool WebServer::InitSocket_() {
         optLinger.l_linger = 1; // 关闭套接字时，如果还有未发送的数据，会等待 1 秒时间让数据发送完毕或者超时后再关闭，避免数据丢失，实现优雅关闭
     }
 
-    listenFd_ = socket(AF_INET, SOCK_STREAM, 0); // 创建 socket
-    if(listenFd_ < 0) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0); // 创建非阻塞 socket
+    if(fd < 0) {
         LOG_ERROR("Create socket error!", port_);
-        return false;
+        return -1;
     }
 
-    ret = setsockopt(listenFd_, SOL_SOCKET, SO_LINGER, &optLinger, sizeof(optLinger)); // 设置 socket 的 SO_LINGER 选项
+    ret = setsockopt(fd, SOL_SOCKET, SO_LINGER, &optLinger, sizeof(optLinger)); // 设置 socket 的 SO_LINGER 选项
     if(ret < 0) {
-        close(listenFd_);
+        close(fd);
         LOG_ERROR("Init linger error!", port_);
-        return false;
+        return -1;
     }
 
     int optval = 1;
     /* 端口复用 */
     /* 允许在服务器重启等情况下，即使之前绑定的端口处于 TIME_WAIT 状态，新的套接字也可以复用该端口进行绑定，方便服务器快速重启等情况
        note: 多个套接字绑定到单个端口时，只有最后一个套接字会正常接收数据。 */
-    ret = setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, (const void*)&optval, sizeof(int));
+    ret = setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, (const void*)&optval, sizeof(int));
     if(ret == -1) {
         LOG_ERROR("set socket port multiplex error !");
-        close(listenFd_);
-        return false;
+        close(fd);
+        return -1;
     }
 
-    ret = bind(listenFd_, (struct sockaddr *)&addr, sizeof(addr)); // 将创建好的 socket(listenFd_) 与特定的本地网络地址(ip:port)进行绑定
+    /* SO_REUSEPORT：多个 socket 绑定同一端口，各自拥有独立的全连接队列，内核负责在它们之间分发新连接 */
+    if(reusePort_) {
+        ret = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, (const void*)&optval, sizeof(int));
+        if(ret == -1) {
+            LOG_ERROR("set socket SO_REUSEPORT error !");
+            close(fd);
+            return -1;
+        }
+    }
+
+    ret = bind(fd, (struct sockaddr *)&addr, sizeof(addr)); // 将创建好的 socket(fd) 与特定的本地网络地址(ip:port)进行绑定
     if(ret < 0) {
         LOG_ERROR("Bind Port:%d error!", port_);
-        close(listenFd_);
-        return false;
+        close(fd);
+        return -1;
     }
 
-    ret = listen(listenFd_, 6); // 创建一个监听队列用于存放待处理的客户连接，最多有6个客户端请求处于等待被接受的队列中
+    ret = listen(fd, backlog_); // 创建一个监听队列用于存放待处理的客户连接，实际长度还受 net.core.somaxconn 限制
     if(ret < 0) {
         LOG_ERROR("Listen port:%d error!", port_);
-        close(listenFd_);
-        return false;
-    }
-    ret = epoller_->AddFd(listenFd_,  listenEvent_ | EPOLLIN); // 将监听套接字添加到 epoller_ 事件监听集合中，同时传入 listenEvent_ | EPOLLIN 作为要关注的事件
-    if(ret == 0) {
-        LOG_ERROR("Add listen error!");
-        close(listenFd_);
-        return false;
+        close(fd);
+        return -1;
     }
-    SetFdNonblock(listenFd_); // 将监听套接字设置为非阻塞状态
-    LOG_INFO("Server port:%d", port_);
-    return true;
+    return fd;
+}
+
+/* reuseport 组内按当前 CPU 号选择 socket：return cpu % n
+   socket 在组内的下标即 bind 的先后顺序，配合子 Reactor 线程绑核，连接的 softirq、accept 与处理都落在同一个核上 */
+bool WebServer::AttachCpuSteering_(int fd, size_t n) {
+    struct sock_filter code[] = {
+        { BPF_LD  | BPF_W | BPF_ABS, 0, 0, (uint32_t)(SKF_AD_OFF + SKF_AD_CPU) }, // A = 当前 CPU
+        { BPF_ALU | BPF_MOD | BPF_K, 0, 0, (uint32_t)n },                       // A = A % n
+        { BPF_RET | BPF_A, 0, 0, 0 },                                           // return A
+    };
+    struct sock_fprog prog = { sizeof(code) / sizeof(code[0]), code };
+    return 0 == setsockopt(fd, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
 }
 
 int WebServer::SetFdNonblock(int fd) {
@@ -9,12 +9,18 @@
 #include <sys/socket.h>
 #include <netinet/in.h>
 #include <arpa/inet.h>
+#include <linux/filter.h> // sock_filter, SKF_AD_CPU
 
 #include "epoller.h"
+#include "eventloop.h"
+#include "connslab.h"
 #include "../log/log.h"
-#include "../timer/heaptimer.h"
+#include "../timer/timingwheel.h"
 #include "../pool/sqlconnpool.h"
 #include "../pool/threadpool.h"
+#include "../pool/diskio.h"
+#include "../pool/sqlasync.h"
+#include "../pool/localuserstore.h"
 #include "../pool/sqlconnRAII.h"
 #include "../http/httpconn.h"
 
@@ -24,26 +30,37 @@ public:
         int port, int trigMode, int timeoutMS, bool OptLinger, 
         int sqlPort, const char* sqlUser, const  char* sqlPwd, 
         const char* dbName, int connPoolNum, int threadNum,
-        bool openLog, int logLevel, int logQueSize);
+        bool openLog, int logLevel, int logQueSize,
+        int reactorNum = 0, int backlog = 6,
+        bool reusePort = false, bool cpuSteering = false,
+        bool useUring = false, int fileCacheMB = 64, int sendfileKB = 1024,
+        int maxBodyMB = 1024, int diskThreadNum = 2, int connPoolMin = 4,
+        const char* userDbPath = nullptr);
 
     ~WebServer();
     void Start();
 
 private:
     bool InitSocket_(); 
+    int CreateListenFd_();
+    static bool AttachCpuSteering_(int fd, size_t n);
     void InitEventMode_(int trigMode);
     void AddClient_(int fd, sockaddr_in addr);
   
     void DealListen_();
-    void DealWrite_(HttpConn* client);
-    void DealRead_(HttpConn* client);
+    bool Accepted_(int fd, const sockaddr_in& addr);
+    void OnAccept_(const UringCompletion& done);
+    void DealWrite_(ConnHandle handle);
+    void DealRead_(ConnHandle handle);
 
     void SendError_(int fd, const char*info);
-    void ExtentTime_(HttpConn* client);
-    void CloseConn_(HttpConn* client);
+    void ExtentTime_(int fd);
+    void CloseConn_(ConnHandle handle, bool locked = false);
+    void Unlock_(ConnHandle handle);
 
-    void OnRead_(HttpConn* client);
-    void OnWrite_(HttpConn* client);
+    void OnRead_(ConnHandle handle);
+    void OnWrite_(ConnHandle handle);
+    void OnResume_(ConnHandle handle);
     void onProcess_(HttpConn* client);
 
     static const int MAX_FD = 65536;
@@ -54,16 +71,22 @@ private:
     bool openLinger_;
     int timeoutMS_;  /* 毫秒MS */
     bool isClose_;
-    int listenFd_;
+    int listenFd_; // 非 reuseport 模式下唯一的监听 socket
+    int backlog_;
+    bool reusePort_;   // 每个子 Reactor 一个 SO_REUSEPORT 监听 socket
+    bool cpuSteering_; // reuseport 组挂载按 CPU 分流的 BPF 程序
     char* srcDir_;
     
     uint32_t listenEvent_;
     uint32_t connEvent_;
    
-    std::unique_ptr<HeapTimer> timer_; // 定时器
+    std::unique_ptr<TimingWheel> timer_; // 定时器
     std::unique_ptr<ThreadPool> threadpool_; // 线程池
     std::unique_ptr<Epoller> epoller_; // Reactor 反应堆
-    std::unordered_map<int, HttpConn> users_; // http connection unordered_map
+    std::unique_ptr<ConnSlab> users_; // http connection 表，fd 为下标
+
+    std::vector<std::unique_ptr<EventLoop>> loops_; // 子 Reactor，为空时使用 单Reactor + 线程池 模式
+    size_t nextLoop_; // 轮询分发新连接
 };
 
 
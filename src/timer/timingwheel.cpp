@@ -0,0 +1,209 @@
+#include "timingwheel.h"
+
+TimingWheel::TimingWheel(): buckets_(BUCKETS, -1), bits_(), current_(Now_()), count_(0) {
+    static_assert(BUCKETS % 64 == 0 && LEVEL_SIZE == 64, "bitmap layout assumes 64-slot words");
+    nodes_.reserve(64);
+}
+
+int64_t TimingWheel::Now_() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+void TimingWheel::Link_(int id) {
+    /* 按到期时间距当前的跨度选择层级：第 0 层按绝对毫秒取槽，高层按对应粒度取槽 */
+    Node& node = nodes_[id];
+    int64_t expires = node.expires < current_ ? current_ : node.expires;
+    int64_t delta = expires - current_;
+    if(delta > MAX_SPAN) {
+        delta = MAX_SPAN;
+        expires = current_ + MAX_SPAN; // 超出范围：先放在最远处，级联时再按真实 expires 重排
+    }
+    int bucket;
+    if(delta < ROOT_SIZE) {
+        bucket = expires & (ROOT_SIZE - 1);
+    }
+    else {
+        int level = 1;
+        int shift = ROOT_BITS;
+        while(delta >= (int64_t(1) << (shift + LEVEL_BITS))) {
+            level++;
+            shift += LEVEL_BITS;
+        }
+        assert(level < LEVELS);
+        bucket = ROOT_SIZE + (level - 1) * LEVEL_SIZE + ((expires >> shift) & (LEVEL_SIZE - 1));
+    }
+    node.scheduled = expires;
+    node.bucket = bucket;
+    node.prev = -1;
+    node.next = buckets_[bucket];
+    if(node.next >= 0) {
+        nodes_[node.next].prev = id;
+    }
+    buckets_[bucket] = id;
+    bits_[bucket >> 6] |= uint64_t(1) << (bucket & 63);
+    count_++;
+}
+
+void TimingWheel::Unlink_(int id) {
+    Node& node = nodes_[id];
+    assert(node.bucket >= 0);
+    if(node.prev >= 0) {
+        nodes_[node.prev].next = node.next;
+    } else {
+        buckets_[node.bucket] = node.next;
+        if(node.next < 0) {
+            bits_[node.bucket >> 6] &= ~(uint64_t(1) << (node.bucket & 63));
+        }
+    }
+    if(node.next >= 0) {
+        nodes_[node.next].prev = node.prev;
+    }
+    node.prev = node.next = node.bucket = -1;
+    count_--;
+}
+
+void TimingWheel::Cascade_(int level) {
+    /* 把高层当前槽内的结点按最新的 expires 重新放入低层 */
+    int shift = ROOT_BITS + (level - 1) * LEVEL_BITS;
+    int bucket = ROOT_SIZE + (level - 1) * LEVEL_SIZE + ((current_ >> shift) & (LEVEL_SIZE - 1));
+    int id = buckets_[bucket];
+    buckets_[bucket] = -1;
+    bits_[bucket >> 6] &= ~(uint64_t(1) << (bucket & 63));
+    while(id >= 0) {
+        int next = nodes_[id].next;
+        nodes_[id].bucket = -1;
+        count_--;
+        Link_(id);
+        id = next;
+    }
+}
+
+void TimingWheel::Expire_(int bucket) {
+    /* 每次重新读取链表头：回调中可能 add/cancel 同一槽内的其他结点 */
+    while(buckets_[bucket] >= 0) {
+        int id = buckets_[bucket];
+        Unlink_(id);
+        Node& node = nodes_[id];
+        if(node.expires > current_) {
+            Link_(id); // 期间被 adjust 延后过，惰性重排
+            continue;
+        }
+        TimeoutCallBack cb = std::move(node.cb);
+        node.cb = nullptr;
+        cb();
+    }
+}
+
+void TimingWheel::add(int id, int timeout, const TimeoutCallBack& cb) {
+    assert(id >= 0);
+    if(static_cast<size_t>(id) >= nodes_.size()) {
+        nodes_.resize(id + 1);
+    }
+    Node& node = nodes_[id];
+    if(node.bucket >= 0) {
+        Unlink_(id);
+    }
+    node.expires = Now_() + timeout;
+    node.cb = cb;
+    Link_(id);
+}
+
+void TimingWheel::adjust(int id, int timeout) {
+    /* 连接已超时关闭后仍可能收到一次事件，此时结点已不在时间轮中，忽略即可 */
+    if(id < 0 || static_cast<size_t>(id) >= nodes_.size() || nodes_[id].bucket < 0) {
+        return;
+    }
+    Node& node = nodes_[id];
+    node.expires = Now_() + timeout;
+    if(node.expires < node.scheduled) { // 提前到期才需要立即移动结点
+        Unlink_(id);
+        Link_(id);
+    }
+}
+
+void TimingWheel::cancel(int id) {
+    if(id < 0 || static_cast<size_t>(id) >= nodes_.size() || nodes_[id].bucket < 0) {
+        return;
+    }
+    Unlink_(id);
+    nodes_[id].cb = nullptr;
+}
+
+void TimingWheel::doWork(int id) {
+    /* 删除指定id结点，并触发回调函数 */
+    if(id < 0 || static_cast<size_t>(id) >= nodes_.size() || nodes_[id].bucket < 0) {
+        return;
+    }
+    Unlink_(id);
+    TimeoutCallBack cb = std::move(nodes_[id].cb);
+    nodes_[id].cb = nullptr;
+    cb();
+}
+
+void TimingWheel::clear() {
+    nodes_.clear();
+    buckets_.assign(BUCKETS, -1);
+    std::fill(bits_, bits_ + WORDS, 0);
+    count_ = 0;
+}
+
+void TimingWheel::tick() {
+    /* 推进到当前时间：直接跳到下一个非空槽或级联时刻，每转完一圈从上一层级联一个槽 */
+    int64_t now = Now_();
+    while(current_ <= now && count_ > 0) {
+        int64_t next = NextEvent_();
+        if(next > now) { break; }
+        current_ = next;
+        if((current_ & (ROOT_SIZE - 1)) == 0) {
+            int shift = ROOT_BITS;
+            for(int level = 1; level < LEVELS; level++) {
+                Cascade_(level);
+                if(((current_ >> shift) & (LEVEL_SIZE - 1)) != 0) { break; }
+                shift += LEVEL_BITS;
+            }
+        }
+        Expire_(current_ & (ROOT_SIZE - 1));
+        current_++;
+    }
+    if(current_ <= now) { current_ = now + 1; } // 其间的槽都是空的
+}
+
+int64_t TimingWheel::NextEvent_() const {
+    /* 下一次需要处理的时刻（>= current_）：第 0 层最近的非空槽，或各高层最近一个非空槽的级联时刻 */
+    int64_t next = current_ + MAX_SPAN;
+    int from = current_ & (ROOT_SIZE - 1);
+    for(int k = 0; k < ROOT_SIZE; ) {
+        int pos = (from + k) & (ROOT_SIZE - 1);
+        uint64_t word = bits_[pos >> 6] >> (pos & 63);
+        if(word) {
+            k += __builtin_ctzll(word);
+            if(k < ROOT_SIZE) { next = current_ + k; }
+            break;
+        }
+        k += 64 - (pos & 63);
+    }
+    int shift = ROOT_BITS;
+    for(int level = 1; level < LEVELS; level++) {
+        /* 该层的槽按级联顺序旋转，使第 j 个（j >= 1）级联时刻对应第 j - 1 位 */
+        int64_t base = (current_ - 1) >> shift;
+        int start = static_cast<int>((base + 1) & (LEVEL_SIZE - 1));
+        uint64_t word = bits_[(ROOT_SIZE >> 6) + level - 1];
+        if(start) { word = (word >> start) | (word << (64 - start)); }
+        if(word) {
+            int64_t when = (base + 1 + __builtin_ctzll(word)) << shift;
+            if(when < next) { next = when; }
+        }
+        shift += LEVEL_BITS;
+    }
+    return next;
+}
+
+int TimingWheel::GetNextTick() {
+    tick();
+    if(count_ == 0) {
+        return -1;
+    }
+    int64_t res = NextEvent_() - Now_();
+    return res < 0 ? 0 : static_cast<int>(res);
+}
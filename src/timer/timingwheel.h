@@ -0,0 +1,73 @@
+#ifndef TIMING_WHEEL_H
+#define TIMING_WHEEL_H
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <chrono>
+#include <stdint.h>
+#include <assert.h>
+
+/* 分层时间轮，连接超时定时器（接口沿用原 HeapTimer，test/timer_bench.cpp 中有两者的对比）
+   第 0 层 256 个 1ms 槽，第 1~3 层各 64 个槽，粒度依次 x256、x64、x64，共覆盖约 18.6 小时，更远的按最远处理后再级联。
+   结点以 fd 为下标存放，槽内为侵入式双向链表，add/cancel 都是 O(1)；
+   adjust 延后到期时间时只改 expires，不移动结点，等所在槽到期或级联时再按最新的 expires 重新放入（惰性重排）。
+   每个槽在位图中占一位，tick 直接跳到下一个非空槽或级联时刻，空闲期间不逐毫秒推进 */
+class TimingWheel {
+public:
+    typedef std::function<void()> TimeoutCallBack;
+
+    TimingWheel();
+
+    ~TimingWheel() { clear(); }
+
+    void adjust(int id, int timeout); // timeout：从现在起的毫秒数
+
+    void add(int id, int timeOut, const TimeoutCallBack& cb);
+
+    void cancel(int id);
+
+    void doWork(int id);
+
+    void clear();
+
+    void tick();
+
+    int GetNextTick();
+
+private:
+    static const int ROOT_BITS = 8;
+    static const int LEVEL_BITS = 6;
+    static const int LEVELS = 4;
+    static const int ROOT_SIZE = 1 << ROOT_BITS;
+    static const int LEVEL_SIZE = 1 << LEVEL_BITS;
+    static const int BUCKETS = ROOT_SIZE + (LEVELS - 1) * LEVEL_SIZE;
+    static const int64_t MAX_SPAN = (int64_t(1) << (ROOT_BITS + (LEVELS - 1) * LEVEL_BITS)) - 1;
+    static const int WORDS = BUCKETS / 64; // 非空槽位图：第 0 层占 4 个字，第 1~3 层各 1 个字
+
+    struct Node {
+        Node(): expires(0), scheduled(0), prev(-1), next(-1), bucket(-1) {}
+        int64_t expires;   // 真实到期时间（ms），adjust 只改这里
+        int64_t scheduled; // 入槽时依据的到期时间
+        int prev;
+        int next;
+        int bucket;        // 所在槽，-1 表示不在时间轮中
+        TimeoutCallBack cb;
+    };
+
+    static int64_t Now_();
+
+    void Link_(int id);
+    void Unlink_(int id);
+    void Cascade_(int level);
+    void Expire_(int bucket);
+    int64_t NextEvent_() const;
+
+    std::vector<Node> nodes_;  // 以 fd 为下标
+    std::vector<int> buckets_; // 各槽链表头
+    uint64_t bits_[WORDS];     // 非空槽位图，下标与 buckets_ 一致
+    int64_t current_;          // 下一个待处理的毫秒
+    size_t count_;
+};
+
+#endif //TIMING_WHEEL_H
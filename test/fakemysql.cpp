@@ -0,0 +1,291 @@
+#include "fakemysql.h"
+
+#include <algorithm>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <vector>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include "pool/sqlconnpool.h" // SQL_NONBLOCK
+#include "pool/sqlstmt.h"     // SqlBool
+
+namespace {
+
+const unsigned int DUP_ENTRY = 1062;
+
+struct Row {
+    std::string name;
+    std::string pwd;
+};
+
+std::mutex g_mtx;
+std::map<std::string, Row> g_users; // 小写用户名 -> 行
+int g_insertStatements = 0;
+int g_insertedRows = 0;
+std::function<void()> g_onInsert;
+int g_suspend = 0;
+int g_resumes = 0;
+int g_badResumes = 0;
+
+const unsigned int TIMEOUT_MS = 5;
+
+#ifdef SQL_NONBLOCK
+static_assert(FakeMysql::WAIT_READ == MYSQL_WAIT_READ && FakeMysql::WAIT_WRITE == MYSQL_WAIT_WRITE &&
+              FakeMysql::WAIT_TIMEOUT == MYSQL_WAIT_TIMEOUT, "FakeMysql: unexpected MYSQL_WAIT_* values");
+#endif
+
+struct FakeConn {
+    unsigned long threadId;
+    int fds[2]; // fds[0] 作为连接的 socket
+};
+
+enum Op { NONE, PREPARE, EXECUTE, STORE };
+
+struct FakeStmt {
+    FakeConn* conn = nullptr;
+    Op op = NONE;      // 已发起、等待继续的操作
+    int wait = 0;
+    std::string text;
+    MYSQL_BIND* params = nullptr;
+    MYSQL_BIND* result = nullptr;
+    std::vector<std::string> rows; // 查询结果的第一列
+    size_t next = 0;
+    unsigned int err = 0;
+};
+
+FakeStmt* Stmt(MYSQL_STMT* stmt) {
+    return reinterpret_cast<FakeStmt*>(stmt);
+}
+
+std::string Fold(std::string name) {
+    for(char& ch: name) {
+        if(ch >= 'A' && ch <= 'Z') { ch += 'a' - 'A'; }
+    }
+    return name;
+}
+
+size_t Placeholders(const std::string& text) {
+    size_t n = 0;
+    for(char ch: text) { n += ch == '?'; }
+    return n;
+}
+
+std::string Param(const FakeStmt& stmt, size_t i) {
+    return std::string(static_cast<const char*>(stmt.params[i].buffer), *stmt.params[i].length);
+}
+
+int Execute(FakeStmt& stmt) {
+    stmt.rows.clear();
+    stmt.next = 0;
+    stmt.err = 0;
+    size_t n = Placeholders(stmt.text);
+    if(stmt.text.compare(0, 6, "INSERT") == 0) {
+        std::function<void()> hook;
+        {
+            std::lock_guard<std::mutex> locker(g_mtx);
+            hook = g_onInsert;
+        }
+        if(hook) { hook(); }
+        std::lock_guard<std::mutex> locker(g_mtx);
+        g_insertStatements++;
+        std::map<std::string, Row> rows;
+        for(size_t i = 0; i + 1 < n; i += 2) {
+            std::string name = Param(stmt, i);
+            if(g_users.count(Fold(name)) || !rows.emplace(Fold(name), Row{name, Param(stmt, i + 1)}).second) {
+                stmt.err = DUP_ENTRY; // 一条语句要么全部插入，要么都不插入
+                return 1;
+            }
+        }
+        g_insertedRows += rows.size();
+        g_users.insert(rows.begin(), rows.end());
+        return 0;
+    }
+    std::lock_guard<std::mutex> locker(g_mtx);
+    bool names = stmt.text.find("SELECT username") == 0;
+    for(size_t i = 0; i < n; i++) {
+        auto it = g_users.find(Fold(Param(stmt, i)));
+        if(it != g_users.end()) {
+            stmt.rows.push_back(names ? it->second.name : it->second.pwd);
+        }
+    }
+    return 0;
+}
+
+/* 非阻塞操作的发起：不挂起时立即执行；挂起时记下操作，按要等待的事件准备 socket */
+int Start(int* ret, FakeStmt& stmt, Op op, int (*run)(FakeStmt&)) {
+    int wait;
+    {
+        std::lock_guard<std::mutex> locker(g_mtx);
+        wait = g_suspend;
+    }
+    if(!wait) {
+        *ret = run(stmt);
+        return 0;
+    }
+    stmt.op = op;
+    stmt.wait = wait;
+    if(wait & FakeMysql::WAIT_READ) {
+        ssize_t n = write(stmt.conn->fds[1], "r", 1);
+        (void)n;
+    }
+    return wait;
+}
+
+int Cont(int* ret, FakeStmt& stmt, int ready, int (*run)(FakeStmt&)) {
+    {
+        std::lock_guard<std::mutex> locker(g_mtx);
+        g_resumes++;
+        if(stmt.op == NONE || !(ready & stmt.wait)) { g_badResumes++; }
+    }
+    char buf[16];
+    while(read(stmt.conn->fds[0], buf, sizeof(buf)) > 0) {}
+    stmt.op = NONE;
+    stmt.wait = 0;
+    *ret = run(stmt);
+    return 0;
+}
+
+int RunPrepare(FakeStmt&) { return 0; }
+int RunExecute(FakeStmt& stmt) { return Execute(stmt); }
+int RunStore(FakeStmt&) { return 0; }
+
+} // namespace
+
+namespace FakeMysql {
+
+void Reset() {
+    std::lock_guard<std::mutex> locker(g_mtx);
+    g_users.clear();
+    g_insertStatements = g_insertedRows = 0;
+    g_onInsert = nullptr;
+    g_suspend = g_resumes = g_badResumes = 0;
+}
+
+void Suspend(int wait) {
+    std::lock_guard<std::mutex> locker(g_mtx);
+    g_suspend = wait;
+}
+
+int Resumes() {
+    std::lock_guard<std::mutex> locker(g_mtx);
+    return g_resumes;
+}
+
+int BadResumes() {
+    std::lock_guard<std::mutex> locker(g_mtx);
+    return g_badResumes;
+}
+
+void AddUser(const std::string& name, const std::string& pwd) {
+    std::lock_guard<std::mutex> locker(g_mtx);
+    g_users[Fold(name)] = Row{name, pwd};
+}
+
+bool HasUser(const std::string& name, std::string* pwd) {
+    std::lock_guard<std::mutex> locker(g_mtx);
+    auto it = g_users.find(Fold(name));
+    if(it == g_users.end()) { return false; }
+    if(pwd) { *pwd = it->second.pwd; }
+    return true;
+}
+
+int InsertStatements() {
+    std::lock_guard<std::mutex> locker(g_mtx);
+    return g_insertStatements;
+}
+
+int InsertedRows() {
+    std::lock_guard<std::mutex> locker(g_mtx);
+    return g_insertedRows;
+}
+
+void OnInsert(std::function<void()> hook) {
+    std::lock_guard<std::mutex> locker(g_mtx);
+    g_onInsert = std::move(hook);
+}
+
+} // namespace FakeMysql
+
+extern "C" {
+
+int mysql_library_init(int, char**, char**) { return 0; }
+void mysql_library_end(void) {}
+void mysql_thread_end(void) {}
+
+MYSQL* mysql_init(MYSQL*) {
+    static std::atomic<unsigned long> ids(0);
+    FakeConn* conn = new FakeConn{ ++ids, { -1, -1 } };
+    if(socketpair(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0, conn->fds) < 0) {
+        delete conn;
+        return nullptr;
+    }
+    return reinterpret_cast<MYSQL*>(conn);
+}
+
+int mysql_options(MYSQL*, enum mysql_option, const void*) { return 0; }
+
+MYSQL* mysql_real_connect(MYSQL* sql, const char*, const char*, const char*, const char*, unsigned int, const char*, unsigned long) {
+    return sql;
+}
+
+void mysql_close(MYSQL* sql) {
+    FakeConn* conn = reinterpret_cast<FakeConn*>(sql);
+    close(conn->fds[0]);
+    close(conn->fds[1]);
+    delete conn;
+}
+unsigned int mysql_errno(MYSQL*) { return 0; }
+const char* mysql_error(MYSQL*) { return ""; }
+int mysql_ping(MYSQL*) { return 0; }
+unsigned long mysql_thread_id(MYSQL* sql) { return reinterpret_cast<FakeConn*>(sql)->threadId; }
+
+MYSQL_STMT* mysql_stmt_init(MYSQL* sql) {
+    FakeStmt* stmt = new FakeStmt();
+    stmt->conn = reinterpret_cast<FakeConn*>(sql);
+    return reinterpret_cast<MYSQL_STMT*>(stmt);
+}
+SqlBool mysql_stmt_close(MYSQL_STMT* stmt) { delete Stmt(stmt); return 0; }
+
+int mysql_stmt_prepare(MYSQL_STMT* stmt, const char* text, unsigned long len) {
+    Stmt(stmt)->text.assign(text, len);
+    return 0;
+}
+
+SqlBool mysql_stmt_bind_param(MYSQL_STMT* stmt, MYSQL_BIND* bind) { Stmt(stmt)->params = bind; return 0; }
+SqlBool mysql_stmt_bind_result(MYSQL_STMT* stmt, MYSQL_BIND* bind) { Stmt(stmt)->result = bind; return 0; }
+int mysql_stmt_execute(MYSQL_STMT* stmt) { return Execute(*Stmt(stmt)); }
+int mysql_stmt_store_result(MYSQL_STMT*) { return 0; }
+
+int mysql_stmt_fetch(MYSQL_STMT* stmt) {
+    FakeStmt& s = *Stmt(stmt);
+    if(s.next >= s.rows.size()) { return MYSQL_NO_DATA; }
+    const std::string& value = s.rows[s.next++];
+    MYSQL_BIND& bind = s.result[0];
+    *bind.length = value.size();
+    *bind.is_null = 0;
+    memcpy(bind.buffer, value.data(), std::min<size_t>(value.size(), bind.buffer_length));
+    return value.size() > bind.buffer_length ? MYSQL_DATA_TRUNCATED : 0;
+}
+
+SqlBool mysql_stmt_free_result(MYSQL_STMT* stmt) { Stmt(stmt)->rows.clear(); return 0; }
+unsigned int mysql_stmt_errno(MYSQL_STMT* stmt) { return Stmt(stmt)->err; }
+const char* mysql_stmt_error(MYSQL_STMT* stmt) { return Stmt(stmt)->err ? "Duplicate entry" : ""; }
+
+#ifdef SQL_NONBLOCK
+int mysql_stmt_prepare_start(int* ret, MYSQL_STMT* stmt, const char* text, unsigned long len) {
+    Stmt(stmt)->text.assign(text, len);
+    return Start(ret, *Stmt(stmt), PREPARE, RunPrepare);
+}
+int mysql_stmt_prepare_cont(int* ret, MYSQL_STMT* stmt, int ready) { return Cont(ret, *Stmt(stmt), ready, RunPrepare); }
+int mysql_stmt_execute_start(int* ret, MYSQL_STMT* stmt) { return Start(ret, *Stmt(stmt), EXECUTE, RunExecute); }
+int mysql_stmt_execute_cont(int* ret, MYSQL_STMT* stmt, int ready) { return Cont(ret, *Stmt(stmt), ready, RunExecute); }
+int mysql_stmt_store_result_start(int* ret, MYSQL_STMT* stmt) { return Start(ret, *Stmt(stmt), STORE, RunStore); }
+int mysql_stmt_store_result_cont(int* ret, MYSQL_STMT* stmt, int ready) { return Cont(ret, *Stmt(stmt), ready, RunStore); }
+my_socket mysql_get_socket(MYSQL* sql) { return reinterpret_cast<FakeConn*>(sql)->fds[0]; }
+unsigned int mysql_get_timeout_value_ms(const MYSQL*) { return TIMEOUT_MS; }
+#endif
+
+} // extern "C"
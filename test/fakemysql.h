@@ -0,0 +1,35 @@
+#ifndef FAKE_MYSQL_H
+#define FAKE_MYSQL_H
+
+#include <string>
+#include <functional>
+
+/* 测试替身：在进程内实现服务器用到的 MySQL 客户端接口（连接、预处理语句），数据是内存中的 user 表。
+   链接了它的测试不再链接 -lmysqlclient，也不需要数据库服务器。
+   用户名比较不区分大小写，INSERT 遇到重复整条失败（ER_DUP_ENTRY），与 MySQL 默认排序规则、InnoDB 的行为一致。
+   非阻塞接口（SQL_NONBLOCK）默认立即完成；Suspend 之后 mysql_stmt_xxx_start 只记下操作并返回要等待的事件，
+   在 mysql_stmt_xxx_cont 中才执行，连接的 socket 是 socketpair 的一端 */
+namespace FakeMysql {
+
+void Reset();
+void AddUser(const std::string& name, const std::string& pwd);
+bool HasUser(const std::string& name, std::string* pwd = nullptr);
+
+int InsertStatements(); // 执行过的 INSERT 语句数（含失败的）
+int InsertedRows();
+
+/* 非阻塞接口要等待的事件，取值与 MYSQL_WAIT_* 相同：WAIT_READ 时 socket 立即变为可读，WAIT_WRITE 时 socket 一直可写，
+   只有 WAIT_TIMEOUT 时要等 mysql_get_timeout_value_ms 到期；0 为立即完成 */
+const int WAIT_READ = 1;
+const int WAIT_WRITE = 2;
+const int WAIT_TIMEOUT = 8;
+void Suspend(int wait);
+int Resumes();    // mysql_stmt_xxx_cont 的调用次数
+int BadResumes(); // 调用 mysql_stmt_xxx_cont 时要等待的事件并未就绪的次数
+
+/* 每条 INSERT 执行前调用（不持有内部锁），可用来模拟查询与插入之间其他进程写入的同名用户 */
+void OnInsert(std::function<void()> hook);
+
+} // namespace FakeMysql
+
+#endif //FAKE_MYSQL_H
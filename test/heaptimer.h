@@ -9,8 +9,9 @@
 #include <functional> 
 #include <assert.h> 
 #include <chrono>
-#include "../log/log.h"
+#include <vector>
 
+/* 原连接超时定时器（小根堆）：服务器已改用 TimingWheel，这里只作为 timer_bench 的对照 */
 typedef std::function<void()> TimeoutCallBack;
 typedef std::chrono::high_resolution_clock Clock;
 typedef std::chrono::milliseconds MS;
@@ -30,7 +31,7 @@ public:
 
     ~HeapTimer() { clear(); }
     
-    void adjust(int id, int newExpires);
+    void adjust(int id, int timeout);
 
     void add(int id, int timeOut, const TimeoutCallBack& cb);
 
@@ -0,0 +1,199 @@
+#include <gtest/gtest.h>
+#include <string>
+
+#include "http/httprequest.h"
+
+namespace {
+
+/* 与 HttpConn::process 相同的驱动方式：等待异步任务（已在调用线程中完成）时立即再次 parse */
+HTTP_CODE Parse(HttpRequest& request, Buffer& buff) {
+    HTTP_CODE ret = request.parse(buff);
+    while(ret == NO_REQUEST && request.DiskBusy() && !request.WaitDisk()) {
+        ret = request.parse(buff);
+    }
+    return ret;
+}
+
+HTTP_CODE ParseText(HttpRequest& request, Buffer& buff, const std::string& text) {
+    buff.Append(text);
+    return Parse(request, buff);
+}
+
+/* 用户存储替身：只有 alice/secret 能登录，回调在调用线程中直接完成 */
+class FakeUserStore: public UserStore {
+public:
+    void Verify(const std::string& name, const std::string& pwd, bool isLogin, std::function<void(bool)> done) override {
+        done(isLogin && name == "alice" && pwd == "secret");
+    }
+    void Close() override {}
+    const char* Name() const override { return "fake"; }
+};
+
+class HttpRequestTest: public ::testing::Test {
+protected:
+    static void SetUpTestSuite() {
+        DiskIO::Instance()->Init(0); // 磁盘任务在调用线程中直接执行
+        UserStore::Use(&store_);
+    }
+
+    HttpRequest request_;
+    Buffer buff_;
+    static FakeUserStore store_;
+};
+
+FakeUserStore HttpRequestTest::store_;
+
+} // namespace
+
+TEST_F(HttpRequestTest, ParsesRequestLineAndHeaders) {
+    ASSERT_EQ(ParseText(request_, buff_,
+            "GET /index.html HTTP/1.1\r\n"
+            "Host:  localhost:1316 \r\n"
+            "Connection: keep-alive\r\n"
+            "Accept-Encoding: br;q=0, gzip\r\n"
+            "\r\n"), GET_REQUEST);
+    EXPECT_EQ(request_.method(), "GET");
+    EXPECT_EQ(request_.path(), "/index.html");
+    EXPECT_EQ(request_.version(), "1.1");
+    EXPECT_EQ(request_.GetHeader("host"), "localhost:1316"); // 字段名不区分大小写，值去掉首尾空白
+    EXPECT_EQ(request_.GetHeader("X-Missing"), "");
+    EXPECT_TRUE(request_.IsKeepAlive());
+    EXPECT_TRUE(request_.AcceptsEncoding("gzip"));
+    EXPECT_FALSE(request_.AcceptsEncoding("br"));
+    EXPECT_EQ(buff_.ReadableBytes(), 0u);
+}
+
+TEST_F(HttpRequestTest, RewritesDefaultPages) {
+    ASSERT_EQ(ParseText(request_, buff_, "GET / HTTP/1.1\r\n\r\n"), GET_REQUEST);
+    EXPECT_EQ(request_.path(), "/index.html");
+    request_.Init();
+    ASSERT_EQ(ParseText(request_, buff_, "GET /login HTTP/1.1\r\n\r\n"), GET_REQUEST);
+    EXPECT_EQ(request_.path(), "/login.html");
+    request_.Init();
+    ASSERT_EQ(ParseText(request_, buff_, "GET /files/%E4%B8%AD+a.txt HTTP/1.0\r\n\r\n"), GET_REQUEST);
+    EXPECT_EQ(request_.path(), "/files/\xE4\xB8\xAD a.txt");
+    EXPECT_FALSE(request_.IsKeepAlive());
+}
+
+TEST_F(HttpRequestTest, ResumesAcrossPartialReads) {
+    /* 逐字节送入：每次都不完整，视图在缓冲区扩容挪动后仍须指向正确的数据 */
+    Buffer small(8);
+    std::string text = "GET /picture HTTP/1.1\r\nHost: a\r\nUser-Agent: test-agent/1.0\r\nConnection: keep-alive\r\n\r\n";
+    for(size_t i = 0; i + 1 < text.size(); i++) {
+        small.Append(text.data() + i, 1);
+        ASSERT_EQ(Parse(request_, small), NO_REQUEST) << "at byte " << i;
+    }
+    small.Append(text.data() + text.size() - 1, 1);
+    ASSERT_EQ(Parse(request_, small), GET_REQUEST);
+    EXPECT_EQ(request_.path(), "/picture.html");
+    EXPECT_EQ(request_.GetHeader("User-Agent"), "test-agent/1.0");
+    EXPECT_EQ(request_.GetHeader("Host"), "a");
+    EXPECT_TRUE(request_.IsKeepAlive());
+}
+
+TEST_F(HttpRequestTest, LeavesPipelinedRequestInBuffer) {
+    buff_.Append(std::string("GET /a HTTP/1.1\r\nConnection: keep-alive\r\n\r\n"
+                             "GET /b HTTP/1.1\nConnection: keep-alive\n\n")); // 第二个请求只用 LF 换行
+    ASSERT_EQ(Parse(request_, buff_), GET_REQUEST);
+    EXPECT_EQ(request_.path(), "/a");
+    EXPECT_GT(buff_.ReadableBytes(), 0u);
+    request_.Init();
+    ASSERT_EQ(Parse(request_, buff_), GET_REQUEST);
+    EXPECT_EQ(request_.path(), "/b");
+    EXPECT_EQ(request_.GetHeader("Connection"), "keep-alive");
+    EXPECT_EQ(buff_.ReadableBytes(), 0u);
+}
+
+TEST_F(HttpRequestTest, RejectsMalformedHeads) {
+    const char* bad[] = {
+        "GET /index.html\r\n\r\n",                     // 缺少版本
+        "GET  /index.html HTTP/1.1\r\n\r\n",           // 空的路径
+        "GET /index.html FTP/1.1\r\n\r\n",
+        "GET /a HTTP/1.1\r\nNoColon\r\n\r\n",
+        "GET /a HTTP/1.1\r\n: empty-name\r\n\r\n",
+        "GET /a HTTP/1.1\r\nHost: a\rX\n\r\n",         // CR 后不是 LF
+        "POST /a HTTP/1.1\r\nContent-Length: 12x\r\n\r\n",
+        "POST /a HTTP/1.1\r\nContent-Length: 99999999999999999999999\r\n\r\n",
+    };
+    for(const char* text: bad) {
+        HttpRequest request;
+        Buffer buff;
+        EXPECT_EQ(ParseText(request, buff, text), BAD_REQUEST) << text;
+    }
+}
+
+TEST_F(HttpRequestTest, ReadsBodyUpToContentLength) {
+    /* 消息体只取 Content-Length 字节，之后是下一个请求 */
+    ASSERT_EQ(ParseText(request_, buff_,
+            "POST /form HTTP/1.1\r\n"
+            "Content-Type: application/x-www-form-urlencoded\r\n"
+            "Content-Length: 27\r\n"
+            "\r\n"
+            "name=a+b&city=%E5%8C%97%41&"
+            "GET /next HTTP/1.1\r\n\r\n"), GET_REQUEST);
+    EXPECT_EQ(request_.GetPost("name"), "a b");
+    EXPECT_EQ(request_.GetPost("city"), "\xE5\x8C\x97" "A");
+    request_.Init();
+    ASSERT_EQ(Parse(request_, buff_), GET_REQUEST);
+    EXPECT_EQ(request_.path(), "/next");
+}
+
+TEST_F(HttpRequestTest, ReadsBodySplitAcrossReads) {
+    ASSERT_EQ(ParseText(request_, buff_,
+            "POST /form HTTP/1.1\r\nContent-Type: application/x-www-form-urlencoded\r\nContent-Length: 7\r\n\r\nk=v"), NO_REQUEST);
+    ASSERT_EQ(ParseText(request_, buff_, "&x="), NO_REQUEST);
+    ASSERT_EQ(ParseText(request_, buff_, "1"), GET_REQUEST);
+    EXPECT_EQ(request_.GetPost("k"), "v");
+    EXPECT_EQ(request_.GetPost("x"), "1");
+}
+
+TEST_F(HttpRequestTest, RejectsBodyOverLimitBeforeReadingIt) {
+    size_t saved = HttpRequest::maxBodySize;
+    HttpRequest::maxBodySize = 16;
+    EXPECT_EQ(ParseText(request_, buff_, "POST /a HTTP/1.1\r\nContent-Length: 17\r\n\r\n"), PAYLOAD_TOO_LARGE);
+    HttpRequest::maxBodySize = saved;
+}
+
+TEST_F(HttpRequestTest, LoginGoesThroughUserStoreAndSetsSession) {
+    std::string body = "username=alice&password=secret";
+    ASSERT_EQ(ParseText(request_, buff_,
+            "POST /login HTTP/1.1\r\nContent-Type: application/x-www-form-urlencoded\r\nContent-Length: "
+            + std::to_string(body.size()) + "\r\n\r\n" + body), GET_REQUEST);
+    EXPECT_EQ(request_.path(), "/welcome.html");
+    EXPECT_EQ(request_.user(), "alice");
+    std::string cookie = request_.TakeCookie();
+    ASSERT_EQ(cookie.compare(0, 4, "sid="), 0);
+
+    /* 带会话再打开登录页，直接进入欢迎页 */
+    request_.Init();
+    std::string token = cookie.substr(4, cookie.find(';') - 4);
+    ASSERT_EQ(ParseText(request_, buff_, "GET /login.html HTTP/1.1\r\nCookie: a=b; sid=" + token + "\r\n\r\n"), GET_REQUEST);
+    EXPECT_EQ(request_.user(), "alice");
+    EXPECT_EQ(request_.path(), "/welcome.html");
+
+    request_.Init();
+    body = "username=alice&password=wrong";
+    ASSERT_EQ(ParseText(request_, buff_,
+            "POST /login HTTP/1.1\r\nContent-Type: application/x-www-form-urlencoded\r\nContent-Length: "
+            + std::to_string(body.size()) + "\r\n\r\n" + body), GET_REQUEST);
+    EXPECT_EQ(request_.path(), "/error.html");
+    EXPECT_TRUE(request_.TakeCookie().empty());
+}
+
+TEST_F(HttpRequestTest, ReloginReplacesSession) {
+    std::string body = "username=alice&password=secret";
+    std::string login = "POST /login HTTP/1.1\r\nContent-Type: application/x-www-form-urlencoded\r\nContent-Length: "
+                        + std::to_string(body.size()) + "\r\n";
+    ASSERT_EQ(ParseText(request_, buff_, login + "\r\n" + body), GET_REQUEST);
+    std::string cookie = request_.TakeCookie();
+    std::string first = cookie.substr(4, cookie.find(';') - 4);
+
+    /* 带着原会话再次登录：得到新令牌，原令牌作废 */
+    request_.Init();
+    ASSERT_EQ(ParseText(request_, buff_, login + "Cookie: sid=" + first + "\r\n\r\n" + body), GET_REQUEST);
+    cookie = request_.TakeCookie();
+    std::string second = cookie.substr(4, cookie.find(';') - 4);
+    EXPECT_NE(second, first);
+    EXPECT_EQ(SessionTable::Instance()->Find(first), "");
+    EXPECT_EQ(SessionTable::Instance()->Find(second), "alice");
+}
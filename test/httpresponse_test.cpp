@@ -0,0 +1,149 @@
+#include <gtest/gtest.h>
+#include <string>
+
+#include "http/httpresponse.h"
+
+namespace {
+
+/* 响应体用 FileCache::FromMemory 生成，不依赖资源目录 */
+class HttpResponseTest: public ::testing::Test {
+protected:
+    void SetUp() override {
+        for(int i = 0; i < 100; i++) {
+            content_ += static_cast<char>('a' + i % 26);
+        }
+        file_ = FileCache::Instance()->FromMemory("/data.bin", content_, 1);
+    }
+
+    /* 生成响应，返回写入缓冲区的部分（状态行、响应头、multipart 分段头），文件片段见 Parts() */
+    std::string Respond(const std::string& range, const std::string& ifRange = "", FileRef file = nullptr, bool gzip = false) {
+        std::string path = "/data.bin";
+        response_.Init("/tmp/", path, true, 200);
+        response_.SetContent(file ? file : file_);
+        response_.SetAcceptGzip(gzip);
+        response_.SetRange(range, ifRange);
+        Buffer buff;
+        response_.MakeResponse(buff);
+        return buff.RetrieveAllToStr();
+    }
+
+    static bool Has(const std::string& text, const std::string& part) {
+        return text.find(part) != std::string::npos;
+    }
+
+    std::string content_;
+    FileRef file_;
+    HttpResponse response_;
+};
+
+} // namespace
+
+TEST_F(HttpResponseTest, NoRangeSendsWholeFile) {
+    std::string head = Respond("");
+    EXPECT_EQ(response_.Code(), 200);
+    EXPECT_TRUE(Has(head, "Accept-Ranges: bytes\r\n"));
+    EXPECT_TRUE(Has(head, "Content-length: 100\r\n"));
+    ASSERT_EQ(response_.Parts().size(), 1u);
+    EXPECT_EQ(response_.Parts()[0].offset, 0u);
+    EXPECT_EQ(response_.Parts()[0].len, 100u);
+}
+
+TEST_F(HttpResponseTest, SingleRanges) {
+    struct Case { const char* range; size_t offset, len; const char* contentRange; };
+    const Case cases[] = {
+        { "bytes=0-9",     0,  10, "bytes 0-9/100" },
+        { "bytes=90-",     90, 10, "bytes 90-99/100" },
+        { "bytes=-5",      95, 5,  "bytes 95-99/100" },
+        { "bytes=-500",    0,  100, "bytes 0-99/100" },   // 后缀长于文件：整个文件
+        { "bytes=95-1000", 95, 5,  "bytes 95-99/100" },   // 终点截断到文件末尾
+        { "bytes= 10-19 ", 10, 10, "bytes 10-19/100" },
+    };
+    for(const Case& c: cases) {
+        std::string head = Respond(c.range);
+        EXPECT_EQ(response_.Code(), 206) << c.range;
+        EXPECT_TRUE(Has(head, std::string("Content-Range: ") + c.contentRange + "\r\n")) << c.range;
+        EXPECT_TRUE(Has(head, "Content-length: " + std::to_string(c.len) + "\r\n")) << c.range;
+        ASSERT_EQ(response_.Parts().size(), 1u);
+        EXPECT_EQ(response_.Parts()[0].offset, c.offset) << c.range;
+        EXPECT_EQ(response_.Parts()[0].len, c.len) << c.range;
+    }
+}
+
+TEST_F(HttpResponseTest, MultipleRangesUseMultipart) {
+    std::string head = Respond("bytes=0-1, 10-12,-2");
+    EXPECT_EQ(response_.Code(), 206);
+    EXPECT_TRUE(Has(head, "Content-type: multipart/byteranges; boundary="));
+    EXPECT_TRUE(Has(head, "Content-Range: bytes 10-12/100\r\n"));
+    const auto& parts = response_.Parts();
+    ASSERT_EQ(parts.size(), 4u); // 三个区间 + 结束分隔符
+    EXPECT_EQ(parts[0].offset, 0u);   EXPECT_EQ(parts[0].len, 2u);
+    EXPECT_EQ(parts[1].offset, 10u);  EXPECT_EQ(parts[1].len, 3u);
+    EXPECT_EQ(parts[2].offset, 98u);  EXPECT_EQ(parts[2].len, 2u);
+    EXPECT_EQ(parts[3].len, 0u);
+
+    /* Content-length 须等于实际发送的字节数：缓冲区中头部之后的部分加上各文件片段 */
+    size_t bodyStart = head.find("\r\n\r\n") + 4;
+    size_t total = head.size() - bodyStart + 2 + 3 + 2;
+    EXPECT_TRUE(Has(head, "Content-length: " + std::to_string(total) + "\r\n"));
+}
+
+TEST_F(HttpResponseTest, UnsatisfiableRangeIs416) {
+    std::string head = Respond("bytes=100-");
+    EXPECT_EQ(response_.Code(), 416);
+    EXPECT_TRUE(Has(head, "Content-Range: bytes */100\r\n"));
+    Respond("bytes=-0");
+    EXPECT_EQ(response_.Code(), 416);
+}
+
+TEST_F(HttpResponseTest, InvalidRangeIsIgnored) {
+    const char* ignored[] = {
+        "items=0-1", "bytes=", "bytes=a-b", "bytes=5-1", "bytes=-", "bytes=1",
+        "bytes=0-0,1-1,2-2,3-3,4-4,5-5,6-6,7-7,8-8,9-9,10-10,11-11,12-12,13-13,14-14,15-15,16-16", // 区间过多
+    };
+    for(const char* range: ignored) {
+        Respond(range);
+        EXPECT_EQ(response_.Code(), 200) << range;
+        ASSERT_EQ(response_.Parts().size(), 1u);
+        EXPECT_EQ(response_.Parts()[0].len, 100u) << range;
+    }
+}
+
+TEST_F(HttpResponseTest, IfRangeMustMatchCurrentVersion) {
+    std::string etag = "\"" + file_->etag + "\"";
+    Respond("bytes=0-9", etag);
+    EXPECT_EQ(response_.Code(), 206);
+    Respond("bytes=0-9", file_->lastModified);
+    EXPECT_EQ(response_.Code(), 206);
+    Respond("bytes=0-9", "\"other\"");
+    EXPECT_EQ(response_.Code(), 200);
+    Respond("bytes=0-9", "W/" + etag); // If-Range 只接受强校验值
+    EXPECT_EQ(response_.Code(), 200);
+    Respond("bytes=0-9", "Thu, 01 Jan 1970 00:00:00 GMT");
+    EXPECT_EQ(response_.Code(), 200);
+}
+
+TEST_F(HttpResponseTest, IfRangeComparesIdentityEntityWhenGzipAccepted) {
+    /* 可压缩的文本：客户端接受 gzip 时整体响应发送 gzip 版本，带 "-gz" 校验值 */
+    std::string text(4000, 'x');
+    FileRef file = FileCache::Instance()->FromMemory("/data.txt", text, 2);
+    ASSERT_FALSE(file->gzip.empty());
+    std::string etag = "\"" + file->etag + "\"";
+
+    std::string head = Respond("", "", file, true);
+    EXPECT_TRUE(Has(head, "Content-Encoding: gzip\r\n"));
+    EXPECT_TRUE(Has(head, "ETag: \"" + file->etag + "-gz\"\r\n"));
+
+    /* 区间是原文件的字节，If-Range 带原文件的校验值时应满足 */
+    head = Respond("bytes=0-9", etag, file, true);
+    EXPECT_EQ(response_.Code(), 206);
+    EXPECT_FALSE(Has(head, "Content-Encoding"));
+    EXPECT_TRUE(Has(head, "ETag: " + etag + "\r\n"));
+    EXPECT_TRUE(Has(head, "Content-Range: bytes 0-9/4000\r\n"));
+
+    /* gzip 版本的校验值不代表原文件：忽略 Range，整体返回（仍可压缩） */
+    head = Respond("bytes=0-9", "\"" + file->etag + "-gz\"", file, true);
+    EXPECT_EQ(response_.Code(), 200);
+    EXPECT_TRUE(Has(head, "Content-Encoding: gzip\r\n"));
+    ASSERT_EQ(response_.Parts().size(), 1u);
+    EXPECT_EQ(response_.Parts()[0].len, file->gzip.size());
+}
@@ -0,0 +1,142 @@
+#include <gtest/gtest.h>
+#include <future>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>      // mkdtemp
+#include <unistd.h>      // truncate
+#include <sys/stat.h>
+
+#include "pool/localuserstore.h"
+
+namespace {
+
+/* 每个用例使用临时目录中新的日志文件 */
+class LocalUserStoreTest: public ::testing::Test {
+protected:
+    static void SetUpTestSuite() {
+        char dir[] = "/tmp/local_user_store_test_XXXXXX";
+        ASSERT_NE(mkdtemp(dir), nullptr);
+        dir_ = std::string(dir) + "/";
+    }
+
+    static void TearDownTestSuite() {
+        std::string cmd = "rm -rf " + dir_;
+        EXPECT_EQ(system(cmd.c_str()), 0);
+    }
+
+    void SetUp() override {
+        path_ = dir_ + ::testing::UnitTest::GetInstance()->current_test_info()->name() + ".log";
+    }
+
+    void TearDown() override {
+        store_->Close();
+    }
+
+    bool Verify(const std::string& name, const std::string& pwd, bool isLogin) {
+        std::promise<bool> result;
+        store_->Verify(name, pwd, isLogin, [&result](bool ok) { result.set_value(ok); });
+        return result.get_future().get();
+    }
+
+    /* 一次提交多个注册，由写入线程合并写入 */
+    std::vector<bool> Register(const std::vector<std::string>& names) {
+        std::vector<std::promise<bool>> results(names.size());
+        for(size_t i = 0; i < names.size(); i++) {
+            std::promise<bool>* result = &results[i];
+            store_->Verify(names[i], "pw-" + names[i], false, [result](bool ok) { result->set_value(ok); });
+        }
+        std::vector<bool> oks;
+        for(auto& result: results) {
+            oks.push_back(result.get_future().get());
+        }
+        return oks;
+    }
+
+    off_t FileSize() {
+        struct stat st;
+        return stat(path_.c_str(), &st) == 0 ? st.st_size : -1;
+    }
+
+    /* 翻转一个字节的所有位 */
+    void Corrupt(off_t offset) {
+        FILE* fp = fopen(path_.c_str(), "r+b");
+        ASSERT_NE(fp, nullptr);
+        ASSERT_EQ(fseek(fp, offset, SEEK_SET), 0);
+        int ch = fgetc(fp);
+        ASSERT_NE(ch, EOF);
+        ASSERT_EQ(fseek(fp, offset, SEEK_SET), 0);
+        fputc(ch ^ 0xff, fp);
+        fclose(fp);
+    }
+
+    LocalUserStore* store_ = LocalUserStore::Instance();
+    std::string path_;
+    static std::string dir_;
+};
+
+std::string LocalUserStoreTest::dir_;
+
+/* 记录长度：CRC32 + 用户名长度 + 用户名 + 盐 + 摘要 */
+const off_t RECORD = 4 + 2 + 5 + 16 + 32; // 用户名都是 5 个字符
+
+} // namespace
+
+TEST_F(LocalUserStoreTest, ReplaysRegisteredUsers) {
+    ASSERT_TRUE(store_->Init(path_));
+    EXPECT_EQ(Register({ "user1", "user2", "user3", "user1" }), (std::vector<bool>{ true, true, true, false }));
+    store_->Close();
+    EXPECT_EQ(FileSize(), 3 * RECORD);
+
+    ASSERT_TRUE(store_->Init(path_));
+    EXPECT_TRUE(Verify("user2", "pw-user2", true));
+    EXPECT_FALSE(Verify("user2", "wrong", true));
+    EXPECT_FALSE(Verify("user4", "pw-user4", true));
+    EXPECT_FALSE(Verify("user3", "again", false)); // 重放后仍占用
+    EXPECT_TRUE(Verify("user4", "pw-user4", false));
+    store_->Close();
+    EXPECT_EQ(FileSize(), 4 * RECORD);
+}
+
+TEST_F(LocalUserStoreTest, TruncatesTornLastRecord) {
+    ASSERT_TRUE(store_->Init(path_));
+    EXPECT_EQ(Register({ "user1", "user2" }), (std::vector<bool>{ true, true }));
+    store_->Close();
+    ASSERT_EQ(truncate(path_.c_str(), 2 * RECORD - 10), 0); // 最后一条只写了一部分
+
+    ASSERT_TRUE(store_->Init(path_));
+    EXPECT_EQ(FileSize(), RECORD);
+    EXPECT_TRUE(Verify("user1", "pw-user1", true));
+    EXPECT_FALSE(Verify("user2", "pw-user2", true));
+    EXPECT_TRUE(Verify("user2", "pw-user2", false)); // 从截断处接着追加
+    store_->Close();
+
+    ASSERT_TRUE(store_->Init(path_));
+    EXPECT_TRUE(Verify("user2", "pw-user2", true));
+}
+
+TEST_F(LocalUserStoreTest, TruncatesCorruptLastRecord) {
+    ASSERT_TRUE(store_->Init(path_));
+    EXPECT_EQ(Register({ "user1", "user2" }), (std::vector<bool>{ true, true }));
+    store_->Close();
+    Corrupt(2 * RECORD - 1); // 最后一条的摘要损坏
+
+    ASSERT_TRUE(store_->Init(path_));
+    EXPECT_EQ(FileSize(), RECORD);
+    EXPECT_TRUE(Verify("user1", "pw-user1", true));
+    EXPECT_FALSE(Verify("user2", "pw-user2", true));
+}
+
+TEST_F(LocalUserStoreTest, RefusesCorruptRecordInTheMiddle) {
+    ASSERT_TRUE(store_->Init(path_));
+    EXPECT_EQ(Register({ "user1", "user2", "user3" }), (std::vector<bool>{ true, true, true }));
+    store_->Close();
+
+    Corrupt(RECORD + 8); // 第二条的用户名损坏
+    EXPECT_FALSE(store_->Init(path_));
+    EXPECT_EQ(FileSize(), 3 * RECORD); // 不截断，后面的用户还在
+
+    Corrupt(RECORD + 5); // 用户名长度的高字节损坏，超过上限
+    EXPECT_FALSE(store_->Init(path_));
+    EXPECT_EQ(FileSize(), 3 * RECORD);
+}
@@ -0,0 +1,101 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <string>
+#include <stdio.h>
+#include <stdlib.h>      // mkdtemp
+#include <unistd.h>
+
+#include "http/httpconn.h"
+
+/* 统计 operator new 次数：验证缓存命中时解析请求、生成静态文件响应的路径上没有堆分配 */
+static std::atomic<size_t> g_allocs(0);
+
+void* operator new(size_t size) {
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if(!p) { throw std::bad_alloc(); }
+    return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+namespace {
+
+class ResponseAllocTest: public ::testing::Test {
+protected:
+    /* 资源目录路径长于 std::string 的短字符串优化，逐请求构造 string 就会分配 */
+    static void SetUpTestSuite() {
+        char dir[] = "/tmp/nano_alloc_test_XXXXXX";
+        ASSERT_NE(mkdtemp(dir), nullptr);
+        root_ = std::string(dir) + "/";
+        FILE* fp = fopen((root_ + "style.css").c_str(), "w");
+        ASSERT_NE(fp, nullptr);
+        for(int i = 0; i < 200; i++) {
+            fputs("body { margin: 0; padding: 0; }\n", fp);
+        }
+        fclose(fp);
+        FileCache::Instance()->Init(root_, 64 << 20, 1 << 20);
+        HttpConn::srcDir = root_.c_str();
+    }
+
+    static void TearDownTestSuite() {
+        FileCache::Instance()->Close();
+        unlink((root_ + "style.css").c_str());
+        rmdir(root_.c_str());
+    }
+
+    /* 与 HttpConn::process 对一个完整 GET 请求的处理相同 */
+    int Serve(const std::string& text) {
+        readBuff_.Append(text.data(), text.size());
+        EXPECT_EQ(request_.parse(readBuff_), GET_REQUEST);
+        response_.Init(HttpConn::srcDir, request_.path(), request_.IsKeepAlive(), 200);
+        response_.SetContent(request_.TakeReply());
+        response_.SetCookie(request_.TakeCookie());
+        response_.SetRange(request_.GetHeader("Range"), request_.GetHeader("If-Range"));
+        response_.SetAcceptGzip(request_.AcceptsEncoding("gzip"));
+        response_.SetConditional(request_.GetHeader("If-None-Match"), request_.GetHeader("If-Modified-Since"));
+        request_.Init();
+        response_.MakeResponse(writeBuff_);
+        FileRef file = response_.ReleaseFile(); // 发送完毕后释放
+        writeBuff_.RetrieveAll();
+        return response_.Code();
+    }
+
+    static std::string root_;
+    HttpRequest request_;
+    HttpResponse response_;
+    Buffer readBuff_;
+    Buffer writeBuff_;
+};
+
+std::string ResponseAllocTest::root_;
+
+} // namespace
+
+TEST_F(ResponseAllocTest, CachedStaticResponsesDoNotAllocate) {
+    const std::string plain = "GET /style.css HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n\r\n";
+    const std::string gzip = "GET /style.css HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n"
+                             "Accept-Encoding: gzip, deflate, br\r\nUser-Agent: Mozilla/5.0 (X11; Linux x86_64)\r\n\r\n";
+    const std::string range = "GET /style.css HTTP/1.1\r\nConnection: keep-alive\r\nRange: bytes=100-199\r\n\r\n";
+    ASSERT_EQ(Serve(plain), 200); // 预热：加载进缓存，各成员的容量增长到位
+    FileRef file = FileCache::Instance()->Get(root_ + "style.css");
+    ASSERT_FALSE(file->gzip.empty());
+    const std::string conditional = "GET /style.css HTTP/1.1\r\nConnection: keep-alive\r\nAccept-Encoding: gzip\r\n"
+                                    "If-None-Match: \"" + file->etag + "-gz\"\r\n\r\n";
+    file.reset();
+    ASSERT_EQ(Serve(gzip), 200);
+    ASSERT_EQ(Serve(range), 206);
+    ASSERT_EQ(Serve(conditional), 304);
+
+    size_t before = g_allocs.load();
+    for(int i = 0; i < 1000; i++) {
+        Serve(plain);
+        Serve(gzip);
+        Serve(range);
+        Serve(conditional);
+    }
+    EXPECT_EQ(g_allocs.load() - before, 0u) << "allocations for 4000 responses";
+}
@@ -0,0 +1,122 @@
+#include <gtest/gtest.h>
+#include <future>
+#include <string>
+#include <vector>
+
+#include "fakemysql.h"
+#include "pool/sqlasync.h"
+
+namespace {
+
+/* 连接池与 SqlAsync 连到 FakeMysql；各用例使用不同的用户名，避开 UserCache 中前面用例留下的记录 */
+class SqlAsyncTest: public ::testing::Test {
+protected:
+    static void SetUpTestSuite() {
+        SqlConnPool::Instance()->Init("localhost", 3306, "user", "pwd", "db", 2, 2);
+        SqlAsync::Instance()->Init(SqlConnPool::Instance(), 2);
+    }
+
+    static void TearDownTestSuite() {
+        SqlAsync::Instance()->Close();
+        SqlConnPool::Instance()->ClosePool();
+    }
+
+    void SetUp() override {
+        FakeMysql::Reset();
+    }
+
+    /* 同时提交一组注册（进入同一批次），等全部回调后按提交顺序返回结果 */
+    static std::vector<bool> Register(const std::vector<std::string>& names) {
+        std::vector<std::promise<bool>> results(names.size());
+        for(size_t i = 0; i < names.size(); i++) {
+            std::promise<bool>* result = &results[i];
+            SqlAsync::Instance()->Verify(names[i], "pw-" + names[i], false, [result](bool ok) { result->set_value(ok); });
+        }
+        std::vector<bool> oks;
+        for(auto& result: results) {
+            oks.push_back(result.get_future().get());
+        }
+        return oks;
+    }
+
+    static bool Login(const std::string& name, const std::string& pwd) {
+        std::promise<bool> result;
+        SqlAsync::Instance()->Verify(name, pwd, true, [&result](bool ok) { result.set_value(ok); });
+        return result.get_future().get();
+    }
+};
+
+} // namespace
+
+TEST_F(SqlAsyncTest, ConcurrentRegistrationsAreBatched) {
+    std::vector<std::string> names;
+    for(int i = 0; i < 10; i++) {
+        names.push_back("batch" + std::to_string(i));
+    }
+    EXPECT_EQ(Register(names), std::vector<bool>(names.size(), true));
+    EXPECT_EQ(FakeMysql::InsertedRows(), 10);
+    EXPECT_LT(FakeMysql::InsertStatements(), 10); // 合并成批插入
+    std::string pwd;
+    ASSERT_TRUE(FakeMysql::HasUser("batch3", &pwd));
+    EXPECT_EQ(pwd, "pw-batch3");
+    EXPECT_TRUE(Login("batch3", "pw-batch3"));
+    EXPECT_FALSE(Login("batch3", "wrong"));
+}
+
+TEST_F(SqlAsyncTest, CaseDuplicatesInBatchAreRejected) {
+    /* 只差大小写的用户名在数据库中视为相同：先到的注册成功，其余立即失败，不会让整批 INSERT 失败 */
+    EXPECT_EQ(Register({ "Alice", "other", "alice", "ALICE" }), (std::vector<bool>{ true, true, false, false }));
+    std::string pwd;
+    ASSERT_TRUE(FakeMysql::HasUser("alice", &pwd));
+    EXPECT_EQ(pwd, "pw-Alice");
+    EXPECT_TRUE(FakeMysql::HasUser("other"));
+}
+
+TEST_F(SqlAsyncTest, ExistingNameFailsOnlyItsRow) {
+    FakeMysql::AddUser("Carol", "old");
+    EXPECT_EQ(Register({ "dave", "carol", "erin" }), (std::vector<bool>{ true, false, true }));
+    std::string pwd;
+    ASSERT_TRUE(FakeMysql::HasUser("carol", &pwd));
+    EXPECT_EQ(pwd, "old");
+}
+
+TEST_F(SqlAsyncTest, DuplicateAtInsertTimeRetriesRemainingRows) {
+    /* 查询用户名之后、插入之前，另一个进程注册了 frank：整条 INSERT 失败，重新查询后只插入其余的 */
+    bool raced = false;
+    FakeMysql::OnInsert([&raced] {
+        if(!raced) {
+            raced = true;
+            FakeMysql::AddUser("Frank", "theirs");
+        }
+    });
+    EXPECT_EQ(Register({ "gina", "frank", "hank" }), (std::vector<bool>{ true, false, true }));
+    EXPECT_TRUE(raced);
+    EXPECT_EQ(FakeMysql::InsertedRows(), 2);
+    std::string pwd;
+    ASSERT_TRUE(FakeMysql::HasUser("frank", &pwd));
+    EXPECT_EQ(pwd, "theirs");
+}
+
+#ifdef SQL_NONBLOCK
+/* 非阻塞 API 的每一步都先挂起：socket 可读、可写、只能等超时三种情况下，Step_ 都在事件就绪后继续，结果与立即完成时相同 */
+TEST_F(SqlAsyncTest, SuspendedStepsResumeOnEvents) {
+    int round = 0;
+    for(int wait: { FakeMysql::WAIT_READ, FakeMysql::WAIT_WRITE, FakeMysql::WAIT_TIMEOUT,
+                    FakeMysql::WAIT_READ | FakeMysql::WAIT_TIMEOUT }) {
+        SCOPED_TRACE(wait);
+        FakeMysql::Reset();
+        FakeMysql::AddUser("taken" + std::to_string(round), "old");
+        FakeMysql::Suspend(wait);
+        std::string a = "resume" + std::to_string(round) + "a";
+        std::string b = "resume" + std::to_string(round) + "b";
+        EXPECT_EQ(Register({ a, "taken" + std::to_string(round), b }), (std::vector<bool>{ true, false, true }));
+        EXPECT_EQ(FakeMysql::InsertedRows(), 2);
+        FakeMysql::AddUser("direct" + std::to_string(round), "pw"); // 不经过 UserCache，登录要查询数据库
+        EXPECT_TRUE(Login("direct" + std::to_string(round), "pw"));
+        EXPECT_FALSE(Login("direct" + std::to_string(round), "wrong"));
+        EXPECT_GE(FakeMysql::Resumes(), 4); // 查询用户名（执行、取结果）、插入、登录查询
+        EXPECT_EQ(FakeMysql::BadResumes(), 0);
+        round++;
+    }
+}
+#endif
@@ -0,0 +1,98 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include <thread>
+
+#include "pool/threadpool.h"
+
+/* 统计全进程的 operator new 次数，验证稳定运行时派发任务没有堆分配 */
+static std::atomic<size_t> g_allocs(0);
+
+void* operator new(size_t size) {
+    g_allocs.fetch_add(1, std::memory_order_relaxed);
+    void* p = malloc(size ? size : 1);
+    if(!p) { throw std::bad_alloc(); }
+    return p;
+}
+
+void operator delete(void* p) noexcept { free(p); }
+void operator delete(void* p, size_t) noexcept { free(p); }
+
+namespace {
+
+const int BATCH = 512; // 不超过全局队列的初始容量，预热后环形数组不再扩容
+const int ROUNDS = 200;
+
+void WaitFor(const std::atomic<int>& done, int target) {
+    while(done.load(std::memory_order_acquire) < target) {
+        std::this_thread::yield();
+    }
+}
+
+/* 外部线程（epoll 主线程）提交：任务进全局注入队列 */
+void DispatchFromOutside(ThreadPool& pool, std::atomic<int>& done, int rounds) {
+    for(int r = 0; r < rounds; r++) {
+        int target = done.load() + BATCH;
+        for(int i = 0; i < BATCH; i++) {
+            pool.AddTask([&done] { done.fetch_add(1, std::memory_order_release); });
+        }
+        WaitFor(done, target);
+    }
+}
+
+struct Chain {
+    ThreadPool* pool;
+    std::atomic<int>* done;
+    int left;
+};
+
+/* 工作线程内提交：任务进本地队列，其他线程窃取 */
+void RunChain(Chain chain) {
+    chain.done->fetch_add(1, std::memory_order_release);
+    if(chain.left > 0) {
+        Chain next = { chain.pool, chain.done, chain.left - 1 };
+        chain.pool->AddTask([next] { RunChain(next); });
+    }
+}
+
+void DispatchFromWorkers(ThreadPool& pool, std::atomic<int>& done, int rounds) {
+    for(int r = 0; r < rounds; r++) {
+        int target = done.load() + 4 * (BATCH / 4);
+        for(int i = 0; i < 4; i++) {
+            Chain chain = { &pool, &done, BATCH / 4 - 1 };
+            pool.AddTask([chain] { RunChain(chain); });
+        }
+        WaitFor(done, target);
+    }
+}
+
+} // namespace
+
+TEST(ThreadPoolTest, RunsEveryTask) {
+    ThreadPool pool(4);
+    std::atomic<int> done(0);
+    DispatchFromOutside(pool, done, 10);
+    DispatchFromWorkers(pool, done, 10);
+    EXPECT_EQ(done.load(), 20 * BATCH);
+}
+
+TEST(ThreadPoolTest, ExternalDispatchDoesNotAllocate) {
+    ThreadPool pool(4);
+    std::atomic<int> done(0);
+    DispatchFromOutside(pool, done, 2); // 预热：线程启动、thread_local 初始化
+
+    size_t before = g_allocs.load();
+    DispatchFromOutside(pool, done, ROUNDS);
+    EXPECT_EQ(g_allocs.load() - before, 0u) << "allocations for " << ROUNDS * BATCH << " tasks";
+}
+
+TEST(ThreadPoolTest, WorkerDispatchDoesNotAllocate) {
+    ThreadPool pool(4);
+    std::atomic<int> done(0);
+    DispatchFromWorkers(pool, done, 2);
+
+    size_t before = g_allocs.load();
+    DispatchFromWorkers(pool, done, ROUNDS);
+    EXPECT_EQ(g_allocs.load() - before, 0u) << "allocations for " << ROUNDS * BATCH << " tasks";
+}
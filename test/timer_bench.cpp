@@ -0,0 +1,100 @@
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "heaptimer.h"
+#include "timer/timingwheel.h"
+
+/* HeapTimer 与 TimingWheel 的对比：定时器数 10k / 100k / 1M，超时 60s 附近随机抖动，与连接超时的用法一致
+   Add：建立 N 个定时器；Adjust：N 个定时器在册时随机刷新（每个请求一次）；DoWork：逐个删除并回调（连接关闭） */
+
+namespace {
+
+const int TIMEOUT_MS = 60000;
+
+std::vector<int> Timeouts(int n) {
+    std::mt19937 rng(n);
+    std::uniform_int_distribution<int> jitter(0, 5000);
+    std::vector<int> res(n);
+    for(int i = 0; i < n; i++) {
+        res[i] = TIMEOUT_MS + jitter(rng);
+    }
+    return res;
+}
+
+std::vector<int> Shuffled(int n) {
+    std::vector<int> ids(n);
+    for(int i = 0; i < n; i++) { ids[i] = i; }
+    std::shuffle(ids.begin(), ids.end(), std::mt19937(n + 1));
+    return ids;
+}
+
+template<class Timer>
+void BM_Add(benchmark::State& state) {
+    int n = static_cast<int>(state.range(0));
+    std::vector<int> timeouts = Timeouts(n);
+    for(auto _ : state) {
+        Timer timer;
+        for(int i = 0; i < n; i++) {
+            timer.add(i, timeouts[i], [] {});
+        }
+        benchmark::DoNotOptimize(timer);
+        state.PauseTiming(); // 析构不计时
+        timer.clear();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+
+template<class Timer>
+void BM_Adjust(benchmark::State& state) {
+    int n = static_cast<int>(state.range(0));
+    std::vector<int> timeouts = Timeouts(n);
+    std::vector<int> ids = Shuffled(n);
+    Timer timer;
+    for(int i = 0; i < n; i++) {
+        timer.add(i, timeouts[i], [] {});
+    }
+    size_t k = 0;
+    for(auto _ : state) {
+        int id = ids[k];
+        timer.adjust(id, timeouts[id]);
+        if(++k == ids.size()) { k = 0; }
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+template<class Timer>
+void BM_DoWork(benchmark::State& state) {
+    int n = static_cast<int>(state.range(0));
+    std::vector<int> timeouts = Timeouts(n);
+    std::vector<int> ids = Shuffled(n);
+    for(auto _ : state) {
+        state.PauseTiming();
+        Timer timer;
+        for(int i = 0; i < n; i++) {
+            timer.add(i, timeouts[i], [] {});
+        }
+        state.ResumeTiming();
+        for(int id: ids) {
+            timer.doWork(id);
+        }
+        benchmark::DoNotOptimize(timer);
+    }
+    state.SetItemsProcessed(state.iterations() * n);
+}
+
+} // namespace
+
+#define TIMER_BENCH(func, timer) \
+    BENCHMARK_TEMPLATE(func, timer)->Arg(10000)->Arg(100000)->Arg(1000000)->Unit(benchmark::kMicrosecond)
+
+TIMER_BENCH(BM_Add, HeapTimer);
+TIMER_BENCH(BM_Add, TimingWheel);
+TIMER_BENCH(BM_Adjust, HeapTimer);
+TIMER_BENCH(BM_Adjust, TimingWheel);
+TIMER_BENCH(BM_DoWork, HeapTimer);
+TIMER_BENCH(BM_DoWork, TimingWheel);
+
+BENCHMARK_MAIN();
@@ -0,0 +1,69 @@
+#include <gtest/gtest.h>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "timer/timingwheel.h"
+
+namespace {
+
+int64_t NowMs() {
+    return std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/* 像 epoll 循环一样按 GetNextTick() 的返回值睡眠，直到没有定时器；返回循环次数 */
+int RunUntilEmpty(TimingWheel& wheel, int64_t limitMs) {
+    int loops = 0;
+    int64_t deadline = NowMs() + limitMs;
+    int next;
+    while((next = wheel.GetNextTick()) >= 0 && NowMs() < deadline) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(next));
+        loops++;
+    }
+    return loops;
+}
+
+} // namespace
+
+TEST(TimingWheelTest, FiresEachTimerNoEarlierThanItsTimeout) {
+    TimingWheel wheel;
+    /* 覆盖第 0 层（< 256ms）和第 1 层的级联 */
+    const int timeouts[] = { 1, 7, 40, 255, 256, 300, 700 };
+    const int n = sizeof(timeouts) / sizeof(timeouts[0]);
+    std::vector<int64_t> fired(n, 0);
+    int64_t start = NowMs();
+    for(int i = 0; i < n; i++) {
+        wheel.add(i, timeouts[i], [&fired, i] { fired[i] = NowMs(); });
+    }
+    RunUntilEmpty(wheel, 3000);
+    for(int i = 0; i < n; i++) {
+        ASSERT_GT(fired[i], 0) << "timer " << i << " never fired";
+        EXPECT_GE(fired[i] - start, timeouts[i]);
+        EXPECT_LT(fired[i] - start, timeouts[i] + 100);
+    }
+}
+
+TEST(TimingWheelTest, AdjustPostponesAndCancelDrops) {
+    TimingWheel wheel;
+    bool adjusted = false, cancelled = false;
+    int64_t start = NowMs(), adjustedAt = 0;
+    wheel.add(3, 20, [&] { adjusted = true; adjustedAt = NowMs(); });
+    wheel.add(4, 20, [&] { cancelled = true; });
+    wheel.adjust(3, 300); // 延后：惰性重排，结点留在原槽
+    wheel.cancel(4);
+    RunUntilEmpty(wheel, 3000);
+    EXPECT_TRUE(adjusted);
+    EXPECT_FALSE(cancelled);
+    EXPECT_GE(adjustedAt - start, 300);
+}
+
+TEST(TimingWheelTest, IdleGapIsSkippedInsteadOfWalked) {
+    TimingWheel wheel;
+    bool fired = false;
+    wheel.add(0, 1500, [&] { fired = true; });
+    int loops = RunUntilEmpty(wheel, 5000);
+    EXPECT_TRUE(fired);
+    /* 每次等待都直接到下一个级联时刻或到期时刻，而不是每毫秒醒来一次 */
+    EXPECT_LE(loops, 12);
+}
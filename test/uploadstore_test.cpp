@@ -0,0 +1,160 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+#include <stdlib.h>      // mkdtemp
+#include <sys/stat.h>
+#include <openssl/evp.h>
+
+#include "http/uploadstore.h"
+
+namespace {
+
+std::string Sha256(const std::string& data) {
+    unsigned char md[EVP_MAX_MD_SIZE];
+    unsigned int len = 0;
+    EVP_Digest(data.data(), data.size(), md, &len, EVP_sha256(), nullptr);
+    static const char HEX[] = "0123456789abcdef";
+    std::string hex;
+    for(unsigned int i = 0; i < len; i++) {
+        hex += HEX[md[i] >> 4];
+        hex += HEX[md[i] & 15];
+    }
+    return hex;
+}
+
+std::string ReadFile(const std::string& path) {
+    std::string data;
+    if(FILE* fp = fopen(path.c_str(), "rb")) {
+        char buf[4096];
+        size_t n;
+        while((n = fread(buf, 1, sizeof(buf), fp)) > 0) { data.append(buf, n); }
+        fclose(fp);
+    }
+    return data;
+}
+
+/* 上传目录为临时目录，各用例使用不同的文件名 */
+class UploadStoreTest: public ::testing::Test {
+protected:
+    static void SetUpTestSuite() {
+        char dir[] = "/tmp/upload_store_test_XXXXXX";
+        ASSERT_NE(mkdtemp(dir), nullptr);
+        dir_ = std::string(dir) + "/";
+        UploadStore::Instance()->Init(dir_);
+    }
+
+    static void TearDownTestSuite() {
+        std::string cmd = "rm -rf " + dir_;
+        EXPECT_EQ(system(cmd.c_str()), 0);
+    }
+
+    void SetUp() override {
+        for(int i = 0; i < 100000; i++) {
+            content_ += static_cast<char>('a' + i * 7 % 26);
+        }
+    }
+
+    UploadStore::Status Put(const std::string& id, size_t offset, size_t len) {
+        UploadStore::SessionRef session = store_->Find(id);
+        return session ? UploadStore::Write(*session, offset, content_.data() + offset, len) : UploadStore::NOT_FOUND;
+    }
+
+    UploadStore* store_ = UploadStore::Instance();
+    std::string content_;
+    static std::string dir_;
+};
+
+std::string UploadStoreTest::dir_;
+
+} // namespace
+
+TEST_F(UploadStoreTest, InOrderChunksComplete) {
+    std::string id = store_->Create("in-order.bin", content_.size());
+    ASSERT_FALSE(id.empty());
+    for(size_t offset = 0; offset < content_.size(); offset += 30000) {
+        ASSERT_EQ(Put(id, offset, std::min<size_t>(30000, content_.size() - offset)), UploadStore::OK);
+    }
+    Json::Value result;
+    ASSERT_EQ(store_->Finalize(id, Sha256(content_), result), UploadStore::OK);
+    EXPECT_EQ(result["sha256"].asString(), Sha256(content_));
+    EXPECT_EQ(ReadFile(dir_ + "in-order.bin"), content_);
+    EXPECT_EQ(store_->Find(id), nullptr); // 完成后会话结束
+}
+
+TEST_F(UploadStoreTest, OutOfOrderChunksAreHashedFromFile) {
+    std::string id = store_->Create("out-of-order.bin", content_.size());
+    ASSERT_FALSE(id.empty());
+    ASSERT_EQ(Put(id, 60000, 40000), UploadStore::OK);
+    ASSERT_EQ(Put(id, 0, 30000), UploadStore::OK);
+
+    Json::Value result;
+    EXPECT_EQ(store_->Finalize(id, "", result), UploadStore::INCOMPLETE);
+    Json::Value status = UploadStore::Describe(*store_->Find(id));
+    ASSERT_EQ(status["received"].size(), 2u);
+    EXPECT_EQ(status["received"][0][1].asUInt64(), 30000u);
+    EXPECT_EQ(status["received"][1][0].asUInt64(), 60000u);
+
+    ASSERT_EQ(Put(id, 30000, 30000), UploadStore::OK);
+    ASSERT_EQ(store_->Finalize(id, Sha256(content_), result), UploadStore::OK);
+    EXPECT_EQ(ReadFile(dir_ + "out-of-order.bin"), content_);
+}
+
+TEST_F(UploadStoreTest, ResentRangeOverHashedPrefixIsRehashed) {
+    std::string id = store_->Create("resent.bin", content_.size());
+    ASSERT_FALSE(id.empty());
+    UploadStore::SessionRef session = store_->Find(id);
+    std::string garbage(20000, '#');
+    ASSERT_EQ(UploadStore::Write(*session, 0, garbage.data(), garbage.size()), UploadStore::OK);
+    /* 重传覆盖了已计入摘要的前缀，内容与之前不同 */
+    ASSERT_EQ(Put(id, 10000, content_.size() - 10000), UploadStore::OK);
+    ASSERT_EQ(Put(id, 0, 10000), UploadStore::OK);
+    Json::Value result;
+    ASSERT_EQ(store_->Finalize(id, Sha256(content_), result), UploadStore::OK);
+    EXPECT_EQ(ReadFile(dir_ + "resent.bin"), content_);
+}
+
+TEST_F(UploadStoreTest, RejectsBadRangeAndMismatch) {
+    std::string id = store_->Create("mismatch.bin", content_.size());
+    ASSERT_FALSE(id.empty());
+    UploadStore::SessionRef session = store_->Find(id);
+    EXPECT_EQ(UploadStore::Write(*session, content_.size(), "x", 1), UploadStore::BAD_RANGE);
+    ASSERT_EQ(Put(id, 0, content_.size()), UploadStore::OK);
+    Json::Value result;
+    EXPECT_EQ(store_->Finalize(id, std::string(64, '0'), result), UploadStore::MISMATCH);
+    EXPECT_EQ(store_->Find(id), nullptr); // 校验失败会话作废
+    struct stat st;
+    EXPECT_NE(stat((dir_ + "mismatch.bin").c_str(), &st), 0);
+    EXPECT_EQ(UploadStore::Write(*session, 0, "x", 1), UploadStore::NOT_FOUND);
+}
+
+TEST_F(UploadStoreTest, SameContentIsStoredOnce) {
+    Json::Value result;
+    for(const char* name: { "dedup-a.bin", "dedup-b.bin" }) {
+        std::string id = store_->Create(name, content_.size());
+        ASSERT_FALSE(id.empty());
+        ASSERT_EQ(Put(id, 0, content_.size()), UploadStore::OK);
+        ASSERT_EQ(store_->Finalize(id, "", result), UploadStore::OK);
+    }
+    EXPECT_TRUE(result["deduplicated"].asBool());
+    struct stat a, b;
+    ASSERT_EQ(stat((dir_ + "dedup-a.bin").c_str(), &a), 0);
+    ASSERT_EQ(stat((dir_ + "dedup-b.bin").c_str(), &b), 0);
+    EXPECT_EQ(a.st_ino, b.st_ino);
+}
+
+TEST_F(UploadStoreTest, RejectsInvalidNamesAndCapsSessions) {
+    EXPECT_TRUE(store_->Create("../escape", 1).empty());
+    EXPECT_TRUE(store_->Create(".hidden", 1).empty());
+
+    std::vector<std::string> ids;
+    for(;;) {
+        std::string id = store_->Create("many.bin", 16);
+        if(id.empty()) { break; }
+        ids.push_back(id);
+        ASSERT_LT(ids.size(), 100000u);
+    }
+    EXPECT_GT(ids.size(), 0u);
+    store_->Remove(ids.back());
+    EXPECT_FALSE(store_->Create("many.bin", 16).empty()); // 腾出位置后可以再建立
+    store_->Init(dir_); // 清空会话，删除临时文件
+}